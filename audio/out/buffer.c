@@ -20,6 +20,7 @@
 #include <math.h>
 #include <errno.h>
 #include <assert.h>
+#include <stdatomic.h>
 
 #include "ao.h"
 #include "internal.h"
@@ -61,7 +62,7 @@ struct buffer_state {
     bool paused;                // logically paused
     bool hw_paused;             // driver->set_pause() was used successfully
 
-    int64_t end_time_ns;        // absolute output time of last played sample
+    _Atomic int64_t end_time_ns; // absolute output time of last played sample
     int64_t queued_time_ns;     // duration of samples that have been queued to
                                 // the device but have not been played.
                                 // This field is only set in ao_set_paused(),
@@ -70,19 +71,36 @@ struct buffer_state {
 
     bool initial_unblocked;
 
+    mp_thread thread;           // thread shoveling data to AO or ring
+    bool thread_valid;          // thread is running
+
     // "Push" AOs only (AOs with driver->write).
     bool recover_pause;         // non-hw_paused: needs to recover delay
     struct mp_pcm_state prepause_state;
-    mp_thread thread;           // thread shoveling data to AO
-    bool thread_valid;          // thread is running
     struct mp_aframe *temp_buf;
 
+    // "Pull" AOs only. The thread copies audio from the queue into the ring
+    // (with lock held), and ao_read_data() reads from it without locking.
+    // Positions are total sample counts; the ring index is pos & (size - 1).
+    uint8_t *ring[MP_NUM_CHANNELS]; // per plane
+    int ring_size;              // in samples, power of 2 (immutable)
+    _Atomic uint64_t ring_write; // end of written data (written locked)
+    _Atomic uint64_t ring_read; // end of read data (written by callback)
+    _Atomic uint64_t ring_reset; // data before this was discarded
+    atomic_bool ring_busy;      // callback is reading from the ring
+    atomic_bool ring_eof;       // EOF after the last written sample
+    atomic_uint ring_state;     // odd if the callback should play audio
+    atomic_uint ring_underrun;  // ring_state at last underrun, or 0
+    atomic_int ring_max_request; // largest callback request (written by callback)
+    bool ring_size_warned;
+
     // --- protected by pt_lock
     bool need_wakeup;
     bool terminate;             // exit thread
 };
 
 static MP_THREAD_VOID ao_thread(void *arg);
+static void fill_ring(struct ao *ao);
 
 void ao_wakeup(struct ao *ao)
 {
@@ -177,25 +195,43 @@ static int read_buffer(struct ao *ao, void **data, int samples, bool *eof,
     return pos;
 }
 
-static int ao_read_data_locked(struct ao *ao, void **data, int samples,
-                               int64_t out_time_ns, bool *eof, bool pad_silence)
+// Copy samples between the ring and data, starting at ring position pos.
+static void ring_copy(struct ao *ao, uint64_t pos, void **data, int samples,
+                      bool to_ring)
 {
     struct buffer_state *p = ao->buffer_state;
-    assert(!ao->driver->write);
-
-    int pos = read_buffer(ao, data, samples, eof, pad_silence);
-
-    if (pos > 0)
-        p->end_time_ns = out_time_ns;
-
-    if (pos < samples && p->playing && !p->paused) {
-        p->playing = false;
-        ao->wakeup_cb(ao->wakeup_ctx);
-        // For ao_drain().
-        mp_cond_broadcast(&p->wakeup);
+    int done = 0;
+    while (done < samples) {
+        int offset = (pos + done) & (p->ring_size - 1);
+        int copy = MPMIN(samples - done, p->ring_size - offset);
+        for (int n = 0; n < ao->num_planes; n++) {
+            char *ring = (char *)p->ring[n] + offset * ao->sstride;
+            char *buf = (char *)data[n] + done * ao->sstride;
+            if (to_ring) {
+                memcpy(ring, buf, copy * ao->sstride);
+            } else {
+                memcpy(buf, ring, copy * ao->sstride);
+            }
+        }
+        done += copy;
     }
+}
 
-    return pos;
+// Number of samples in the ring that still have to be played.
+static int64_t get_ring_samples(struct buffer_state *p)
+{
+    uint64_t read = MPMAX(atomic_load(&p->ring_read),
+                          atomic_load(&p->ring_reset));
+    return atomic_load(&p->ring_write) - read;
+}
+
+// called locked
+static void update_ring_state(struct buffer_state *p)
+{
+    unsigned int state = atomic_load(&p->ring_state);
+    bool active = p->playing && !p->paused;
+    if (active != (state & 1))
+        atomic_store(&p->ring_state, state + 1);
 }
 
 // Read the given amount of samples in the user-provided data buffer. Returns
@@ -206,29 +242,147 @@ static int ao_read_data_locked(struct ao *ao, void **data, int samples,
 // If this is called in paused mode, it will always return 0.
 // The caller should set out_time_ns to the expected delay until the last sample
 // reaches the speakers, in nanoseconds, using mp_time_ns() as reference.
+// This reads from a ring that is filled by a separate thread, and never takes
+// a lock or allocates, so it can be called from a realtime callback. The
+// blocking parameter is ignored for this reason.
 int ao_read_data(struct ao *ao, void **data, int samples, int64_t out_time_ns, bool *eof, bool pad_silence, bool blocking)
 {
     struct buffer_state *p = ao->buffer_state;
-
-    if (blocking) {
-        mp_mutex_lock(&p->lock);
-    } else if (mp_mutex_trylock(&p->lock)) {
-        return 0;
-    }
+    assert(!ao->driver->write);
 
     bool eof_buf;
     if (eof == NULL) {
         // This is a public API. We want to reduce the cognitive burden of the caller.
         eof = &eof_buf;
     }
+    *eof = false;
 
-    int pos = ao_read_data_locked(ao, data, samples, out_time_ns, eof, pad_silence);
+    // ring_busy must be set before ring_reset is read; see fill_ring().
+    atomic_store(&p->ring_busy, true);
 
-    mp_mutex_unlock(&p->lock);
+    unsigned int state = atomic_load(&p->ring_state);
+    uint64_t read = MPMAX(atomic_load(&p->ring_read),
+                          atomic_load(&p->ring_reset));
+    int pos = 0;
+    bool wakeup = false;
+
+    if (samples > atomic_load(&p->ring_max_request))
+        atomic_store(&p->ring_max_request, samples);
+
+    if (state & 1) {
+        bool ring_eof = atomic_load(&p->ring_eof);
+        uint64_t avail = atomic_load(&p->ring_write) - read;
+        pos = MPMIN(samples, avail);
+        ring_copy(ao, read, data, pos, false);
+        read += pos;
+        if (pos < samples) {
+            // The rest is played as silence. Let the thread refill the ring,
+            // or stop playback if there's no more data, as it holds the lock.
+            *eof = ring_eof;
+            atomic_store(&p->ring_underrun, state);
+            wakeup = true;
+        } else {
+            wakeup = avail - pos < p->ring_size / 2;
+        }
+    }
+
+    atomic_store(&p->ring_read, read);
+    atomic_store(&p->ring_busy, false);
+
+    if (pos > 0)
+        p->end_time_ns = out_time_ns;
+
+    // pad with silence (underflow/paused/eof)
+    if (pad_silence) {
+        for (int n = 0; n < ao->num_planes; n++) {
+            af_fill_silence((char *)data[n] + pos * ao->sstride,
+                    (samples - pos) * ao->sstride,
+                    ao->format);
+        }
+    }
+
+    ao_post_process_data(ao, data, pos);
+
+    // Wake up the thread to refill the ring. If this fails, its timeout
+    // will pick it up.
+    if (wakeup && mp_mutex_trylock(&p->pt_lock) == 0) {
+        p->need_wakeup = true;
+        mp_cond_broadcast(&p->pt_wakeup);
+        mp_mutex_unlock(&p->pt_lock);
+    }
 
     return pos;
 }
 
+// called locked
+static void fill_ring(struct ao *ao)
+{
+    struct buffer_state *p = ao->buffer_state;
+
+    int max_request = atomic_load(&p->ring_max_request);
+    if (max_request > p->ring_size / 2 && !p->ring_size_warned) {
+        MP_WARN(ao, "Audio device requests %d samples at once, which is more "
+                "than half of the %d samples buffered. Increase --audio-buffer "
+                "to avoid dropouts.\n", max_request, p->ring_size);
+        p->ring_size_warned = true;
+    }
+
+    // Read before refilling, so an underrun reported during the refill is
+    // handled next time.
+    unsigned int underrun = atomic_exchange(&p->ring_underrun, 0);
+
+    if (!p->playing || p->paused)
+        return;
+
+    uint64_t write = atomic_load(&p->ring_write);
+    uint64_t read = atomic_load(&p->ring_read);
+    // Data discarded by ao_reset() can be overwritten only if the callback is
+    // not reading it right now. If it starts reading after this check, it
+    // will see the new ring_reset, and skip the discarded data.
+    if (!atomic_load(&p->ring_busy))
+        read = MPMAX(read, atomic_load(&p->ring_reset));
+    int space = p->ring_size - (write - read);
+
+    while (space > 0) {
+        if (!p->pending || !mp_aframe_get_size(p->pending)) {
+            TA_FREEP(&p->pending);
+            struct mp_frame frame = mp_pin_out_read(p->input->pins[0]);
+            if (!frame.type)
+                break;
+            if (frame.type != MP_FRAME_AUDIO) {
+                if (frame.type == MP_FRAME_EOF)
+                    atomic_store(&p->ring_eof, true);
+                mp_frame_unref(&frame);
+                continue;
+            }
+            p->pending = frame.data;
+            atomic_store(&p->ring_eof, false);
+        }
+
+        int copy = MPMIN(mp_aframe_get_size(p->pending), space);
+        void **fdata = (void **)mp_aframe_get_data_ro(p->pending);
+        ring_copy(ao, write, fdata, copy, true);
+        mp_aframe_skip_samples(p->pending, copy);
+        write += copy;
+        space -= copy;
+        atomic_store(&p->ring_write, write);
+    }
+
+    // If the callback ran out of data only because the ring wasn't refilled
+    // in time, it played silence for the missing part and keeps playing now.
+    // Only stop if there is really no more data (queue empty or EOF), which
+    // is the case if the ring is still empty after refilling it.
+    if (underrun && underrun == atomic_load(&p->ring_state) &&
+        !get_ring_samples(p))
+    {
+        p->playing = false;
+        update_ring_state(p);
+        ao->wakeup_cb(ao->wakeup_ctx);
+        // For ao_drain().
+        mp_cond_broadcast(&p->wakeup);
+    }
+}
+
 // Same as ao_read_data(), but convert data according to *fmt.
 // fmt->src_fmt and fmt->channels must be the same as the AO parameters.
 int ao_read_data_converted(struct ao *ao, struct ao_convert_fmt *fmt,
@@ -314,6 +468,8 @@ double ao_get_delay(struct ao *ao)
     int64_t pending = mp_async_queue_get_samples(p->queue);
     if (p->pending)
         pending += mp_aframe_get_size(p->pending);
+    if (!ao->driver->write)
+        pending += get_ring_samples(p);
 
     mp_mutex_unlock(&p->lock);
     return driver_delay + pending / (double)ao->samplerate;
@@ -332,6 +488,8 @@ void ao_reset(struct ao *ao)
     mp_async_queue_reset(p->queue);
     mp_filter_reset(p->filter_root);
     mp_async_queue_resume_reading(p->queue);
+    atomic_store(&p->ring_reset, atomic_load(&p->ring_write));
+    atomic_store(&p->ring_eof, false);
 
     if (!ao->stream_silence && ao->driver->reset) {
         if (ao->driver->write) {
@@ -348,6 +506,7 @@ void ao_reset(struct ao *ao)
     p->recover_pause = false;
     p->hw_paused = false;
     p->end_time_ns = 0;
+    update_ring_state(p);
 
     mp_mutex_unlock(&p->lock);
 
@@ -371,9 +530,14 @@ void ao_start(struct ao *ao)
 
     p->playing = true;
 
-    if (!ao->driver->write && !p->paused && !p->streaming) {
-        p->streaming = true;
-        do_start = true;
+    if (!ao->driver->write) {
+        // Make sure the callback has data as soon as it sees the new state.
+        fill_ring(ao);
+        update_ring_state(p);
+        if (!p->paused && !p->streaming) {
+            p->streaming = true;
+            do_start = true;
+        }
     }
 
     mp_mutex_unlock(&p->lock);
@@ -435,6 +599,11 @@ void ao_set_paused(struct ao *ao, bool paused, bool eof)
     }
     p->paused = paused;
 
+    if (!ao->driver->write) {
+        fill_ring(ao);
+        update_ring_state(p);
+    }
+
     mp_mutex_unlock(&p->lock);
 
     if (do_change_state) {
@@ -578,19 +747,29 @@ bool init_buffer_post(struct ao *ao)
     };
     mp_async_queue_set_config(p->queue, cfg);
 
-    if (ao->driver->write) {
-        mp_filter_graph_set_wakeup_cb(p->filter_root, wakeup_filters, ao);
+    if (!ao->driver->write) {
+        // The ring must hold at least 2 of the largest callback requests, so
+        // one can be refilled while the other is played. Requests are usually
+        // at most device_buffer, which is 0 if the AO doesn't know it (e.g.
+        // pipewire), so use the soft buffer (which is at least device_buffer),
+        // and at least 100 ms. fill_ring() warns if requests are larger.
+        int size = MPMAX(ao->buffer, ao->samplerate / 10);
+        p->ring_size = mp_round_next_power_of_2(size * 2);
+        for (int n = 0; n < ao->num_planes; n++)
+            p->ring[n] = talloc_size(p, p->ring_size * ao->sstride);
+    }
 
-        p->thread_valid = true;
-        if (mp_thread_create(&p->thread, ao_thread, ao)) {
-            p->thread_valid = false;
-            return false;
-        }
-    } else {
-        if (ao->stream_silence) {
-            ao->driver->start(ao);
-            p->streaming = true;
-        }
+    mp_filter_graph_set_wakeup_cb(p->filter_root, wakeup_filters, ao);
+
+    p->thread_valid = true;
+    if (mp_thread_create(&p->thread, ao_thread, ao)) {
+        p->thread_valid = false;
+        return false;
+    }
+
+    if (!ao->driver->write && ao->stream_silence) {
+        ao->driver->start(ao);
+        p->streaming = true;
     }
 
     if (ao->stream_silence) {
@@ -714,17 +893,25 @@ static MP_THREAD_VOID ao_thread(void *arg)
         mp_mutex_lock(&p->lock);
 
         bool retry = false;
-        if (!ao->driver->initially_blocked || p->initial_unblocked)
-            retry = ao_play_data(ao);
-
-        // Wait until the device wants us to write more data to it.
-        // Fallback to guessing.
         int64_t timeout = INT64_MAX;
-        if (p->streaming && !retry && (!p->paused || ao->stream_silence)) {
-            // Wake up again if half of the audio buffer has been played.
-            // Since audio could play at a faster or slower pace, wake up twice
-            // as often as ideally needed.
-            timeout = MP_TIME_S_TO_NS(ao->device_buffer / (double)ao->samplerate * 0.25);
+        if (!ao->driver->write) {
+            fill_ring(ao);
+            // The callback wakes us up if the ring is half empty, but it
+            // can't wait for the lock, so poll as fallback.
+            if (p->playing && !p->paused)
+                timeout = MP_TIME_S_TO_NS(p->ring_size / (double)ao->samplerate * 0.25);
+        } else {
+            if (!ao->driver->initially_blocked || p->initial_unblocked)
+                retry = ao_play_data(ao);
+
+            // Wait until the device wants us to write more data to it.
+            // Fallback to guessing.
+            if (p->streaming && !retry && (!p->paused || ao->stream_silence)) {
+                // Wake up again if half of the audio buffer has been played.
+                // Since audio could play at a faster or slower pace, wake up
+                // twice as often as ideally needed.
+                timeout = MP_TIME_S_TO_NS(ao->device_buffer / (double)ao->samplerate * 0.25);
+            }
         }
 
         mp_mutex_unlock(&p->lock);
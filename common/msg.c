@@ -41,8 +41,19 @@
 #include "msg.h"
 #include "msg_control.h"
 
-// log buffer size (lines) logfile level
-#define FILE_BUF 100
+// log buffer size (lines) logfile level. If the log file writer can't keep up,
+// messages are dropped (and the number of dropped messages is logged) instead
+// of blocking the logging thread.
+#define FILE_BUF 4096
+
+// Maximum size of terminal output queued for the terminal writer thread. If
+// the terminal is slower than that, further messages above MSGL_WARN are not
+// shown on the terminal, and the number of dropped messages is reported.
+#define TERM_BUF_MAX (256 * 1024)
+
+// Messages are formatted into a buffer of this size on the stack before the
+// log lock is taken. Longer messages need a heap allocation.
+#define MSG_STAGING_BUF 512
 
 // lines to accumulate before any client requests the terminal loglevel
 #define EARLY_TERM_BUF 100
@@ -81,6 +92,13 @@ struct mp_log_root {
     bstr status_line;
     struct mp_log *status_log;
     bstr term_status_msg;
+    // Terminal output not written yet, per file descriptor. Written by
+    // flush_term_output(), either by the logging thread itself, or for
+    // deferred output by term_thread.
+    bstr term_pending[STDERR_FILENO + 1];
+    uint64_t term_dropped;  // messages not shown because term_pending was full
+    bool term_thread_active; // also termination signal for the thread
+    mp_cond term_wakeup;
     // --- must be accessed atomically
     /* This is incremented every time the msglevels must be reloaded.
      * (This is perhaps better than maintaining a globally accessible and
@@ -90,6 +108,10 @@ struct mp_log_root {
     char *log_path;
     char *stats_path;
     mp_thread log_file_thread;
+    mp_thread term_thread;
+    // --- protected by term_write_lock (serializes actual terminal writes)
+    mp_mutex term_write_lock;
+    bstr term_writing[STDERR_FILENO + 1];
     // --- owner thread only, but frozen while log_file_thread is running
     FILE *log_file;
     struct mp_log_buffer *log_file_buffer;
@@ -260,16 +282,87 @@ static void prepare_prefix(struct mp_log_root *root, bstr *out, int lev, int ter
     root->blank_lines += root->status_lines;
 }
 
+// Append output for the terminal. Must hold root->lock.
+static void queue_term_output(struct mp_log_root *root, int fileno, bstr data)
+{
+    if (!data.len)
+        return;
+    bstr_xappend(root, &root->term_pending[fileno], data);
+    if (root->term_thread_active)
+        mp_cond_signal(&root->term_wakeup);
+}
+
+// Write all queued terminal output. Must not hold root->lock.
+static void flush_term_output(struct mp_log_root *root)
+{
+    mp_mutex_lock(&root->term_write_lock);
+    for (int fd = STDOUT_FILENO; fd <= STDERR_FILENO; fd++) {
+        // Swap buffers, so that other threads can continue to log while this
+        // one is blocked on the terminal.
+        mp_mutex_lock(&root->lock);
+        bstr data = root->term_pending[fd];
+        root->term_pending[fd] = root->term_writing[fd];
+        root->term_pending[fd].len = 0;
+        mp_mutex_unlock(&root->lock);
+
+        if (data.len) {
+            FILE *fp = fd == STDERR_FILENO ? stderr : stdout;
+            fwrite(data.start, data.len, 1, fp);
+            fflush(fp);
+        }
+        root->term_writing[fd] = data;
+    }
+    mp_mutex_unlock(&root->term_write_lock);
+}
+
+static MP_THREAD_VOID term_thread(void *p)
+{
+    struct mp_log_root *root = p;
+
+    mp_thread_set_name("term-log");
+
+    mp_mutex_lock(&root->lock);
+    while (root->term_thread_active) {
+        if (root->term_pending[STDOUT_FILENO].len ||
+            root->term_pending[STDERR_FILENO].len)
+        {
+            mp_mutex_unlock(&root->lock);
+            flush_term_output(root);
+            mp_mutex_lock(&root->lock);
+        } else {
+            mp_cond_wait(&root->term_wakeup, &root->lock);
+        }
+    }
+    mp_mutex_unlock(&root->lock);
+
+    MP_THREAD_RETURN();
+}
+
+// Only to be called from the main thread.
+static void terminate_term_thread(struct mp_log_root *root)
+{
+    mp_mutex_lock(&root->lock);
+    bool wait_terminate = root->term_thread_active;
+    root->term_thread_active = false;
+    mp_cond_broadcast(&root->term_wakeup);
+    mp_mutex_unlock(&root->lock);
+
+    if (wait_terminate)
+        mp_thread_join(root->term_thread);
+
+    flush_term_output(root);
+}
+
 static void msg_flush_status_line(struct mp_log_root *root, bool clear)
 {
     if (!root->status_lines)
         goto done;
 
-    FILE *fp = term_msg_fp(root, MSGL_STATUS);
+    int fileno = term_msg_fileno(root, MSGL_STATUS);
     if (!clear) {
-        if (root->isatty[term_msg_fileno(root, MSGL_STATUS)])
-            fprintf(fp, TERM_ESC_RESTORE_CURSOR);
-        fprintf(fp, "\n");
+        if (root->isatty[fileno])
+            queue_term_output(root, fileno, bstr0(TERM_ESC_RESTORE_CURSOR));
+        queue_term_output(root, fileno, bstr0("\n"));
         root->blank_lines = 0;
         root->status_lines = 0;
         goto done;
@@ -277,10 +370,8 @@ static void msg_flush_status_line(struct mp_log_root *root, bool clear)
 
     bstr term_msg = {0};
     prepare_prefix(root, &term_msg, MSGL_STATUS, 0);
-    if (term_msg.len) {
-        fprintf(fp, "%.*s", BSTR_P(term_msg));
-        talloc_free(term_msg.start);
-    }
+    queue_term_output(root, fileno, term_msg);
+    talloc_free(term_msg.start);
 
 done:
     root->status_line.len = 0;
@@ -294,15 +385,23 @@ void mp_msg_flush_status_line(struct mp_log *log, bool clear)
     mp_mutex_lock(&log->root->lock);
     msg_flush_status_line(log->root, clear);
     mp_mutex_unlock(&log->root->lock);
+
+    // The caller may write to the terminal on its own after this.
+    flush_term_output(log->root);
 }
 
 void mp_msg_set_term_title(struct mp_log *log, const char *title)
 {
     if (log->root && title) {
-        // Lock because printf to terminal is not necessarily atomic.
-        mp_mutex_lock(&log->root->lock);
-        fprintf(term_msg_fp(log->root, MSGL_STATUS), "\033]0;%s\007", title);
-        mp_mutex_unlock(&log->root->lock);
+        struct mp_log_root *root = log->root;
+        mp_mutex_lock(&root->lock);
+        char *s = talloc_asprintf(NULL, "\033]0;%s\007", title);
+        queue_term_output(root, term_msg_fileno(root, MSGL_STATUS), bstr0(s));
+        talloc_free(s);
+        bool sync = !root->term_thread_active;
+        mp_mutex_unlock(&root->lock);
+        if (sync)
+            flush_term_output(root);
     }
 }
 
@@ -452,25 +551,9 @@ static void write_msg_to_buffers(struct mp_log *log, int lev, bstr text)
         if (buffer_level == MP_LOG_BUFFER_MSGL_LOGFILE)
             buffer_level = MPMAX(log->terminal_level, MSGL_DEBUG);
         if (lev <= buffer_level && lev != MSGL_STATUS) {
-            if (buffer->level == MP_LOG_BUFFER_MSGL_LOGFILE) {
-                // If the buffer is full, block until we can write again,
-                // unless there's no write thread (died, or early filebuffer)
-                bool dead = false;
-                while (buffer->num_entries == buffer->capacity && !dead) {
-                    // Temporary unlock is OK; buffer->level is immutable, and
-                    // buffer can't go away because the global log lock is held.
-                    mp_mutex_unlock(&buffer->lock);
-                    mp_mutex_lock(&root->log_file_lock);
-                    if (root->log_file_thread_active) {
-                        mp_cond_wait(&root->log_file_wakeup,
-                                          &root->log_file_lock);
-                    } else {
-                        dead = true;
-                    }
-                    mp_mutex_unlock(&root->log_file_lock);
-                    mp_mutex_lock(&buffer->lock);
-                }
-            }
+            // If the buffer is full, drop the oldest message. The reader gets
+            // a message with the number of dropped messages instead. Never
+            // block here, not even for the log file.
             if (buffer->num_entries == buffer->capacity) {
                 struct mp_log_buffer_entry *skip = log_buffer_read(buffer);
                 talloc_free(skip);
@@ -501,10 +584,15 @@ static void dump_stats(struct mp_log *log, int lev, bstr text)
         fprintf(root->stats_file, "%"PRId64" %.*s\n", mp_time_ns(), BSTR_P(text));
 }
 
-static void write_term_msg(struct mp_log *log, int lev, bstr text, bstr *out)
+static void write_term_msg(struct mp_log *log, int lev, bstr text, bstr *out,
+                           bool drop_term)
 {
     struct mp_log_root *root = log->root;
     bool print_term = test_terminal_level(log, lev);
+    if (print_term && drop_term) {
+        root->term_dropped += 1;
+        print_term = false;
+    }
     int fileno = term_msg_fileno(root, lev);
     int term_w = 0, term_h = 0;
     if (print_term && root->isatty[fileno])
@@ -562,6 +650,22 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
 
     struct mp_log_root *root = log->root;
 
+    // Format into a per-call staging buffer before taking the lock, so that
+    // other threads are not blocked while formatting.
+    char staging[MSG_STAGING_BUF];
+    bstr text = {0};
+    char *text_alloc = NULL;
+    va_list va2;
+    va_copy(va2, va);
+    int len = vsnprintf(staging, sizeof(staging), format, va);
+    if (len >= (int)sizeof(staging)) {
+        text_alloc = talloc_vasprintf(NULL, format, va2);
+        text = bstr0(text_alloc);
+    } else if (len >= 0) {
+        text = (bstr){(unsigned char *)staging, len};
+    }
+    va_end(va2);
+
     mp_mutex_lock(&root->lock);
 
     root->buffer.len = 0;
@@ -570,9 +674,11 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
         bstr_xappend(root, &root->buffer, log->partial[lev]);
     log->partial[lev].len = 0;
 
-    if (bstr_xappend_vasprintf(root, &root->buffer, format, va) < 0) {
+    if (len < 0 || !text.start) {
         bstr_xappend(root, &root->buffer, bstr0("format error: "));
         bstr_xappend(root, &root->buffer, bstr0(format));
+    } else {
+        bstr_xappend(root, &root->buffer, text);
     }
 
     // Remember last status message and restore it to ensure that it is
@@ -585,31 +691,54 @@ void mp_msg_va(struct mp_log *log, int lev, const char *format, va_list va)
             bstr_xappend(root, &root->status_line, root->buffer);
     }
 
+    // Important messages are written immediately by this thread, the rest is
+    // left to term_thread (if running).
+    bool sync = lev <= MSGL_WARN || !root->term_thread_active;
+    bool queued = false;
+    uint64_t dropped = 0;
+
     if (lev == MSGL_STATS) {
         dump_stats(log, lev, root->buffer);
     } else if (lev == MSGL_STATUS && !test_terminal_level(log, lev)) {
         /* discard */
     } else {
-        write_term_msg(log, lev, root->buffer, &root->term_msg);
+        int fileno = term_msg_fileno(root, lev);
+        bool drop_term = lev > MSGL_WARN &&
+                         root->term_pending[fileno].len > TERM_BUF_MAX;
+
+        write_term_msg(log, lev, root->buffer, &root->term_msg, drop_term);
 
         root->term_status_msg.len = 0;
         if (lev != MSGL_STATUS && root->status_line.len && root->status_log &&
-            is_status_output(root, lev) && test_terminal_level(root->status_log, MSGL_STATUS))
+            !drop_term && is_status_output(root, lev) &&
+            test_terminal_level(root->status_log, MSGL_STATUS))
         {
             write_term_msg(root->status_log, MSGL_STATUS, root->status_line,
-                           &root->term_status_msg);
+                           &root->term_status_msg, false);
         }
 
-        FILE *stream = term_msg_fp(root, lev);
         if (root->term_msg.len) {
-            fwrite(root->term_msg.start, root->term_msg.len, 1, stream);
-            if (root->term_status_msg.len)
-                fwrite(root->term_status_msg.start, root->term_status_msg.len, 1, stream);
-            fflush(stream);
+            queue_term_output(root, fileno, root->term_msg);
+            queue_term_output(root, fileno, root->term_status_msg);
+            queued = true;
+            if (root->term_dropped && !drop_term) {
+                dropped = root->term_dropped;
+                root->term_dropped = 0;
+            }
         }
     }
 
     mp_mutex_unlock(&root->lock);
+
+    talloc_free(text_alloc);
+
+    if (queued && sync)
+        flush_term_output(root);
+
+    if (dropped) {
+        mp_msg(log, MSGL_WARN, "%"PRIu64" messages were not shown on the "
+               "terminal, because it could not keep up.\n", dropped);
+    }
 }
 
 static void destroy_log(void *ptr)
@@ -678,6 +807,8 @@ void mp_msg_init(struct mpv_global *global)
     mp_mutex_init(&root->lock);
     mp_mutex_init(&root->log_file_lock);
     mp_cond_init(&root->log_file_wakeup);
+    mp_mutex_init(&root->term_write_lock);
+    mp_cond_init(&root->term_wakeup);
 
     struct mp_log dummy = { .root = root };
     struct mp_log *log = mp_log_new(root, &dummy, "");
@@ -693,7 +824,7 @@ static MP_THREAD_VOID log_file_thread(void *p)
 
     mp_mutex_lock(&root->log_file_lock);
 
-    while (root->log_file_thread_active) {
+    while (1) {
         struct mp_log_buffer_entry *e =
             mp_msg_log_buffer_read(root->log_file_buffer);
         if (e) {
@@ -701,12 +832,15 @@ static MP_THREAD_VOID log_file_thread(void *p)
             fprintf(root->log_file, "[%8.3f][%c][%s] %s",
                     mp_time_sec(),
                     mp_log_levels[e->level][0], e->prefix, e->text);
-            fflush(root->log_file);
-            mp_mutex_lock(&root->log_file_lock);
             talloc_free(e);
-            // Multiple threads might be blocked if the log buffer was full.
-            mp_cond_broadcast(&root->log_file_wakeup);
+            mp_mutex_lock(&root->log_file_lock);
         } else {
+            // Flush only once the queue is drained, instead of every line.
+            mp_mutex_unlock(&root->log_file_lock);
+            fflush(root->log_file);
+            mp_mutex_lock(&root->log_file_lock);
+            if (!root->log_file_thread_active)
+                break;
             mp_cond_wait(&root->log_file_wakeup, &root->log_file_lock);
         }
     }
@@ -799,8 +933,18 @@ void mp_msg_update_msglevels(struct mpv_global *global, struct MPOpts *opts)
     m_option_type_msglevels.copy(NULL, &root->msg_levels, &opts->msg_levels);
 
     atomic_fetch_add(&root->reload_counter, 1);
+
+    bool start_term_thread = root->use_terminal && !root->term_thread_active;
+    if (start_term_thread)
+        root->term_thread_active = true;
     mp_mutex_unlock(&root->lock);
 
+    if (start_term_thread && mp_thread_create(&root->term_thread, term_thread, root)) {
+        mp_mutex_lock(&root->lock);
+        root->term_thread_active = false;
+        mp_mutex_unlock(&root->lock);
+    }
+
     if (check_new_path(global, opts->log_file, &root->log_path)) {
         terminate_log_file_thread(root);
         if (root->log_path) {
@@ -817,9 +961,7 @@ void mp_msg_update_msglevels(struct mpv_global *global, struct MPOpts *opts)
 
                 if (earlybuf) {
                     // flush, destroy before creating the normal logfile buf,
-                    // as once the new one is created (specifically, its write
-                    // thread), then MSGL_LOGFILE messages become blocking, but
-                    // the early logfile buf is without dequeue - can deadlock.
+                    // so that the early messages are written first.
                     // note: timestamp is unknown, we use 0.000 as indication.
                     // note: new messages while iterating are still flushed.
                     struct mp_log_buffer_entry *e;
@@ -868,10 +1010,18 @@ void mp_msg_update_msglevels(struct mpv_global *global, struct MPOpts *opts)
     }
 }
 
+// Write all terminal output that was deferred so far.
+void mp_msg_flush_term(struct mpv_global *global)
+{
+    flush_term_output(global->log->root);
+}
+
 void mp_msg_force_stderr(struct mpv_global *global, bool force_stderr)
 {
     struct mp_log_root *root = global->log->root;
 
+    flush_term_output(root);
+
     mp_mutex_lock(&root->lock);
     root->force_stderr = force_stderr;
     mp_mutex_unlock(&root->lock);
@@ -889,6 +1039,7 @@ void mp_msg_uninit(struct mpv_global *global)
 {
     struct mp_log_root *root = global->log->root;
     mp_msg_flush_status_line(global->log, true);
+    terminate_term_thread(root);
     if (root->really_quiet && root->isatty[term_msg_fileno(root, MSGL_STATUS)])
         fprintf(term_msg_fp(root, MSGL_STATUS), TERM_ESC_RESTORE_CURSOR);
     terminate_log_file_thread(root);
@@ -903,6 +1054,8 @@ void mp_msg_uninit(struct mpv_global *global)
     mp_mutex_destroy(&root->lock);
     mp_mutex_destroy(&root->log_file_lock);
     mp_cond_destroy(&root->log_file_wakeup);
+    mp_mutex_destroy(&root->term_write_lock);
+    mp_cond_destroy(&root->term_wakeup);
     talloc_free(root);
     global->log = NULL;
 }
@@ -922,8 +1075,7 @@ void mp_msg_uninit(struct mpv_global *global)
 //   is known are when log-file is set at mpv.conf, or from script/client init.
 //   once a file name is known, the early buffer is flushed and destroyed.
 //   unlike the "proper" log-file buffer, the early filebuffer is not backed by
-//   a write thread, and hence non-blocking (can overwrite old messages).
-//   it's also bigger than the actual file buffer (early: 5000, actual: 100).
+//   a write thread, so it can overwrite old messages if it fills up.
 
 static void mp_msg_set_early_logging_raw(struct mpv_global *global, bool enable,
                                          struct mp_log_buffer **root_logbuf,
@@ -51,13 +51,179 @@ void playlist_entry_add_params(struct playlist_entry *e,
         playlist_entry_add_param(e, params[n].name, params[n].value);
 }
 
-static void playlist_update_indexes(struct playlist *pl, int start, int end)
+// Entries are stored in a list of blocks, so that insertion and removal only
+// have to shift the entries within a block, and the (few) blocks after it.
+// The index of an entry is the start of its block plus its position in the
+// block. The block starts are updated lazily, when an index is requested.
+#define BLOCK_SIZE 512
+
+struct playlist_block {
+    int index;          // position in playlist.blocks
+    int start;          // index of entries[0]; valid if index < blocks_valid
+    int num;
+    struct playlist_entry *entries[BLOCK_SIZE];
+};
+
+// Make sure blocks[0..upto] have a valid start.
+static void update_starts(struct playlist *pl, int upto)
 {
-    start = MPMAX(start, 0);
-    end = end < 0 ? pl->num_entries : MPMIN(end, pl->num_entries);
+    for (int n = pl->blocks_valid; n <= upto; n++) {
+        struct playlist_block *prev = n ? pl->blocks[n - 1] : NULL;
+        pl->blocks[n]->start = prev ? prev->start + prev->num : 0;
+    }
+    pl->blocks_valid = MPMAX(pl->blocks_valid, upto + 1);
+}
+
+// The starts of all blocks from the given block index on must be recomputed.
+static void invalidate_starts(struct playlist *pl, int index)
+{
+    pl->blocks_valid = MPMIN(pl->blocks_valid, index);
+}
+
+static void update_block_indexes(struct playlist *pl, int start)
+{
+    for (int n = start; n < pl->num_blocks; n++)
+        pl->blocks[n]->index = n;
+}
+
+static void update_positions(struct playlist_block *b, int start)
+{
+    for (int n = start; n < b->num; n++) {
+        b->entries[n]->pl_block = b;
+        b->entries[n]->pl_pos = n;
+    }
+}
+
+static struct playlist_block *insert_block(struct playlist *pl, int index)
+{
+    struct playlist_block *b = talloc_zero(pl, struct playlist_block);
+    MP_TARRAY_INSERT_AT(pl, pl->blocks, pl->num_blocks, index, b);
+    update_block_indexes(pl, index);
+    invalidate_starts(pl, index);
+    return b;
+}
+
+static void remove_block(struct playlist *pl, struct playlist_block *b)
+{
+    int index = b->index;
+    MP_TARRAY_REMOVE_AT(pl->blocks, pl->num_blocks, index);
+    update_block_indexes(pl, index);
+    invalidate_starts(pl, index);
+    talloc_free(b);
+}
+
+// Append all entries of the block after b to b, and remove that block.
+static void merge_next_block(struct playlist *pl, struct playlist_block *b)
+{
+    struct playlist_block *next = pl->blocks[b->index + 1];
+    assert(b->num + next->num <= BLOCK_SIZE);
+    memcpy(&b->entries[b->num], next->entries, next->num * sizeof(b->entries[0]));
+    int start = b->num;
+    b->num += next->num;
+    update_positions(b, start);
+    remove_block(pl, next);
+}
+
+// Insert add before the entry at position pos in block b (pos == b->num
+// appends to the block).
+static void link_entry(struct playlist *pl, struct playlist_entry *add,
+                       struct playlist_block *b, int pos)
+{
+    if (b->num == BLOCK_SIZE) {
+        struct playlist_block *nb = insert_block(pl, b->index + 1);
+        if (pos == BLOCK_SIZE) {
+            // Appending after a full block; this keeps appended blocks full.
+            b = nb;
+            pos = 0;
+        } else {
+            nb->num = BLOCK_SIZE / 2;
+            b->num -= nb->num;
+            memcpy(nb->entries, &b->entries[b->num],
+                   nb->num * sizeof(b->entries[0]));
+            update_positions(nb, 0);
+            if (pos > b->num) {
+                pos -= b->num;
+                b = nb;
+            }
+        }
+    }
+    memmove(&b->entries[pos + 1], &b->entries[pos],
+            (b->num - pos) * sizeof(b->entries[0]));
+    b->entries[pos] = add;
+    b->num++;
+    update_positions(b, pos);
+    invalidate_starts(pl, b->index + 1);
+    pl->num_entries++;
+}
 
-    for (int n = start; n < end; n++)
-        pl->entries[n]->pl_index = n;
+static void insert_entry(struct playlist *pl, struct playlist_entry *add,
+                         struct playlist_entry *at)
+{
+    if (at) {
+        link_entry(pl, add, at->pl_block, at->pl_pos);
+    } else {
+        if (!pl->num_blocks)
+            insert_block(pl, 0);
+        struct playlist_block *last = pl->blocks[pl->num_blocks - 1];
+        link_entry(pl, add, last, last->num);
+    }
+}
+
+static void unlink_entry(struct playlist *pl, struct playlist_entry *e)
+{
+    struct playlist_block *b = e->pl_block;
+    int pos = e->pl_pos;
+    assert(b->entries[pos] == e);
+    b->num--;
+    memmove(&b->entries[pos], &b->entries[pos + 1],
+            (b->num - pos) * sizeof(b->entries[0]));
+    update_positions(b, pos);
+    invalidate_starts(pl, b->index + 1);
+    pl->num_entries--;
+    e->pl_block = NULL;
+    e->pl_pos = -1;
+
+    // Avoid accumulating many small blocks when removing lots of entries.
+    int limit = BLOCK_SIZE / 2;
+    struct playlist_block *next =
+        b->index + 1 < pl->num_blocks ? pl->blocks[b->index + 1] : NULL;
+    struct playlist_block *prev = b->index ? pl->blocks[b->index - 1] : NULL;
+    if (!b->num) {
+        remove_block(pl, b);
+    } else if (next && b->num + next->num <= limit) {
+        merge_next_block(pl, b);
+    } else if (prev && prev->num + b->num <= limit) {
+        merge_next_block(pl, prev);
+    }
+}
+
+// Return all entries as a flat array (allocated under ta_parent).
+static struct playlist_entry **get_entries(void *ta_parent, struct playlist *pl)
+{
+    struct playlist_entry **entries =
+        talloc_array(ta_parent, struct playlist_entry *, pl->num_entries);
+    int num = 0;
+    for (int n = 0; n < pl->num_blocks; n++) {
+        struct playlist_block *b = pl->blocks[n];
+        memcpy(&entries[num], b->entries, b->num * sizeof(b->entries[0]));
+        num += b->num;
+    }
+    assert(num == pl->num_entries);
+    return entries;
+}
+
+// Replace the contents of pl with the given entries, which must include all
+// entries of pl.
+static void set_entries(struct playlist *pl, struct playlist_entry **entries,
+                        int num_entries)
+{
+    for (int n = 0; n < pl->num_blocks; n++)
+        talloc_free(pl->blocks[n]);
+    pl->num_blocks = 0;
+    pl->blocks_valid = 0;
+    pl->num_entries = 0;
+    for (int n = 0; n < num_entries; n++)
+        insert_entry(pl, entries[n], NULL);
 }
 
 // Inserts the entry so that it takes "at"'s place, shifting "at" and all
@@ -68,15 +234,11 @@ void playlist_insert_at(struct playlist *pl, struct playlist_entry *add,
     assert(add->filename);
     assert(!at || at->pl == pl);
 
-    int index = at ? at->pl_index : pl->num_entries;
-    MP_TARRAY_INSERT_AT(pl, pl->entries, pl->num_entries, index, add);
+    insert_entry(pl, add, at);
 
     add->pl = pl;
-    add->pl_index = index;
     add->id = ++pl->id_alloc;
 
-    playlist_update_indexes(pl, index, pl->num_entries);
-
     talloc_steal(pl, add);
 }
 
@@ -98,11 +260,9 @@ void playlist_remove(struct playlist *pl, struct playlist_entry *entry)
         pl->current_was_replaced = true;
     }
 
-    MP_TARRAY_REMOVE_AT(pl->entries, pl->num_entries, entry->pl_index);
-    playlist_update_indexes(pl, entry->pl_index, -1);
+    unlink_entry(pl, entry);
 
     entry->pl = NULL;
-    entry->pl_index = -1;
     ta_set_parent(entry, NULL);
 
     entry->removed = true;
@@ -111,8 +271,8 @@ void playlist_remove(struct playlist *pl, struct playlist_entry *entry)
 
 void playlist_clear(struct playlist *pl)
 {
-    for (int n = pl->num_entries - 1; n >= 0; n--)
-        playlist_remove(pl, pl->entries[n]);
+    while (pl->num_entries)
+        playlist_remove(pl, playlist_get_last(pl));
     assert(!pl->current);
     pl->current_was_replaced = false;
     pl->playlist_completed = false;
@@ -122,9 +282,12 @@ void playlist_clear(struct playlist *pl)
 
 void playlist_clear_except_current(struct playlist *pl)
 {
-    for (int n = pl->num_entries - 1; n >= 0; n--) {
-        if (pl->entries[n] != pl->current)
-            playlist_remove(pl, pl->entries[n]);
+    struct playlist_entry *e = playlist_get_last(pl);
+    while (e) {
+        struct playlist_entry *prev = playlist_entry_get_rel(e, -1);
+        if (e != pl->current)
+            playlist_remove(pl, e);
+        e = prev;
     }
     pl->playlist_completed = false;
     pl->playlist_started = false;
@@ -140,16 +303,8 @@ void playlist_move(struct playlist *pl, struct playlist_entry *entry,
     assert(entry && entry->pl == pl);
     assert(!at || at->pl == pl);
 
-    int index = at ? at->pl_index : pl->num_entries;
-    MP_TARRAY_INSERT_AT(pl, pl->entries, pl->num_entries, index, entry);
-
-    int old_index = entry->pl_index;
-    if (old_index >= index)
-        old_index += 1;
-    MP_TARRAY_REMOVE_AT(pl->entries, pl->num_entries, old_index);
-
-    playlist_update_indexes(pl, MPMIN(index - 1, old_index - 1),
-                                MPMAX(index + 1, old_index + 1));
+    unlink_entry(pl, entry);
+    insert_entry(pl, entry, at);
 }
 
 void playlist_append_file(struct playlist *pl, const char *filename)
@@ -159,21 +314,23 @@ void playlist_append_file(struct playlist *pl, const char *filename)
 
 void playlist_populate_playlist_path(struct playlist *pl, const char *path)
 {
-    for (int n = 0; n < pl->num_entries; n++) {
-        struct playlist_entry *e = pl->entries[n];
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
         e->playlist_path = talloc_strdup(e, path);
-    }
 }
 
 void playlist_shuffle(struct playlist *pl)
 {
-    for (int n = 0; n < pl->num_entries; n++)
-        pl->entries[n]->original_index = n;
-    for (int n = 0; n < pl->num_entries - 1; n++) {
-        size_t j = (size_t)((pl->num_entries - n) * mp_rand_next_double());
-        MPSWAP(struct playlist_entry *, pl->entries[n], pl->entries[n + j]);
+    int num = pl->num_entries;
+    struct playlist_entry **entries = get_entries(NULL, pl);
+    for (int n = 0; n < num; n++)
+        entries[n]->original_index = n;
+    for (int n = 0; n < num - 1; n++) {
+        size_t j = (size_t)((num - n) * mp_rand_next_double());
+        MPSWAP(struct playlist_entry *, entries[n], entries[n + j]);
     }
-    playlist_update_indexes(pl, 0, -1);
+    set_entries(pl, entries, num);
+    talloc_free(entries);
 }
 
 #define CMP_INT(a, b) ((a) == (b) ? 0 : ((a) > (b) ? 1 : -1))
@@ -185,26 +342,35 @@ static int cmp_unshuffle(const void *a, const void *b)
 
     if (ea->original_index >= 0 && ea->original_index != eb->original_index)
         return CMP_INT(ea->original_index, eb->original_index);
-    return CMP_INT(ea->pl_index, eb->pl_index);
+    return CMP_INT(ea->pl_pos, eb->pl_pos);
 }
 
 void playlist_unshuffle(struct playlist *pl)
 {
-    if (pl->num_entries)
-        qsort(pl->entries, pl->num_entries, sizeof(pl->entries[0]), cmp_unshuffle);
-    playlist_update_indexes(pl, 0, -1);
+    int num = pl->num_entries;
+    struct playlist_entry **entries = get_entries(NULL, pl);
+    // Tie-break by the current index.
+    for (int n = 0; n < num; n++)
+        entries[n]->pl_pos = n;
+    if (num)
+        qsort(entries, num, sizeof(entries[0]), cmp_unshuffle);
+    set_entries(pl, entries, num);
+    talloc_free(entries);
 }
 
 // (Explicitly ignores current_was_replaced.)
 struct playlist_entry *playlist_get_first(struct playlist *pl)
 {
-    return pl->num_entries ? pl->entries[0] : NULL;
+    return pl->num_entries ? pl->blocks[0]->entries[0] : NULL;
 }
 
 // (Explicitly ignores current_was_replaced.)
 struct playlist_entry *playlist_get_last(struct playlist *pl)
 {
-    return pl->num_entries ? pl->entries[pl->num_entries - 1] : NULL;
+    if (!pl->num_entries)
+        return NULL;
+    struct playlist_block *b = pl->blocks[pl->num_blocks - 1];
+    return b->entries[b->num - 1];
 }
 
 struct playlist_entry *playlist_get_next(struct playlist *pl, int direction)
@@ -229,9 +395,23 @@ struct playlist_entry *playlist_entry_get_rel(struct playlist_entry *e,
                                               int direction)
 {
     assert(direction == -1 || direction == +1);
-    if (!e->pl)
+    struct playlist *pl = e->pl;
+    if (!pl)
         return NULL;
-    return playlist_entry_from_index(e->pl, e->pl_index + direction);
+    struct playlist_block *b = e->pl_block;
+    int pos = e->pl_pos + direction;
+    if (pos < 0) {
+        if (!b->index)
+            return NULL;
+        b = pl->blocks[b->index - 1];
+        pos = b->num - 1;
+    } else if (pos >= b->num) {
+        if (b->index + 1 >= pl->num_blocks)
+            return NULL;
+        b = pl->blocks[b->index + 1];
+        pos = 0;
+    }
+    return b->entries[pos];
 }
 
 struct playlist_entry *playlist_get_first_in_next_playlist(struct playlist *pl,
@@ -306,8 +486,9 @@ void playlist_add_base_path(struct playlist *pl, bstr base_path)
 {
     if (base_path.len == 0 || bstrcmp0(base_path, ".") == 0)
         return;
-    for (int n = 0; n < pl->num_entries; n++) {
-        struct playlist_entry *e = pl->entries[n];
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+    {
         if (!mp_is_url(bstr0(e->filename))) {
             char *new_file = mp_path_join_bstr(e, base_path, bstr0(e->filename));
             talloc_free(e->filename);
@@ -318,8 +499,9 @@ void playlist_add_base_path(struct playlist *pl, bstr base_path)
 
 void playlist_set_stream_flags(struct playlist *pl, int flags)
 {
-    for (int n = 0; n < pl->num_entries; n++)
-        pl->entries[n]->stream_flags = flags;
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+        e->stream_flags = flags;
 }
 
 int64_t playlist_transfer_entries_to(struct playlist *pl, int dst_index,
@@ -329,19 +511,31 @@ int64_t playlist_transfer_entries_to(struct playlist *pl, int dst_index,
     struct playlist_entry *first = playlist_get_first(source_pl);
 
     int count = source_pl->num_entries;
-    MP_TARRAY_INSERT_N_AT(pl, pl->entries, pl->num_entries, dst_index, count);
+    struct playlist_entry **entries = get_entries(NULL, source_pl);
+    set_entries(source_pl, NULL, 0);
+
+    struct playlist_entry *at = playlist_entry_from_index(pl, dst_index);
+    if (at && count > BLOCK_SIZE) {
+        // Inserting many entries in the middle: rebuilding is cheaper than
+        // splitting blocks one by one.
+        int num = pl->num_entries;
+        struct playlist_entry **all = get_entries(NULL, pl);
+        MP_TARRAY_INSERT_N_AT(NULL, all, num, dst_index, count);
+        memcpy(&all[dst_index], entries, count * sizeof(entries[0]));
+        set_entries(pl, all, num);
+        talloc_free(all);
+    } else {
+        for (int n = 0; n < count; n++)
+            insert_entry(pl, entries[n], at);
+    }
 
     for (int n = 0; n < count; n++) {
-        struct playlist_entry *e = source_pl->entries[n];
+        struct playlist_entry *e = entries[n];
         e->pl = pl;
-        e->pl_index = dst_index + n;
         e->id = ++pl->id_alloc;
-        pl->entries[e->pl_index] = e;
         talloc_steal(pl, e);
     }
-
-    playlist_update_indexes(pl, dst_index + count, -1);
-    source_pl->num_entries = 0;
+    talloc_free(entries);
 
     pl->playlist_completed = source_pl->playlist_completed;
     pl->playlist_started = source_pl->playlist_started;
@@ -359,7 +553,7 @@ int64_t playlist_transfer_entries(struct playlist *pl, struct playlist *source_p
 
     int add_at = pl->num_entries;
     if (pl->current) {
-        add_at = pl->current->pl_index + 1;
+        add_at = playlist_entry_to_index(pl, pl->current) + 1;
         if (pl->current_was_replaced)
             add_at += 1;
     }
@@ -380,7 +574,9 @@ int playlist_entry_to_index(struct playlist *pl, struct playlist_entry *e)
 {
     if (!e || e->pl != pl)
         return -1;
-    return e->pl_index;
+    struct playlist_block *b = e->pl_block;
+    update_starts(pl, b->index);
+    return b->start + e->pl_pos;
 }
 
 int playlist_entry_count(struct playlist *pl)
@@ -392,7 +588,21 @@ int playlist_entry_count(struct playlist *pl)
 // Return NULL if not found.
 struct playlist_entry *playlist_entry_from_index(struct playlist *pl, int index)
 {
-    return index >= 0 && index < pl->num_entries ? pl->entries[index] : NULL;
+    if (index < 0 || index >= pl->num_entries)
+        return NULL;
+    update_starts(pl, pl->num_blocks - 1);
+    // Find the last block with start <= index.
+    int lo = 0, hi = pl->num_blocks - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (pl->blocks[mid]->start <= index) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    struct playlist_block *b = pl->blocks[lo];
+    return b->entries[index - b->start];
 }
 
 struct playlist *playlist_parse_file(const char *file, struct mp_cancel *cancel,
@@ -441,17 +651,19 @@ void playlist_set_current(struct playlist *pl)
     if (!pl->playlist_dir)
         return;
 
-    for (int i = 0; i < pl->num_entries; ++i) {
-        if (!pl->entries[i]->playlist_path)
+    for (struct playlist_entry *e = playlist_get_first(pl); e;
+         e = playlist_entry_get_rel(e, 1))
+    {
+        if (!e->playlist_path)
             continue;
-        char *path = pl->entries[i]->playlist_path;
+        char *path = e->playlist_path;
         if (path[0] != '.')
-            path = mp_path_join(NULL, pl->playlist_dir, mp_basename(pl->entries[i]->playlist_path));
-        bool same = !strcmp(pl->entries[i]->filename, path);
-        if (path != pl->entries[i]->playlist_path)
+            path = mp_path_join(NULL, pl->playlist_dir, mp_basename(e->playlist_path));
+        bool same = !strcmp(e->filename, path);
+        if (path != e->playlist_path)
             talloc_free(path);
         if (same) {
-            pl->current = pl->entries[i];
+            pl->current = e;
             break;
         }
     }
@@ -26,9 +26,11 @@ struct playlist_param {
 };
 
 struct playlist_entry {
-    // Invariant: (pl && pl->entries[pl_index] == this) || (!pl && pl_index < 0)
+    // Invariant: (pl && pl_block->entries[pl_pos] == this) || (!pl && !pl_block)
+    // Use playlist_entry_to_index() to get the index within the playlist.
     struct playlist *pl;
-    int pl_index;
+    struct playlist_block *pl_block;
+    int pl_pos;
 
     uint64_t id;
 
@@ -40,7 +42,7 @@ struct playlist_entry {
 
     char *title;
 
-    // Used for unshuffling: the pl_index before it was shuffled. -1 => unknown.
+    // Used for unshuffling: the index before it was shuffled. -1 => unknown.
     int original_index;
 
     // Set to true if this playlist entry was selected while trying to go backwards
@@ -62,7 +64,11 @@ struct playlist_entry {
 };
 
 struct playlist {
-    struct playlist_entry **entries;
+    // Private to playlist.c; use playlist_entry_from_index() etc. to access
+    // the entries.
+    struct playlist_block **blocks;
+    int num_blocks;
+    int blocks_valid;
     int num_entries;
 
     // This provides some sort of stable iterator. If this entry is removed from
@@ -1,8 +1,10 @@
+#include <math.h>
 #include <stdatomic.h>
 #include <time.h>
 
 #include "common.h"
 #include "global.h"
+#include "misc/json.h"
 #include "misc/linked_list.h"
 #include "misc/node.h"
 #include "msg.h"
@@ -26,6 +28,22 @@ struct stats_base {
     int num_entries;
 
     int64_t last_time;
+
+    // Cumulative report (stats_global_enable_report()).
+    bool report;
+    int64_t report_start;
+    // Entries of destroyed stats_ctx, merged by full name.
+    struct report_entry **archive;
+    int num_archive;
+
+    // Trace recording (stats_global_enable_trace()).
+    atomic_bool trace;
+    uint64_t trace_id;      // identifies this instance in trace_tls
+    int64_t trace_start;
+    struct trace_buffer **trace_buffers;
+    int num_trace_buffers;
+    int trace_next_tid;
+    bool trace_full_warned;
 };
 
 struct stats_ctx {
@@ -49,22 +67,156 @@ enum val_type {
     VAL_THREAD_CPU_TIME,
 };
 
+// The list of entries is protected by stats_base.lock, but the values are
+// updated with atomics only, so that hot paths can use a handle returned by
+// stats_get_entry() without taking any lock.
 struct stat_entry {
     char name[32];
     const char *full_name; // including stats_ctx.prefix
+    struct stats_ctx *ctx;
 
-    enum val_type type;
-    double val_d;
-    int64_t val_rt;
-    int64_t val_th;
-    int64_t time_start_ns;
+    _Atomic int type;       // enum val_type
+    _Atomic double val_d;
+    _Atomic int64_t val_rt;
+    _Atomic int64_t val_th;
+
+    // Span in progress.
+    _Atomic int64_t time_start_ns;
+    _Atomic int64_t time_cpu_start_ns;
+
+    // VAL_THREAD_CPU_TIME; protected by stats_base.lock.
     int64_t cpu_start_ns;
     mp_thread_id thread_id;
+
+    // Cumulative values for the report. Unlike the fields above, these are
+    // never reset by polling.
+    _Atomic int report_type;
+    _Atomic double total_d;     // VAL_INC: sum; VAL_STATIC*: sum of all values
+    _Atomic double max_d;       // VAL_STATIC*: maximum value
+    _Atomic int64_t total_count; // number of events, values or time spans
+    _Atomic int64_t total_rt;   // VAL_TIME
+    _Atomic int64_t total_th;   // VAL_TIME, VAL_THREAD_CPU_TIME
+};
+
+// Plain copy of the cumulative values of a stat_entry, for the report.
+struct report_entry {
+    char *full_name;
+    enum val_type type;
+    double last_d;
+    double total_d;
+    double max_d;
+    int64_t total_count;
+    int64_t total_rt;
+    int64_t total_th;
 };
 
 #define IS_ACTIVE(ctx) \
     (atomic_load_explicit(&(ctx)->base->active, memory_order_relaxed))
 
+#define IS_TRACING(ctx) \
+    (atomic_load_explicit(&(ctx)->base->trace, memory_order_relaxed))
+
+// Number of trace events kept per thread. Older events are overwritten.
+#define TRACE_EVENTS (1 << 15)
+
+// Maximum number of threads with a trace buffer. Beyond this, buffers of
+// threads which called stats_unregister_thread() or exited are reused.
+#define MAX_TRACE_BUFFERS 32
+
+enum trace_type {
+    TRACE_SPAN,
+    TRACE_EVENT,
+    TRACE_VALUE,
+};
+
+struct trace_event {
+    char name[48];
+    enum trace_type type;
+    int64_t ts_ns;
+    int64_t dur_ns;
+    double value;
+};
+
+// Written only by the owning thread. The lock is contended only while the
+// trace is being dumped.
+struct trace_buffer {
+    mp_mutex lock;
+    int tid;
+    char name[48];
+    bool done;              // thread unregistered, can be reused (base lock)
+    struct trace_event *events;
+    uint64_t num_events;    // total number written; ring index is modulo
+};
+
+static _Atomic uint64_t trace_id_counter;
+
+// Trace buffer of the current thread. Since there can be multiple stats_base
+// instances (libmpv), the buffer is valid only if base_id matches.
+static _Thread_local struct {
+    uint64_t base_id;
+    struct trace_buffer *buf; // NULL with matching base_id: don't trace
+} trace_tls;
+
+// Live stats_base instances, so that exiting threads can find their buffer.
+static mp_static_mutex trace_bases_lock = MP_STATIC_MUTEX_INITIALIZER;
+static struct stats_base **trace_bases;
+static int num_trace_bases;
+
+#if !HAVE_WIN32_THREADS
+// Per-thread value of trace_exit_key, identifying the buffer to release when
+// the thread exits without calling stats_unregister_thread().
+struct trace_owner {
+    uint64_t base_id;
+    int tid;
+};
+
+static pthread_key_t trace_exit_key;
+static mp_once trace_exit_once = MP_STATIC_ONCE_INITIALIZER;
+
+static void trace_thread_exit(void *p)
+{
+    struct trace_owner *owner = p;
+    mp_mutex_lock(&trace_bases_lock);
+    for (int n = 0; n < num_trace_bases; n++) {
+        struct stats_base *base = trace_bases[n];
+        if (base->trace_id != owner->base_id)
+            continue;
+        mp_mutex_lock(&base->lock);
+        for (int i = 0; i < base->num_trace_buffers; i++) {
+            if (base->trace_buffers[i]->tid == owner->tid)
+                base->trace_buffers[i]->done = true;
+        }
+        mp_mutex_unlock(&base->lock);
+    }
+    mp_mutex_unlock(&trace_bases_lock);
+    free(owner);
+}
+
+static void trace_init_exit_key(void)
+{
+    pthread_key_create(&trace_exit_key, trace_thread_exit);
+}
+
+// Make sure the current thread's buffer is released when it exits.
+static void trace_set_owner(struct stats_base *base, struct trace_buffer *buf)
+{
+    mp_exec_once(&trace_exit_once, trace_init_exit_key);
+    struct trace_owner *owner = pthread_getspecific(trace_exit_key);
+    if (!owner) {
+        owner = malloc(sizeof(*owner));
+        if (!owner)
+            return;
+        pthread_setspecific(trace_exit_key, owner);
+    }
+    *owner = (struct trace_owner){base->trace_id, buf->tid};
+}
+#else
+// Threads which exit without unregistering keep their buffer.
+static void trace_set_owner(struct stats_base *base, struct trace_buffer *buf)
+{
+}
+#endif
+
 static void stats_destroy(void *p)
 {
     struct stats_base *stats = p;
@@ -72,6 +224,19 @@ static void stats_destroy(void *p)
     // All entries must have been destroyed before this.
     assert(!stats->list.head);
 
+    mp_mutex_lock(&trace_bases_lock);
+    for (int n = 0; n < num_trace_bases; n++) {
+        if (trace_bases[n] == stats) {
+            MP_TARRAY_REMOVE_AT(trace_bases, num_trace_bases, n);
+            break;
+        }
+    }
+    if (!num_trace_bases)
+        TA_FREEP(&trace_bases);
+    mp_mutex_unlock(&trace_bases_lock);
+
+    for (int n = 0; n < stats->num_trace_buffers; n++)
+        mp_mutex_destroy(&stats->trace_buffers[n]->lock);
     mp_mutex_destroy(&stats->lock);
 }
 
@@ -84,6 +249,11 @@ void stats_global_init(struct mpv_global *global)
 
     global->stats = stats;
     stats->global = global;
+    stats->trace_id = atomic_fetch_add(&trace_id_counter, 1) + 1;
+
+    mp_mutex_lock(&trace_bases_lock);
+    MP_TARRAY_APPEND(NULL, trace_bases, num_trace_bases, stats);
+    mp_mutex_unlock(&trace_bases_lock);
 }
 
 static void add_stat(struct mpv_node *list, struct stat_entry *e,
@@ -105,6 +275,32 @@ static int cmp_entry(const void *p1, const void *p2)
     return strcmp((*e1)->full_name, (*e2)->full_name);
 }
 
+static int cmp_report_entry(const void *p1, const void *p2)
+{
+    struct report_entry **e1 = (void *)p1;
+    struct report_entry **e2 = (void *)p2;
+    return strcmp((*e1)->full_name, (*e2)->full_name);
+}
+
+static void atomic_add_double(_Atomic double *p, double val)
+{
+    double old = atomic_load_explicit(p, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(p, &old, old + val,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+static void atomic_max_double(_Atomic double *p, double val)
+{
+    double old = atomic_load_explicit(p, memory_order_relaxed);
+    while (old < val &&
+           !atomic_compare_exchange_weak_explicit(p, &old, val,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
 void stats_global_query(struct mpv_global *global, struct mpv_node *out)
 {
     struct stats_base *stats = global->stats;
@@ -145,9 +341,10 @@ void stats_global_query(struct mpv_global *global, struct mpv_node *out)
                 struct stat_entry *e = stats->entries[n];
 
                 e->cpu_start_ns = 0;
-                e->val_rt = e->val_th = 0;
-                if (e->type != VAL_THREAD_CPU_TIME)
-                    e->type = 0;
+                atomic_store(&e->val_rt, 0);
+                atomic_store(&e->val_th, 0);
+                if (atomic_load(&e->type) != VAL_THREAD_CPU_TIME)
+                    atomic_store(&e->type, 0);
             }
         }
     }
@@ -156,26 +353,25 @@ void stats_global_query(struct mpv_global *global, struct mpv_node *out)
     for (int n = 0; n < stats->num_entries; n++) {
         struct stat_entry *e = stats->entries[n];
 
-        switch (e->type) {
+        switch (atomic_load(&e->type)) {
         case VAL_STATIC:
-            add_stat(out, e, NULL, e->val_d, NULL);
+            add_stat(out, e, NULL, atomic_load(&e->val_d), NULL);
             break;
         case VAL_STATIC_SIZE: {
-            char *s = format_file_size(e->val_d);
-            add_stat(out, e, NULL, e->val_d, s);
+            double val = atomic_load(&e->val_d);
+            char *s = format_file_size(val);
+            add_stat(out, e, NULL, val, s);
             talloc_free(s);
             break;
         }
         case VAL_INC:
-            add_stat(out, e, NULL, e->val_d, NULL);
-            e->val_d = 0;
+            add_stat(out, e, NULL, atomic_exchange(&e->val_d, 0), NULL);
             break;
         case VAL_TIME: {
-            double t_cpu = MP_TIME_NS_TO_MS(e->val_th);
+            double t_cpu = MP_TIME_NS_TO_MS(atomic_exchange(&e->val_th, 0));
             add_stat(out, e, "cpu", t_cpu, mp_tprintf(80, "%.2f ms", t_cpu));
-            double t_rt = MP_TIME_NS_TO_MS(e->val_rt);
+            double t_rt = MP_TIME_NS_TO_MS(atomic_exchange(&e->val_rt, 0));
             add_stat(out, e, "time", t_rt, mp_tprintf(80, "%.2f ms", t_rt));
-            e->val_rt = e->val_th = 0;
             break;
         }
         case VAL_THREAD_CPU_TIME: {
@@ -194,11 +390,331 @@ void stats_global_query(struct mpv_global *global, struct mpv_node *out)
     mp_mutex_unlock(&stats->lock);
 }
 
+// Fold the values of r into the entry with the same name in the list, or
+// append a copy of r.
+static void merge_report_entry(void *ta_parent, struct report_entry ***list,
+                               int *num, struct report_entry *r)
+{
+    for (int n = 0; n < *num; n++) {
+        struct report_entry *a = (*list)[n];
+        if (strcmp(a->full_name, r->full_name) == 0 && a->type == r->type) {
+            a->total_d += r->total_d;
+            a->max_d = MPMAX(a->max_d, r->max_d);
+            a->total_count += r->total_count;
+            a->total_rt += r->total_rt;
+            a->total_th += r->total_th;
+            a->last_d = r->last_d;
+            return;
+        }
+    }
+
+    struct report_entry *a = talloc_zero(ta_parent, struct report_entry);
+    *a = *r;
+    a->full_name = talloc_strdup(a, r->full_name);
+    MP_TARRAY_APPEND(ta_parent, *list, *num, a);
+}
+
+// Fold the cumulative values of e into the list. Used to keep values of
+// destroyed stats_ctx (e.g. the demuxer of a previous file) for the report.
+// Must hold stats_base.lock.
+static void merge_entry(void *ta_parent, struct report_entry ***list, int *num,
+                        struct stat_entry *e)
+{
+    struct report_entry r = {
+        .full_name = (char *)e->full_name,
+        .type = atomic_load(&e->report_type),
+        .last_d = atomic_load(&e->val_d),
+        .total_d = atomic_load(&e->total_d),
+        .max_d = atomic_load(&e->max_d),
+        .total_count = atomic_load(&e->total_count),
+        .total_rt = atomic_load(&e->total_rt),
+        .total_th = atomic_load(&e->total_th),
+    };
+    if (!r.type)
+        return;
+    if (r.type == VAL_THREAD_CPU_TIME)
+        r.total_th = mp_thread_cpu_time_ns(e->thread_id);
+    merge_report_entry(ta_parent, list, num, &r);
+}
+
+static void archive_entry(struct stats_base *base, struct stat_entry *e)
+{
+    merge_entry(base, &base->archive, &base->num_archive, e);
+}
+
+void stats_global_enable_report(struct mpv_global *global)
+{
+    struct stats_base *stats = global->stats;
+    assert(stats);
+
+    mp_mutex_lock(&stats->lock);
+    stats->report = true;
+    stats->report_start = mp_time_ns();
+    atomic_store(&stats->active, true);
+    mp_mutex_unlock(&stats->lock);
+}
+
+static void add_report_entry(struct mpv_node *map, struct report_entry *e,
+                             double duration)
+{
+    struct mpv_node *ne = node_map_add(map, e->full_name, MPV_FORMAT_NODE_MAP);
+    switch (e->type) {
+    case VAL_STATIC:
+    case VAL_STATIC_SIZE:
+        node_map_add_string(ne, "type", "value");
+        node_map_add_double(ne, "last", e->last_d);
+        node_map_add_double(ne, "avg", e->total_d / MPMAX(e->total_count, 1));
+        node_map_add_double(ne, "max", e->max_d);
+        break;
+    case VAL_INC:
+        node_map_add_string(ne, "type", "events");
+        node_map_add_double(ne, "total", e->total_d);
+        node_map_add_double(ne, "per_second", duration > 0 ? e->total_d / duration : 0);
+        break;
+    case VAL_TIME:
+        node_map_add_string(ne, "type", "time");
+        node_map_add_int64(ne, "count", e->total_count);
+        node_map_add_double(ne, "time", MP_TIME_NS_TO_S(e->total_rt));
+        node_map_add_double(ne, "cpu", MP_TIME_NS_TO_S(e->total_th));
+        node_map_add_double(ne, "per_second",
+                            duration > 0 ? e->total_count / duration : 0);
+        break;
+    case VAL_THREAD_CPU_TIME:
+        node_map_add_string(ne, "type", "thread-cpu");
+        node_map_add_double(ne, "cpu", MP_TIME_NS_TO_S(e->total_th));
+        break;
+    default: ;
+    }
+}
+
+void stats_global_report(struct mpv_global *global, struct mpv_node *out)
+{
+    struct stats_base *stats = global->stats;
+    assert(stats);
+
+    mp_mutex_lock(&stats->lock);
+
+    // Merge copies of archived and live entries, so that values of the same
+    // name are combined.
+    void *tmp = talloc_new(NULL);
+    struct report_entry **list = NULL;
+    int num = 0;
+    for (int n = 0; n < stats->num_archive; n++)
+        merge_report_entry(tmp, &list, &num, stats->archive[n]);
+    for (struct stats_ctx *ctx = stats->list.head; ctx; ctx = ctx->list.next) {
+        for (int n = 0; n < ctx->num_entries; n++)
+            merge_entry(tmp, &list, &num, ctx->entries[n]);
+    }
+    if (num)
+        qsort(list, num, sizeof(list[0]), cmp_report_entry);
+
+    double duration = stats->report ?
+        MP_TIME_NS_TO_S(mp_time_ns() - stats->report_start) : 0;
+
+    node_init(out, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_double(out, "duration", duration);
+    struct mpv_node *entries = node_map_add(out, "entries", MPV_FORMAT_NODE_MAP);
+    for (int n = 0; n < num; n++)
+        add_report_entry(entries, list[n], duration);
+
+    talloc_free(tmp);
+
+    mp_mutex_unlock(&stats->lock);
+}
+
+void stats_global_enable_trace(struct mpv_global *global)
+{
+    struct stats_base *stats = global->stats;
+    assert(stats);
+
+    mp_mutex_lock(&stats->lock);
+    if (!stats->trace_start)
+        stats->trace_start = mp_time_ns();
+    atomic_store(&stats->trace, true);
+    atomic_store(&stats->active, true);
+    mp_mutex_unlock(&stats->lock);
+}
+
+static struct trace_buffer *get_trace_buffer(struct stats_base *base)
+{
+    if (trace_tls.base_id == base->trace_id)
+        return trace_tls.buf;
+
+    mp_mutex_lock(&base->lock);
+    struct trace_buffer *buf = NULL;
+    if (base->num_trace_buffers < MAX_TRACE_BUFFERS) {
+        buf = talloc_zero(base, struct trace_buffer);
+        mp_mutex_init(&buf->lock);
+        buf->events = talloc_array(buf, struct trace_event, TRACE_EVENTS);
+        MP_TARRAY_APPEND(base, base->trace_buffers, base->num_trace_buffers, buf);
+    } else {
+        for (int n = 0; n < base->num_trace_buffers; n++) {
+            if (base->trace_buffers[n]->done) {
+                buf = base->trace_buffers[n];
+                // Move to the end, so that the oldest is reused first.
+                MP_TARRAY_REMOVE_AT(base->trace_buffers, base->num_trace_buffers, n);
+                MP_TARRAY_APPEND(base, base->trace_buffers, base->num_trace_buffers, buf);
+                break;
+            }
+        }
+    }
+    bool warn = false;
+    if (buf) {
+        mp_mutex_lock(&buf->lock);
+        buf->tid = ++base->trace_next_tid;
+        snprintf(buf->name, sizeof(buf->name), "thread-%d", buf->tid);
+        buf->num_events = 0;
+        mp_mutex_unlock(&buf->lock);
+        buf->done = false;
+    } else {
+        warn = !base->trace_full_warned;
+        base->trace_full_warned = true;
+    }
+    mp_mutex_unlock(&base->lock);
+
+    trace_tls.base_id = base->trace_id;
+    trace_tls.buf = buf;
+
+    if (buf)
+        trace_set_owner(base, buf);
+    if (warn) {
+        mp_warn(base->global->log, "More than %d threads are alive with "
+                "tracing enabled; events of new threads are not recorded.\n",
+                MAX_TRACE_BUFFERS);
+    }
+    return buf;
+}
+
+static void trace_add(struct stat_entry *e, enum trace_type type, int64_t ts,
+                      int64_t dur, double value)
+{
+    struct trace_buffer *buf = get_trace_buffer(e->ctx->base);
+    if (!buf)
+        return;
+
+    mp_mutex_lock(&buf->lock);
+    struct trace_event *ev = &buf->events[buf->num_events++ % TRACE_EVENTS];
+    snprintf(ev->name, sizeof(ev->name), "%s", e->full_name);
+    ev->type = type;
+    ev->ts_ns = ts;
+    ev->dur_ns = dur;
+    ev->value = value;
+    mp_mutex_unlock(&buf->lock);
+}
+
+// Set the name shown for the current thread, or mark its buffer as reusable.
+static void trace_register_thread(struct stat_entry *e, bool reg)
+{
+    struct stats_ctx *ctx = e->ctx;
+    if (!IS_TRACING(ctx))
+        return;
+    struct trace_buffer *buf = get_trace_buffer(ctx->base);
+    if (!buf)
+        return;
+    if (reg) {
+        mp_mutex_lock(&buf->lock);
+        snprintf(buf->name, sizeof(buf->name), "%s", e->full_name);
+        mp_mutex_unlock(&buf->lock);
+    } else {
+        mp_mutex_lock(&ctx->base->lock);
+        buf->done = true;
+        mp_mutex_unlock(&ctx->base->lock);
+        trace_tls.base_id = 0; // the thread will most likely exit now
+    }
+}
+
+static void append_trace_string(void *ta_parent, bstr *b, const char *str)
+{
+    char *tmp = talloc_strdup(NULL, "");
+    json_write(&tmp, &(struct mpv_node){
+        .format = MPV_FORMAT_STRING,
+        .u.string = (char *)str,
+    });
+    bstr_xappend(ta_parent, b, bstr0(tmp));
+    talloc_free(tmp);
+}
+
+char *stats_global_trace(struct mpv_global *global, void *ta_parent)
+{
+    struct stats_base *stats = global->stats;
+    assert(stats);
+
+    void *tmp = talloc_new(NULL);
+    bstr b = {0};
+    bstr_xappend(ta_parent, &b, bstr0("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    bool first = true;
+
+    mp_mutex_lock(&stats->lock);
+    int num_buffers = stats->num_trace_buffers;
+    struct trace_buffer **buffers = talloc_array(tmp, struct trace_buffer *,
+                                                 num_buffers);
+    for (int n = 0; n < num_buffers; n++)
+        buffers[n] = stats->trace_buffers[n];
+    int64_t start = stats->trace_start;
+    mp_mutex_unlock(&stats->lock);
+
+    // Copy each ring, so that the thread is blocked only for a short time.
+    struct trace_event *events = talloc_array(tmp, struct trace_event,
+                                              TRACE_EVENTS);
+    for (int i = 0; i < num_buffers; i++) {
+        struct trace_buffer *buf = buffers[i];
+        char name[sizeof(buf->name)];
+
+        mp_mutex_lock(&buf->lock);
+        int tid = buf->tid;
+        snprintf(name, sizeof(name), "%s", buf->name);
+        uint64_t total = buf->num_events;
+        int num = MPMIN(total, TRACE_EVENTS);
+        for (int n = 0; n < num; n++)
+            events[n] = buf->events[(total - num + n) % TRACE_EVENTS];
+        mp_mutex_unlock(&buf->lock);
+
+        bstr_xappend_asprintf(ta_parent, &b, "%s\n{\"ph\":\"M\",\"pid\":1,"
+                              "\"tid\":%d,\"name\":\"thread_name\","
+                              "\"args\":{\"name\":", first ? "" : ",", tid);
+        append_trace_string(ta_parent, &b, name);
+        bstr_xappend(ta_parent, &b, bstr0("}}"));
+        first = false;
+
+        for (int n = 0; n < num; n++) {
+            struct trace_event *ev = &events[n];
+            if (ev->ts_ns < start)
+                continue;
+            bstr_xappend(ta_parent, &b, bstr0(",\n{\"name\":"));
+            append_trace_string(ta_parent, &b, ev->name);
+            switch (ev->type) {
+            case TRACE_SPAN:
+                bstr_xappend_asprintf(ta_parent, &b, ",\"ph\":\"X\",\"dur\":%.3f",
+                                      ev->dur_ns / 1000.0);
+                break;
+            case TRACE_EVENT:
+                bstr_xappend_asprintf(ta_parent, &b, ",\"ph\":\"i\",\"s\":\"t\","
+                                      "\"args\":{\"value\":%.17g}", ev->value);
+                break;
+            case TRACE_VALUE:
+                bstr_xappend_asprintf(ta_parent, &b, ",\"ph\":\"C\","
+                                      "\"args\":{\"value\":%.17g}", ev->value);
+                break;
+            }
+            bstr_xappend_asprintf(ta_parent, &b, ",\"pid\":1,\"tid\":%d,"
+                                  "\"ts\":%.3f}", tid, (ev->ts_ns - start) / 1000.0);
+        }
+    }
+
+    bstr_xappend(ta_parent, &b, bstr0("\n]}\n"));
+    talloc_free(tmp);
+    return (char *)b.start;
+}
+
 static void stats_ctx_destroy(void *p)
 {
     struct stats_ctx *ctx = p;
 
     mp_mutex_lock(&ctx->base->lock);
+    if (ctx->base->report) {
+        for (int n = 0; n < ctx->num_entries; n++)
+            archive_entry(ctx->base, ctx->entries[n]);
+    }
     LL_REMOVE(list, &ctx->base->list, ctx);
     ctx->base->num_entries = 0; // invalidate
     mp_mutex_unlock(&ctx->base->lock);
@@ -235,6 +751,8 @@ static struct stat_entry *find_entry(struct stats_ctx *ctx, const char *name)
     assert(strcmp(e->name, name) == 0); // make e->name larger and don't complain
 
     e->full_name = talloc_asprintf(e, "%s/%s", ctx->prefix, e->name);
+    e->ctx = ctx;
+    atomic_init(&e->max_d, -INFINITY);
 
     MP_TARRAY_APPEND(ctx, ctx->entries, ctx->num_entries, e);
     ctx->base->num_entries = 0; // invalidate
@@ -242,65 +760,132 @@ static struct stat_entry *find_entry(struct stats_ctx *ctx, const char *name)
     return e;
 }
 
-static void static_value(struct stats_ctx *ctx, const char *name, double val,
-                         enum val_type type)
+struct stat_entry *stats_get_entry(struct stats_ctx *ctx, const char *name)
 {
-    if (!IS_ACTIVE(ctx))
-        return;
     mp_mutex_lock(&ctx->base->lock);
     struct stat_entry *e = find_entry(ctx, name);
-    e->val_d = val;
-    e->type = type;
     mp_mutex_unlock(&ctx->base->lock);
+    return e;
+}
+
+static void static_value(struct stat_entry *e, double val, enum val_type type)
+{
+    if (!IS_ACTIVE(e->ctx))
+        return;
+    atomic_store_explicit(&e->val_d, val, memory_order_relaxed);
+    atomic_store_explicit(&e->type, type, memory_order_relaxed);
+    atomic_store_explicit(&e->report_type, type, memory_order_relaxed);
+    atomic_add_double(&e->total_d, val);
+    atomic_max_double(&e->max_d, val);
+    atomic_fetch_add_explicit(&e->total_count, 1, memory_order_relaxed);
+
+    if (IS_TRACING(e->ctx))
+        trace_add(e, TRACE_VALUE, mp_time_ns(), 0, val);
+}
+
+void stats_entry_value(struct stat_entry *e, double val)
+{
+    static_value(e, val, VAL_STATIC);
+}
+
+void stats_entry_size_value(struct stat_entry *e, double val)
+{
+    static_value(e, val, VAL_STATIC_SIZE);
+}
+
+void stats_entry_time_start(struct stat_entry *e)
+{
+    MP_STATS(e->ctx->base->global, "start %s", e->name);
+    if (!IS_ACTIVE(e->ctx))
+        return;
+    atomic_store_explicit(&e->time_cpu_start_ns,
+                          mp_thread_cpu_time_ns(mp_thread_current_id()),
+                          memory_order_relaxed);
+    atomic_store_explicit(&e->time_start_ns, mp_time_ns(), memory_order_relaxed);
+}
+
+void stats_entry_time_end(struct stat_entry *e)
+{
+    MP_STATS(e->ctx->base->global, "end %s", e->name);
+    if (!IS_ACTIVE(e->ctx))
+        return;
+    int64_t start = atomic_exchange_explicit(&e->time_start_ns, 0,
+                                             memory_order_relaxed);
+    if (!start)
+        return;
+    int64_t rt = mp_time_ns() - start;
+    int64_t th = mp_thread_cpu_time_ns(mp_thread_current_id()) -
+                 atomic_load_explicit(&e->time_cpu_start_ns, memory_order_relaxed);
+    atomic_store_explicit(&e->type, VAL_TIME, memory_order_relaxed);
+    atomic_store_explicit(&e->report_type, VAL_TIME, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->val_rt, rt, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->val_th, th, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->total_rt, rt, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->total_th, th, memory_order_relaxed);
+    atomic_fetch_add_explicit(&e->total_count, 1, memory_order_relaxed);
+
+    if (IS_TRACING(e->ctx))
+        trace_add(e, TRACE_SPAN, start, rt, 0);
+}
+
+void stats_entry_event_add(struct stat_entry *e, double amount)
+{
+    if (!IS_ACTIVE(e->ctx))
+        return;
+    atomic_add_double(&e->val_d, amount);
+    atomic_store_explicit(&e->type, VAL_INC, memory_order_relaxed);
+    atomic_store_explicit(&e->report_type, VAL_INC, memory_order_relaxed);
+    atomic_add_double(&e->total_d, amount);
+    atomic_fetch_add_explicit(&e->total_count, 1, memory_order_relaxed);
+
+    if (IS_TRACING(e->ctx))
+        trace_add(e, TRACE_EVENT, mp_time_ns(), 0, amount);
+}
+
+void stats_entry_event(struct stat_entry *e)
+{
+    stats_entry_event_add(e, 1);
 }
 
 void stats_value(struct stats_ctx *ctx, const char *name, double val)
 {
-    static_value(ctx, name, val, VAL_STATIC);
+    if (IS_ACTIVE(ctx))
+        stats_entry_value(stats_get_entry(ctx, name), val);
 }
 
 void stats_size_value(struct stats_ctx *ctx, const char *name, double val)
 {
-    static_value(ctx, name, val, VAL_STATIC_SIZE);
+    if (IS_ACTIVE(ctx))
+        stats_entry_size_value(stats_get_entry(ctx, name), val);
 }
 
 void stats_time_start(struct stats_ctx *ctx, const char *name)
 {
-    MP_STATS(ctx->base->global, "start %s", name);
-    if (!IS_ACTIVE(ctx))
-        return;
-    mp_mutex_lock(&ctx->base->lock);
-    struct stat_entry *e = find_entry(ctx, name);
-    e->cpu_start_ns = mp_thread_cpu_time_ns(mp_thread_current_id());
-    e->time_start_ns = mp_time_ns();
-    mp_mutex_unlock(&ctx->base->lock);
+    if (IS_ACTIVE(ctx)) {
+        stats_entry_time_start(stats_get_entry(ctx, name));
+    } else {
+        MP_STATS(ctx->base->global, "start %s", name);
+    }
 }
 
 void stats_time_end(struct stats_ctx *ctx, const char *name)
 {
-    MP_STATS(ctx->base->global, "end %s", name);
-    if (!IS_ACTIVE(ctx))
-        return;
-    mp_mutex_lock(&ctx->base->lock);
-    struct stat_entry *e = find_entry(ctx, name);
-    if (e->time_start_ns) {
-        e->type = VAL_TIME;
-        e->val_rt += mp_time_ns() - e->time_start_ns;
-        e->val_th += mp_thread_cpu_time_ns(mp_thread_current_id()) - e->cpu_start_ns;
-        e->time_start_ns = 0;
+    if (IS_ACTIVE(ctx)) {
+        stats_entry_time_end(stats_get_entry(ctx, name));
+    } else {
+        MP_STATS(ctx->base->global, "end %s", name);
     }
-    mp_mutex_unlock(&ctx->base->lock);
+}
+
+void stats_event_add(struct stats_ctx *ctx, const char *name, double amount)
+{
+    if (IS_ACTIVE(ctx))
+        stats_entry_event_add(stats_get_entry(ctx, name), amount);
 }
 
 void stats_event(struct stats_ctx *ctx, const char *name)
 {
-    if (!IS_ACTIVE(ctx))
-        return;
-    mp_mutex_lock(&ctx->base->lock);
-    struct stat_entry *e = find_entry(ctx, name);
-    e->val_d += 1;
-    e->type = VAL_INC;
-    mp_mutex_unlock(&ctx->base->lock);
+    stats_event_add(ctx, name, 1);
 }
 
 static void register_thread(struct stats_ctx *ctx, const char *name,
@@ -308,9 +893,19 @@ static void register_thread(struct stats_ctx *ctx, const char *name,
 {
     mp_mutex_lock(&ctx->base->lock);
     struct stat_entry *e = find_entry(ctx, name);
-    e->type = type;
+    if (ctx->base->report && !type &&
+        atomic_load(&e->type) == VAL_THREAD_CPU_TIME)
+    {
+        archive_entry(ctx->base, e);
+        atomic_store(&e->report_type, 0);
+    }
+    atomic_store(&e->type, type);
+    if (type)
+        atomic_store(&e->report_type, type);
     e->thread_id = mp_thread_current_id();
     mp_mutex_unlock(&ctx->base->lock);
+
+    trace_register_thread(e, type);
 }
 
 void stats_register_thread_cputime(struct stats_ctx *ctx, const char *name)
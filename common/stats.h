@@ -2,11 +2,29 @@
 
 struct mpv_global;
 struct mpv_node;
+struct stat_entry;
 struct stats_ctx;
 
 void stats_global_init(struct mpv_global *global);
 void stats_global_query(struct mpv_global *global, struct mpv_node *out);
 
+// Start collecting cumulative values of all entries (including those of
+// stats_ctx destroyed later), for stats_global_report().
+void stats_global_enable_report(struct mpv_global *global);
+
+// Return a MPV_FORMAT_NODE_MAP with the total of every entry since
+// stats_global_enable_report() was called. Unlike stats_global_query(), this
+// does not reset anything.
+void stats_global_report(struct mpv_global *global, struct mpv_node *out);
+
+// Start recording every time span, event and value with its thread and
+// timestamp into per-thread ring buffers, for stats_global_trace().
+void stats_global_enable_trace(struct mpv_global *global);
+
+// Return the recorded trace as Chrome trace event format JSON (as understood
+// by chrome://tracing and Perfetto), allocated with ta_parent.
+char *stats_global_trace(struct mpv_global *global, void *ta_parent);
+
 // stats_ctx can be free'd with ta_free(), or by using the ta_parent.
 struct stats_ctx *stats_ctx_create(void *ta_parent, struct mpv_global *global,
                                    const char *prefix);
@@ -25,6 +43,24 @@ void stats_time_end(struct stats_ctx *ctx, const char *name);
 // Display number of events per poll period.
 void stats_event(struct stats_ctx *ctx, const char *name);
 
+// Like stats_event(), but count the given amount (e.g. bytes) per event.
+void stats_event_add(struct stats_ctx *ctx, const char *name, double amount);
+
+// Return a handle for the entry with the given name, creating it if needed.
+// The handle stays valid until the stats_ctx is destroyed. Unlike the name
+// based functions above, which look up the entry under a global lock, the
+// stats_entry_*() functions only do atomic updates and take no lock, so they
+// are suitable for hot paths. Spans of the same entry should not overlap, and
+// stats_entry_time_start() and _end() should be called on the same thread.
+struct stat_entry *stats_get_entry(struct stats_ctx *ctx, const char *name);
+
+void stats_entry_value(struct stat_entry *e, double val);
+void stats_entry_size_value(struct stat_entry *e, double val);
+void stats_entry_time_start(struct stat_entry *e);
+void stats_entry_time_end(struct stat_entry *e);
+void stats_entry_event(struct stat_entry *e);
+void stats_entry_event_add(struct stat_entry *e, double amount);
+
 // Report the thread's CPU time. This needs to be called only once per thread.
 // The current thread is assumed to stay valid until the stats_ctx is destroyed
 // or stats_unregister_thread() is called, otherwise UB will occur.
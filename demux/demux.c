@@ -151,6 +151,7 @@ struct demux_internal {
     struct mp_log *log;
     struct mpv_global *global;
     struct stats_ctx *stats;
+    struct stat_entry *stat_packets, *stat_bytes, *stat_queue_bytes;
 
     bool can_cache;             // not a slave demuxer; caching makes sense
     bool can_record;            // stream recording is allowed
@@ -2074,6 +2075,8 @@ static void add_packet_locked(struct sh_stream *stream, demux_packet_t *dp)
 
     size_t bytes = demux_packet_estimate_total_size(dp);
     in->total_bytes += bytes;
+    stats_entry_event(in->stat_packets);
+    stats_entry_event_add(in->stat_bytes, dp->len);
     dp->cum_pos = queue->tail_cum_pos;
     queue->tail_cum_pos += bytes;
 
@@ -2203,6 +2206,7 @@ static bool read_packet(struct demux_internal *in)
 
     MP_TRACE(in, "bytes=%zd, read_more=%d prefetch_more=%d, refresh_more=%d\n",
              (size_t)total_fw_bytes, read_more, prefetch_more, refresh_more);
+    stats_entry_size_value(in->stat_queue_bytes, total_fw_bytes);
     if (total_fw_bytes >= in->max_bytes) {
         // if we hit the limit just by prefetching, simply stop prefetching
         if (!read_more) {
@@ -2984,6 +2988,7 @@ static void demux_copy(struct demuxer *dst, struct demuxer *src)
     dst->num_attachments = src->num_attachments;
     dst->matroska_data = src->matroska_data;
     dst->playlist = src->playlist;
+    dst->dir_scan = src->dir_scan;
     dst->seekable = src->seekable;
     dst->partially_seekable = src->partially_seekable;
     dst->filetype = src->filetype;
@@ -3309,6 +3314,9 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .demux_ts = MP_NOPTS_VALUE,
         .owns_stream = !params->external_stream,
     };
+    in->stat_packets = stats_get_entry(in->stats, "packets");
+    in->stat_bytes = stats_get_entry(in->stats, "bytes");
+    in->stat_queue_bytes = stats_get_entry(in->stats, "queue-bytes");
     mp_mutex_init(&in->lock);
     mp_cond_init(&in->wakeup);
 
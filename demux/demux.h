@@ -259,6 +259,9 @@ typedef struct demuxer {
 
     // If the file is a playlist file
     struct playlist *playlist;
+    // Rest of a directory playlist that is scanned in the background. The user
+    // can take ownership with talloc_steal(). See demux_dir_scan_read().
+    struct demux_dir_scan *dir_scan;
 
     struct mp_tags *metadata;
 
@@ -365,4 +368,10 @@ bool demux_matroska_uid_cmp(struct matroska_segment_uid *a,
 
 const char *stream_type_name(enum stream_type type);
 
+// demux_playlist.c
+bool demux_dir_scan_read(struct demux_dir_scan *scan, struct playlist *pl,
+                         bool wait);
+void demux_dir_scan_set_wakeup_cb(struct demux_dir_scan *scan,
+                                  void (*cb)(void *ctx), void *ctx);
+
 #endif /* MPLAYER_DEMUXER_H */
@@ -255,9 +255,10 @@ static void find_ordered_chapter_sources(struct tl_ctx *ctx)
                 playlist_parse_file(opts->ordered_chapters_files,
                                     ctx->tl->cancel, ctx->global);
             talloc_steal(tmp, pl);
-            for (int n = 0; n < pl->num_entries; n++) {
-                MP_TARRAY_APPEND(tmp, filenames, num_filenames,
-                                 pl->entries[n]->filename);
+            for (struct playlist_entry *e = playlist_get_first(pl); e;
+                 e = playlist_entry_get_rel(e, 1))
+            {
+                MP_TARRAY_APPEND(tmp, filenames, num_filenames, e->filename);
             }
         } else if (!ctx->demuxer->stream->is_local_fs) {
             MP_WARN(ctx, "Playback source is not a "
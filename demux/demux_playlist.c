@@ -26,11 +26,13 @@
 #include "common/msg.h"
 #include "common/playlist.h"
 #include "misc/charset_conv.h"
+#include "misc/thread_pool.h"
 #include "misc/thread_tools.h"
 #include "options/path.h"
 #include "player/core.h"
 #include "stream/stream.h"
 #include "osdep/io.h"
+#include "osdep/threads.h"
 #include "misc/natural_sort.h"
 #include "demux.h"
 
@@ -55,6 +57,7 @@ enum autocreate_mode {
 struct demux_playlist_opts {
     int dir_mode;
     char **directory_filter;
+    bool async_scan;
 };
 
 struct m_sub_options demux_playlist_conf = {
@@ -66,6 +69,7 @@ struct m_sub_options demux_playlist_conf = {
             {"ignore", DIR_IGNORE})},
         {"directory-filter-types",
             OPT_STRINGLIST(directory_filter)},
+        {"directory-async-scan", OPT_BOOL(async_scan)},
         {0}
     },
     .size = sizeof(struct demux_playlist_opts),
@@ -107,6 +111,7 @@ struct pl_parser {
     char *codepage;
     struct demux_playlist_opts *opts;
     struct MPOpts *mp_opts;
+    struct demux_dir_scan *dir_scan;
 };
 
 
@@ -387,6 +392,38 @@ static int parse_txt(struct pl_parser *p)
 }
 
 #define MAX_DIR_STACK 20
+#define MAX_SCAN_THREADS 4
+
+struct demux_dir_scan {
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+    struct MPOpts *mp_opts;
+    int dir_mode;
+    int autocreate;
+    int stream_flags;
+
+    // With --directory-async-scan, each subdirectory of the top level directory
+    // is scanned on a worker thread. Otherwise, this is NULL and everything is
+    // scanned while opening.
+    struct mp_thread_pool *pool;
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
+    struct dir_scan_job **jobs; // in playlist order
+    int num_jobs;
+    int num_read;               // jobs[0..num_read-1] were returned and freed
+};
+
+struct dir_scan_job {
+    struct demux_dir_scan *scan;
+    char *path;
+    struct stat dir_stack[MAX_DIR_STACK];
+    int num_dir_stack;
+    struct playlist *pl;        // owned by the worker thread until done is set
+    bool done;
+};
 
 static bool same_st(struct stat *st1, struct stat *st2)
 {
@@ -395,7 +432,7 @@ static bool same_st(struct stat *st1, struct stat *st2)
 
 struct pl_dir_entry {
     char *path;
-    char *name;
+    bstr key; // mp_natural_sort_key() of the name
     struct stat st;
     bool is_dir;
 };
@@ -405,72 +442,78 @@ static int cmp_dir_entry(const void *a, const void *b)
     struct pl_dir_entry *a_entry = (struct pl_dir_entry*) a;
     struct pl_dir_entry *b_entry = (struct pl_dir_entry*) b;
     if (a_entry->is_dir == b_entry->is_dir) {
-        return mp_natural_sort_cmp(a_entry->name, b_entry->name);
+        return bstrcmp(a_entry->key, b_entry->key);
     } else {
         return a_entry->is_dir ? 1 : -1;
     }
 }
 
-static bool test_path(struct pl_parser *p, char *path, int autocreate)
+static bool test_path(struct demux_dir_scan *scan, char *path)
 {
+    int autocreate = scan->autocreate;
     if (autocreate & AUTO_ANY)
         return true;
 
     bstr ext = bstr_get_ext(bstr0(path));
-    if (autocreate & AUTO_VIDEO && str_in_list(ext, p->mp_opts->video_exts))
+    if (autocreate & AUTO_VIDEO && str_in_list(ext, scan->mp_opts->video_exts))
         return true;
-    if (autocreate & AUTO_AUDIO && str_in_list(ext, p->mp_opts->audio_exts))
+    if (autocreate & AUTO_AUDIO && str_in_list(ext, scan->mp_opts->audio_exts))
         return true;
-    if (autocreate & AUTO_IMAGE && str_in_list(ext, p->mp_opts->image_exts))
+    if (autocreate & AUTO_IMAGE && str_in_list(ext, scan->mp_opts->image_exts))
         return true;
 
     return false;
 }
 
+static void add_scan_job(struct demux_dir_scan *scan, char *path,
+                         struct stat *dir_stack, int num_dir_stack);
+
 // Return true if this was a readable directory.
-static bool scan_dir(struct pl_parser *p, char *path,
-                     struct stat *dir_stack, int num_dir_stack, int autocreate)
+static bool scan_dir(struct demux_dir_scan *scan, struct playlist *pl,
+                     char *path, struct stat *dir_stack, int num_dir_stack)
 {
     if (strlen(path) >= 8192 || num_dir_stack == MAX_DIR_STACK)
         return false; // things like mount bind loops
 
     DIR *dp = opendir(path);
     if (!dp) {
-        MP_ERR(p, "Could not read directory.\n");
+        MP_ERR(scan, "Could not read directory.\n");
         return false;
     }
 
+    void *tmp = talloc_new(NULL);
     struct pl_dir_entry *dir_entries = NULL;
     int num_dir_entries = 0;
     int path_len = strlen(path);
-    int dir_mode = p->opts->dir_mode;
+    int dir_mode = scan->dir_mode;
 
     struct dirent *ep;
     while ((ep = readdir(dp))) {
         if (ep->d_name[0] == '.')
             continue;
 
-        if (mp_cancel_test(p->s->cancel))
+        if (mp_cancel_test(scan->cancel))
             break;
 
-        char *file = mp_path_join(p, path, ep->d_name);
+        char *file = mp_path_join(tmp, path, ep->d_name);
+        bstr key = mp_natural_sort_key(tmp, &file[path_len]);
 
         struct stat st;
         if (stat(file, &st) == 0 && S_ISDIR(st.st_mode)) {
             if (dir_mode != DIR_IGNORE) {
                 for (int n = 0; n < num_dir_stack; n++) {
                     if (same_st(&dir_stack[n], &st)) {
-                        MP_VERBOSE(p, "Skip recursive entry: %s\n", file);
+                        MP_VERBOSE(scan, "Skip recursive entry: %s\n", file);
                         goto skip;
                     }
                 }
 
-                struct pl_dir_entry d = {file, &file[path_len], st, true};
-                MP_TARRAY_APPEND(p, dir_entries, num_dir_entries, d);
+                struct pl_dir_entry d = {file, key, st, true};
+                MP_TARRAY_APPEND(tmp, dir_entries, num_dir_entries, d);
             }
         } else {
-            struct pl_dir_entry f = {file, &file[path_len], .is_dir = false};
-            MP_TARRAY_APPEND(p, dir_entries, num_dir_entries, f);
+            struct pl_dir_entry f = {file, key, .is_dir = false};
+            MP_TARRAY_APPEND(tmp, dir_entries, num_dir_entries, f);
         }
 
         skip: ;
@@ -484,17 +527,116 @@ static bool scan_dir(struct pl_parser *p, char *path,
         char *file = dir_entries[n].path;
         if (dir_mode == DIR_RECURSIVE && dir_entries[n].is_dir) {
             dir_stack[num_dir_stack] = dir_entries[n].st;
-            scan_dir(p, file, dir_stack, num_dir_stack + 1, autocreate);
+            if (scan->pool && num_dir_stack == 0) {
+                add_scan_job(scan, file, dir_stack, num_dir_stack + 1);
+            } else {
+                scan_dir(scan, pl, file, dir_stack, num_dir_stack + 1);
+            }
         }
         else {
-            if (dir_entries[n].is_dir || test_path(p, file, autocreate))
-                playlist_append_file(p->pl, dir_entries[n].path);
+            if (dir_entries[n].is_dir || test_path(scan, file))
+                playlist_append_file(pl, dir_entries[n].path);
         }
     }
 
+    talloc_free(tmp);
     return true;
 }
 
+static void scan_job_worker(void *ctx)
+{
+    struct dir_scan_job *job = ctx;
+    struct demux_dir_scan *scan = job->scan;
+
+    if (!mp_cancel_test(scan->cancel))
+        scan_dir(scan, job->pl, job->path, job->dir_stack, job->num_dir_stack);
+
+    mp_mutex_lock(&scan->lock);
+    job->done = true;
+    mp_cond_broadcast(&scan->wakeup);
+    if (scan->wakeup_cb)
+        scan->wakeup_cb(scan->wakeup_cb_ctx);
+    mp_mutex_unlock(&scan->lock);
+}
+
+static void add_scan_job(struct demux_dir_scan *scan, char *path,
+                         struct stat *dir_stack, int num_dir_stack)
+{
+    struct dir_scan_job *job = talloc_zero(scan, struct dir_scan_job);
+    job->scan = scan;
+    job->path = talloc_strdup(job, path);
+    memcpy(job->dir_stack, dir_stack, num_dir_stack * sizeof(dir_stack[0]));
+    job->num_dir_stack = num_dir_stack;
+    job->pl = talloc_zero(job, struct playlist);
+
+    mp_mutex_lock(&scan->lock);
+    MP_TARRAY_APPEND(scan, scan->jobs, scan->num_jobs, job);
+    mp_mutex_unlock(&scan->lock);
+
+    // Can't fail, because the pool has at least 1 thread.
+    mp_thread_pool_queue(scan->pool, scan_job_worker, job);
+}
+
+static void dir_scan_destroy(void *ptr)
+{
+    struct demux_dir_scan *scan = ptr;
+    mp_cancel_trigger(scan->cancel);
+    talloc_free(scan->pool); // waits until all jobs are done
+    mp_cond_destroy(&scan->wakeup);
+    mp_mutex_destroy(&scan->lock);
+}
+
+static struct demux_dir_scan *dir_scan_create(struct pl_parser *p,
+                                              int autocreate)
+{
+    struct demux_dir_scan *scan = talloc_zero(NULL, struct demux_dir_scan);
+    talloc_set_destructor(scan, dir_scan_destroy);
+    scan->log = mp_log_new(scan, p->log, NULL);
+    scan->cancel = mp_cancel_new(scan);
+    scan->mp_opts = mp_get_config_group(scan, p->global, &mp_opt_root);
+    scan->dir_mode = p->opts->dir_mode;
+    scan->autocreate = autocreate;
+    mp_mutex_init(&scan->lock);
+    mp_cond_init(&scan->wakeup);
+    return scan;
+}
+
+// Move the entries of finished subdirectory scans to the end of pl, stopping
+// at the first unfinished one to keep the order. If wait is set, block until
+// pl has at least 1 entry or the scan is complete. Returns false if the scan
+// is complete; the caller should free the scan then.
+bool demux_dir_scan_read(struct demux_dir_scan *scan, struct playlist *pl,
+                         bool wait)
+{
+    mp_mutex_lock(&scan->lock);
+    while (scan->num_read < scan->num_jobs) {
+        struct dir_scan_job *job = scan->jobs[scan->num_read];
+        if (!job->done) {
+            if (!wait || pl->num_entries)
+                break;
+            mp_cond_wait(&scan->wakeup, &scan->lock);
+            continue;
+        }
+        playlist_set_stream_flags(job->pl, scan->stream_flags);
+        playlist_append_entries(pl, job->pl);
+        talloc_free(job);
+        scan->num_read++;
+    }
+    bool more = scan->num_read < scan->num_jobs;
+    mp_mutex_unlock(&scan->lock);
+    return more;
+}
+
+// cb is called from worker threads when new entries are available.
+void demux_dir_scan_set_wakeup_cb(struct demux_dir_scan *scan,
+                                  void (*cb)(void *ctx), void *ctx)
+{
+    mp_mutex_lock(&scan->lock);
+    scan->wakeup_cb = cb;
+    scan->wakeup_cb_ctx = ctx;
+    mp_mutex_unlock(&scan->lock);
+}
+
 static enum autocreate_mode get_directory_filter(struct pl_parser *p)
 {
     enum autocreate_mode autocreate = AUTO_NONE;
@@ -559,14 +701,26 @@ static int parse_dir(struct pl_parser *p)
 
     struct stat dir_stack[MAX_DIR_STACK];
 
-    if (p->opts->dir_mode == DIR_AUTO) {
-        struct MPOpts *opts = mp_get_config_group(NULL, p->global, &mp_opt_root);
-        p->opts->dir_mode = opts->shuffle ? DIR_RECURSIVE : DIR_LAZY;
-        talloc_free(opts);
+    struct demux_dir_scan *scan = dir_scan_create(p, autocreate);
+    struct MPOpts *opts = scan->mp_opts;
+    if (scan->dir_mode == DIR_AUTO)
+        scan->dir_mode = opts->shuffle ? DIR_RECURSIVE : DIR_LAZY;
+    // Entries can be added later only if the whole playlist is not needed to
+    // start playback.
+    if (p->opts->async_scan && scan->dir_mode == DIR_RECURSIVE &&
+        !opts->shuffle && !opts->merge_files && opts->playlist_pos < 0)
+        scan->pool = mp_thread_pool_create(scan, 1, 1, MAX_SCAN_THREADS);
+
+    mp_cancel_set_parent(scan->cancel, p->s->cancel);
+    scan_dir(scan, p->pl, path, dir_stack, 0);
+    bool more = demux_dir_scan_read(scan, p->pl, true);
+    mp_cancel_set_parent(scan->cancel, NULL);
+    if (more && !mp_cancel_test(scan->cancel)) {
+        p->dir_scan = talloc_steal(p, scan);
+    } else {
+        talloc_free(scan);
     }
 
-    scan_dir(p, path, dir_stack, 0, autocreate);
-
     p->add_base = false;
     ret = p->pl->num_entries > 0 ? 0 : -1;
 
@@ -679,6 +833,10 @@ static int open_file(struct demuxer *demuxer, enum demux_check check)
     }
     playlist_set_stream_flags(p->pl, demuxer->stream_origin);
     demuxer->playlist = talloc_steal(demuxer, p->pl);
+    if (ok && p->dir_scan) {
+        p->dir_scan->stream_flags = demuxer->stream_origin;
+        demuxer->dir_scan = talloc_steal(demuxer, p->dir_scan);
+    }
     demuxer->filetype = p->format ? p->format : fmt->name;
     demuxer->fully_read = true;
     talloc_free(p);
@@ -38,6 +38,7 @@
 #include "common/codecs.h"
 #include "common/global.h"
 #include "common/recorder.h"
+#include "common/stats.h"
 #include "misc/dispatch.h"
 
 #include "audio/aframe.h"
@@ -162,6 +163,8 @@ struct priv {
 
     struct mp_codec_params *codec;
     struct mp_decoder *decoder;
+    struct stats_ctx *stats;
+    struct stat_entry *stat_packets, *stat_bytes, *stat_frames;
 
     // Demuxer output.
     struct mp_pin *demux;
@@ -922,6 +925,11 @@ static void feed_packet(struct priv *p)
         packet->pts = packet->dts = MP_NOPTS_VALUE;
     }
 
+    if (packet) {
+        stats_entry_event(p->stat_packets);
+        stats_entry_event_add(p->stat_bytes, packet->len);
+    }
+
     mp_pin_in_write(p->decoder->f->pins[0], p->packet);
     p->packet_fed = true;
     p->packet = MP_NO_FRAME;
@@ -1056,6 +1064,8 @@ static void read_frame(struct priv *p)
 
 output_frame:
     process_output_frame(p, frame);
+    if (frame.type != MP_FRAME_EOF)
+        stats_entry_event(p->stat_frames);
     mp_pin_in_write(pin, frame);
 }
 
@@ -1095,6 +1105,7 @@ static MP_THREAD_VOID dec_thread(void *ptr)
     case STREAM_AUDIO: t_name = "dec/audio"; break;
     }
     mp_thread_set_name(t_name);
+    stats_register_thread_cputime(p->stats, "thread");
 
     while (!p->request_terminate_dec_thread) {
         mp_filter_graph_run(p->dec_root_filter);
@@ -1102,6 +1113,8 @@ static MP_THREAD_VOID dec_thread(void *ptr)
         mp_dispatch_queue_process(p->dec_dispatch, INFINITY);
     }
 
+    stats_unregister_thread(p->stats, "thread");
+
     MP_THREAD_RETURN();
 }
 
@@ -1202,12 +1215,17 @@ struct mp_decoder_wrapper *mp_decoder_wrapper_create(struct mp_filter *parent,
         }
 
         p->queue_opts = p->opts->vdec_queue_opts;
+        p->stats = stats_ctx_create(p, public_f->global, "vd");
     } else if (p->header->type == STREAM_AUDIO) {
         p->log = mp_log_new(p, parent->global->log, "!ad");
         p->queue_opts = p->opts->adec_queue_opts;
+        p->stats = stats_ctx_create(p, public_f->global, "ad");
     } else {
         goto error;
     }
+    p->stat_packets = stats_get_entry(p->stats, "packets");
+    p->stat_bytes = stats_get_entry(p->stats, "bytes");
+    p->stat_frames = stats_get_entry(p->stats, "frames");
 
     if (p->queue_opts && p->queue_opts->use_queue) {
         p->queue = mp_async_queue_create();
@@ -1,6 +1,7 @@
 #include "audio/aframe.h"
 #include "audio/out/ao.h"
 #include "common/global.h"
+#include "common/stats.h"
 #include "options/m_config.h"
 #include "options/m_option.h"
 #include "video/out/vo.h"
@@ -17,6 +18,8 @@
 struct chain {
     struct mp_filter *f;
     struct mp_log *log;
+    struct stats_ctx *stats;
+    struct stat_entry *stat_frames;
 
     enum mp_output_chain_type type;
 
@@ -201,6 +204,9 @@ static void user_wrapper_process(struct mp_filter *f)
         if (pts != MP_NOPTS_VALUE)
             u->last_out_pts = pts;
 
+        if (u == p->output && frame.type != MP_FRAME_EOF)
+            stats_entry_event(p->stat_frames);
+
         mp_pin_in_write(f->ppins[1], frame);
 
         struct mp_filter_command cmd = {.type = MP_FILTER_COMMAND_IS_ACTIVE};
@@ -694,6 +700,9 @@ struct mp_output_chain *mp_output_chain_create(struct mp_filter *parent,
     p->f = f;
     p->log = f->log;
     p->type = type;
+    p->stats = stats_ctx_create(p, f->global,
+                                type == MP_OUTPUT_CHAIN_VIDEO ? "vf" : "af");
+    p->stat_frames = stats_get_entry(p->stats, "frames");
 
     struct mp_output_chain *c = &p->public;
     c->f = f;
@@ -231,8 +231,8 @@ struct mpv_handle;
 // Platform specific implementation, provided by ipc-*.c.
 struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
                                struct mpv_global *global);
-// Start a thread for the given handle and return a socket in out_fd[0] that
-// is served by this thread. If the FD is not full-duplex, then out_fd[0] is
+// Serve the given handle over IPC and return a socket in out_fd[0] that
+// is connected to it. If the FD is not full-duplex, then out_fd[0] is
 // the user's read-end, and out_fd[1] the write-end, otherwise out_fd[1] is set
 // to -1.
 //  returns:
@@ -251,4 +251,33 @@ char *mp_json_encode_event(struct mpv_event *event);
 struct mpv_handle;
 char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *buf);
 
+// Message framing of an IPC connection, which clients can switch with the
+// set_protocol command.
+enum mp_ipc_framing {
+    MP_IPC_FRAMING_JSON,        // newline-separated JSON (or text commands)
+    MP_IPC_FRAMING_MSGPACK,     // 32 bit big endian length + MessagePack
+};
+
+// State of a connection served with the functions below. The connection is
+// never blocked by requests: requests that could block are started
+// asynchronously, and their replies are sent from mp_ipc_encode_event().
+struct mp_ipc_conn;
+struct mp_ipc_conn *mp_ipc_conn_create(void *ta_parent, struct mpv_handle *client);
+
+// Whether a request that the client did not send as async is still running.
+// No further messages are executed until its reply event was passed to
+// mp_ipc_encode_event().
+bool mp_ipc_conn_busy(struct mp_ipc_conn *conn);
+
+// Append the serialized event to *out (allocated with ta_parent). All events
+// of the client must be passed to this, as it also handles request replies.
+void mp_ipc_encode_event(struct mp_ipc_conn *conn, void *ta_parent, bstr *out,
+                         struct mpv_event *event);
+
+// If "buf" starts with a complete message, and no request is running, remove
+// the message from the start of "buf" (without reallocating), execute it,
+// append the reply (if any, and if it's not deferred) to *out, and return true.
+bool mp_ipc_consume_next_message(struct mp_ipc_conn *conn, void *ta_parent,
+                                 bstr *out, bstr *buf);
+
 #endif /* MPLAYER_INPUT_H */
@@ -20,6 +20,7 @@
 #include <limits.h>
 #include <poll.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -42,16 +43,44 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+// If this much output is queued for a client, stop reading its commands and
+// events until the client catches up.
+#define MAX_PENDING_OUTPUT (256 * 1024)
+
+// Maximum size of an incomplete message. Clients which send more than this
+// without completing the message are disconnected.
+#define MAX_PENDING_INPUT (16 * 1024 * 1024)
+
+// All clients are served by a single thread (ipc_thread), which is started on
+// demand and polls the listening socket, all client sockets, and wakeup_pipe.
+// The latter is written by the mpv_handle wakeup callbacks and whenever the
+// shared state below changes.
 struct mp_ipc_ctx {
     struct mp_log *log;
     struct mp_client_api *client_api;
     const char *path;
+    int wakeup_pipe[2];
 
+    mp_mutex lock;
+    // --- protected by lock
     mp_thread thread;
-    int death_pipe[2];
+    bool thread_running;
+    bool terminate;         // mp_uninit_ipc() was called
+    bool detached;          // ipc_thread frees this struct on exit
+    int num_clients;        // including new_clients
+    struct client_arg **new_clients;
+    int num_new_clients;
+
+    // --- owned by ipc_thread
+    int listen_fd;
+    int client_num;
+    struct client_arg **clients;
+    int num_active;
+    struct pollfd *fds;
 };
 
 struct client_arg {
+    struct mp_ipc_ctx *ctx;
     struct mp_log *log;
     struct mpv_handle *client;
 
@@ -61,193 +90,189 @@ struct client_arg {
     bool quit_on_close;
 
     bool writable;
+    bool dead;
+    bool hangup;            // POLLHUP/POLLERR was reported
+    atomic_bool wakeup;     // set by the mpv_handle wakeup callback
+
+    struct mp_ipc_conn *conn;
+    bstr client_msg;        // unprocessed input
+    bstr out;               // queued output, starting at out_pos
+    size_t out_pos;
 };
 
-static int ipc_write_str(struct client_arg *client, const char *buf)
+static void ipc_wakeup(struct mp_ipc_ctx *ctx)
 {
-    size_t count = strlen(buf);
-    while (count > 0) {
-        ssize_t rc = send(client->client_fd, buf, count, MSG_NOSIGNAL);
-        if (rc <= 0) {
-            if (rc == 0)
-                return -1;
+    (void)write(ctx->wakeup_pipe[1], &(char){0}, 1);
+}
 
-            if (errno == EBADF || errno == ENOTSOCK) {
-                client->writable = false;
-                return 0;
-            }
+static void client_wakeup_cb(void *p)
+{
+    struct client_arg *arg = p;
+    if (!atomic_exchange(&arg->wakeup, true))
+        ipc_wakeup(arg->ctx);
+}
 
-            if (errno == EINTR || errno == EAGAIN)
-                continue;
+static size_t client_pending_output(struct client_arg *arg)
+{
+    return arg->out.len - arg->out_pos;
+}
+
+static bool client_blocked(struct client_arg *arg)
+{
+    return client_pending_output(arg) >= MAX_PENDING_OUTPUT;
+}
+
+// Stop reading input while a request is running or output is blocked, so
+// unprocessed input doesn't pile up.
+static bool client_can_read(struct client_arg *arg)
+{
+    return !client_blocked(arg) && !mp_ipc_conn_busy(arg->conn);
+}
 
-            return rc;
+// Write as much of the queued output as the socket accepts without blocking.
+static void client_flush(struct client_arg *arg)
+{
+    while (client_pending_output(arg)) {
+        ssize_t rc = send(arg->client_fd, arg->out.start + arg->out_pos,
+                          client_pending_output(arg), MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR)
+            continue;
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (rc < 0 && (errno == EBADF || errno == ENOTSOCK)) {
+            arg->writable = false;
+            arg->out_pos = arg->out.len;
+            break;
+        }
+        if (rc <= 0) {
+            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
+            arg->dead = true;
+            return;
         }
+        arg->out_pos += rc;
+    }
 
-        count -= rc;
-        buf   += rc;
+    if (arg->out_pos == arg->out.len) {
+        arg->out.len = arg->out_pos = 0;
+    } else if (arg->out_pos > arg->out.len / 2) {
+        memmove(arg->out.start, arg->out.start + arg->out_pos,
+                client_pending_output(arg));
+        arg->out.len -= arg->out_pos;
+        arg->out_pos = 0;
     }
+}
 
-    return 0;
+// Call after appending to arg->out.
+static void client_queued(struct client_arg *arg)
+{
+    if (!arg->writable) {
+        arg->out.len = arg->out_pos = 0;
+        return;
+    }
+    client_flush(arg);
 }
 
-static MP_THREAD_VOID client_thread(void *p)
+// Execute the complete messages in client_msg, until a request has to wait.
+static void client_process_messages(struct client_arg *arg)
 {
-    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
-    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
-    sigfillset(&sa.sa_mask);
-    sigaction(SIGPIPE, &sa, NULL);
+    bstr rest = arg->client_msg;
+    while (!arg->dead && mp_ipc_consume_next_message(arg->conn, arg, &arg->out,
+                                                     &rest))
+        client_queued(arg);
+    memmove(arg->client_msg.start, rest.start, rest.len);
+    arg->client_msg.len = rest.len;
+}
 
-    int rc;
+static void client_read_events(struct client_arg *arg)
+{
+    while (!arg->dead && !client_blocked(arg)) {
+        mpv_event *event = mpv_wait_event(arg->client, 0);
 
-    struct client_arg *arg = p;
-    bstr client_msg = { talloc_strdup(NULL, ""), 0 };
+        if (event->event_id == MPV_EVENT_NONE)
+            return;
+
+        if (event->event_id == MPV_EVENT_SHUTDOWN) {
+            arg->dead = true;
+            return;
+        }
 
-    char *tname = talloc_asprintf(NULL, "ipc/%s", arg->client_name);
-    mp_thread_set_name(tname);
-    talloc_free(tname);
+        // Replies to requests must be processed even if they're not sent.
+        bool busy = mp_ipc_conn_busy(arg->conn);
+        mp_ipc_encode_event(arg->conn, arg, &arg->out, event);
+        client_queued(arg);
 
-    int pipe_fd = mpv_get_wakeup_pipe(arg->client);
-    if (pipe_fd < 0) {
-        MP_ERR(arg, "Could not get wakeup pipe\n");
-        goto done;
+        // A request finished; continue with the next messages.
+        if (busy && !mp_ipc_conn_busy(arg->conn))
+            client_process_messages(arg);
     }
 
-    MP_VERBOSE(arg, "Client connected\n");
-
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = pipe_fd},
-        {.events = POLLIN, .fd = arg->client_fd},
-    };
+    // Stopped early; come back once the output was flushed.
+    atomic_store(&arg->wakeup, true);
+}
 
-    fcntl(arg->client_fd, F_SETFL, fcntl(arg->client_fd, F_GETFL, 0) | O_NONBLOCK);
+static void client_read_commands(struct client_arg *arg)
+{
+    while (!arg->dead && client_can_read(arg)) {
+        char buf[4096];
+        ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
 
-    while (1) {
-        rc = poll(fds, 2, 0);
-        if (rc == 0)
-            rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
-            continue;
+            MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
+            arg->dead = true;
+            return;
         }
 
-        if (fds[0].revents & POLLIN) {
-            mp_flush_wakeup_pipe(pipe_fd);
-
-            while (1) {
-                mpv_event *event = mpv_wait_event(arg->client, 0);
+        if (bytes == 0) {
+            MP_VERBOSE(arg, "Client disconnected\n");
+            arg->dead = true;
+            return;
+        }
 
-                if (event->event_id == MPV_EVENT_NONE)
-                    break;
+        bstr_xappend(arg, &arg->client_msg, (bstr){buf, bytes});
+        client_process_messages(arg);
 
-                if (event->event_id == MPV_EVENT_SHUTDOWN)
-                    goto done;
+        if (arg->client_msg.len > MAX_PENDING_INPUT) {
+            MP_ERR(arg, "Message too large, disconnecting client.\n");
+            arg->dead = true;
+            return;
+        }
+    }
+}
 
-                if (!arg->writable)
-                    continue;
+// Called on ipc_thread when it takes over a client.
+static void client_activate(struct client_arg *arg)
+{
+    MP_VERBOSE(arg, "Client connected\n");
 
-                char *event_msg = mp_json_encode_event(event);
-                if (!event_msg) {
-                    MP_ERR(arg, "Encoding error\n");
-                    goto done;
-                }
+    arg->conn = mp_ipc_conn_create(arg, arg->client);
 
-                rc = ipc_write_str(arg, event_msg);
-                talloc_free(event_msg);
-                if (rc < 0) {
-                    MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-            }
-        }
+    fcntl(arg->client_fd, F_SETFL, fcntl(arg->client_fd, F_GETFL, 0) | O_NONBLOCK);
 
-        if (fds[1].revents & (POLLIN | POLLHUP | POLLNVAL)) {
-            while (1) {
-                char buf[128];
-                bstr append = { buf, 0 };
-
-                ssize_t bytes = read(arg->client_fd, buf, sizeof(buf));
-                if (bytes < 0) {
-                    if (errno == EAGAIN)
-                        break;
-
-                    MP_ERR(arg, "Read error (%s)\n", mp_strerror(errno));
-                    goto done;
-                }
-
-                if (bytes == 0) {
-                    MP_VERBOSE(arg, "Client disconnected\n");
-                    goto done;
-                }
-
-                append.len = bytes;
-
-                bstr_xappend(NULL, &client_msg, append);
-
-                while (bstrchr(client_msg, '\n') != -1) {
-                    char *reply_msg = mp_ipc_consume_next_command(arg->client,
-                        NULL, &client_msg);
-
-                    if (reply_msg && arg->writable) {
-                        rc = ipc_write_str(arg, reply_msg);
-                        if (rc < 0) {
-                            MP_ERR(arg, "Write error (%s)\n", mp_strerror(errno));
-                            talloc_free(reply_msg);
-                            goto done;
-                        }
-                    }
-
-                    talloc_free(reply_msg);
-                }
-            }
-        }
-    }
+    // Note that this calls the callback once, so initial events are read.
+    mpv_set_wakeup_callback(arg->client, client_wakeup_cb, arg);
+}
 
-done:
-    if (client_msg.len > 0)
+static void client_destroy(struct client_arg *arg)
+{
+    if (arg->client_msg.len > 0)
         MP_WARN(arg, "Ignoring unterminated command on disconnect.\n");
-    talloc_free(client_msg.start);
     if (arg->close_client_fd)
         close(arg->client_fd);
     struct mpv_handle *h = arg->client;
-    bool quit = arg->quit_on_close;
-    talloc_free(arg);
-    if (quit) {
+    if (arg->quit_on_close) {
         mpv_terminate_destroy(h);
     } else {
         mpv_destroy(h);
     }
-    MP_THREAD_RETURN();
+    talloc_free(arg);
 }
 
 static bool ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client,
-                             bool free_on_init_fail)
-{
-    if (!client->client)
-        client->client = mp_new_client(ctx->client_api, client->client_name);
-    if (!client->client)
-        goto err;
-
-    client->log = mp_client_get_log(client->client);
-
-    mp_thread client_thr;
-    if (mp_thread_create(&client_thr, client_thread, client))
-        goto err;
-    mp_thread_detach(client_thr);
-
-    return true;
-
-err:
-    if (free_on_init_fail) {
-        if (client->client)
-            mpv_destroy(client->client);
-
-        if (client->close_client_fd)
-            close(client->client_fd);
-    }
-
-    talloc_free(client);
-    return false;
-}
+                             bool free_on_init_fail);
 
 static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
 {
@@ -264,52 +289,19 @@ static void ipc_start_client_json(struct mp_ipc_ctx *ctx, int id, int fd)
     ipc_start_client(ctx, client, true);
 }
 
-bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
-                              int out_fd[2])
-{
-    int pair[2];
-    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair))
-        return false;
-    mp_set_cloexec(pair[0]);
-    mp_set_cloexec(pair[1]);
-
-    struct client_arg *client = talloc_ptrtype(NULL, client);
-    *client = (struct client_arg){
-        .client = h,
-        .client_name = mpv_client_name(h),
-        .client_fd   = pair[1],
-        .close_client_fd = true,
-        .writable = true,
-    };
-
-    if (!ipc_start_client(ctx, client, false)) {
-        close(pair[0]);
-        close(pair[1]);
-        return false;
-    }
-
-    out_fd[0] = pair[0];
-    out_fd[1] = -1;
-    return true;
-}
-
-static MP_THREAD_VOID ipc_thread(void *p)
+static int ipc_listen(struct mp_ipc_ctx *arg)
 {
     int rc;
 
     int ipc_fd;
     struct sockaddr_un ipc_un = {0};
 
-    struct mp_ipc_ctx *arg = p;
-
-    mp_thread_set_name("ipc/socket");
-
     MP_VERBOSE(arg, "Starting IPC master\n");
 
     ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (ipc_fd < 0) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     fchmod(ipc_fd, 0600);
@@ -317,7 +309,7 @@ static MP_THREAD_VOID ipc_thread(void *p)
     size_t path_len = strlen(arg->path);
     if (path_len >= sizeof(ipc_un.sun_path) - 1) {
         MP_ERR(arg, "Could not create IPC socket\n");
-        goto done;
+        goto error;
     }
 
     ipc_un.sun_family = AF_UNIX,
@@ -334,52 +326,232 @@ static MP_THREAD_VOID ipc_thread(void *p)
     rc = bind(ipc_fd, (struct sockaddr *) &ipc_un, addr_len);
     if (rc < 0) {
         MP_ERR(arg, "Could not bind IPC socket\n");
-        goto done;
+        goto error;
     }
 
     rc = listen(ipc_fd, 10);
     if (rc < 0) {
         MP_ERR(arg, "Could not listen on IPC socket\n");
-        goto done;
+        goto error;
     }
 
     MP_VERBOSE(arg, "Listening to IPC socket.\n");
+    return ipc_fd;
 
-    int client_num = 0;
+error:
+    if (ipc_fd >= 0)
+        close(ipc_fd);
+    return -1;
+}
 
-    struct pollfd fds[2] = {
-        {.events = POLLIN, .fd = arg->death_pipe[0]},
-        {.events = POLLIN, .fd = ipc_fd},
-    };
+static void ipc_accept(struct mp_ipc_ctx *arg)
+{
+    int client_fd = accept(arg->listen_fd, NULL, NULL);
+    if (client_fd < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED)
+            return;
+        MP_ERR(arg, "Could not accept IPC client\n");
+        close(arg->listen_fd);
+        arg->listen_fd = -1;
+        return;
+    }
+
+    ipc_start_client_json(arg, arg->client_num++, client_fd);
+}
+
+static MP_THREAD_VOID ipc_thread(void *p)
+{
+    // We don't use MSG_NOSIGNAL because the moldy fruit OS doesn't support it.
+    struct sigaction sa = { .sa_handler = SIG_IGN, .sa_flags = SA_RESTART };
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, NULL);
+
+    struct mp_ipc_ctx *arg = p;
+
+    mp_thread_set_name("ipc");
+
+    if (arg->path && arg->path[0])
+        arg->listen_fd = ipc_listen(arg);
 
     while (1) {
-        rc = poll(fds, 2, -1);
-        if (rc < 0) {
-            MP_ERR(arg, "Poll error\n");
-            continue;
+        // Serve everything that is ready before sleeping.
+        for (int n = 0; n < arg->num_active; n++) {
+            struct client_arg *client = arg->clients[n];
+            if (!client_blocked(client) && atomic_exchange(&client->wakeup, false))
+                client_read_events(client);
+        }
+
+        for (int n = arg->num_active - 1; n >= 0; n--) {
+            struct client_arg *client = arg->clients[n];
+            if (!client->dead)
+                continue;
+            MP_TARRAY_REMOVE_AT(arg->clients, arg->num_active, n);
+            client_destroy(client);
+            mp_mutex_lock(&arg->lock);
+            arg->num_clients--;
+            mp_mutex_unlock(&arg->lock);
+        }
+
+        mp_mutex_lock(&arg->lock);
+        int num_new = arg->num_new_clients;
+        for (int n = 0; n < num_new; n++)
+            MP_TARRAY_APPEND(arg, arg->clients, arg->num_active, arg->new_clients[n]);
+        arg->num_new_clients = 0;
+        bool terminate = arg->terminate;
+        bool done = terminate && !arg->num_clients;
+        mp_mutex_unlock(&arg->lock);
+
+        for (int n = arg->num_active - num_new; n < arg->num_active; n++)
+            client_activate(arg->clients[n]);
+
+        if (terminate && arg->listen_fd >= 0) {
+            close(arg->listen_fd);
+            arg->listen_fd = -1;
         }
 
-        if (fds[0].revents & POLLIN)
-            goto done;
+        if (done)
+            break;
+
+        int num_fds = 0;
+        MP_TARRAY_GROW(arg, arg->fds, 2 + arg->num_active);
+        arg->fds[num_fds++] = (struct pollfd){
+            .events = POLLIN, .fd = arg->wakeup_pipe[0],
+        };
+        if (arg->listen_fd >= 0) {
+            arg->fds[num_fds++] = (struct pollfd){
+                .events = POLLIN, .fd = arg->listen_fd,
+            };
+        }
+        int first_client = num_fds;
+        for (int n = 0; n < arg->num_active; n++) {
+            struct client_arg *client = arg->clients[n];
+            short events = (client_can_read(client) ? POLLIN : 0) |
+                           (client_pending_output(client) ? POLLOUT : 0);
+            arg->fds[num_fds++] = (struct pollfd){
+                .events = events,
+                // Hangups are reported even if no events are requested.
+                .fd = client->hangup && !events ? -1 : client->client_fd,
+            };
+        }
 
-        if (fds[1].revents & POLLIN) {
-            int client_fd = accept(ipc_fd, NULL, NULL);
-            if (client_fd < 0) {
-                MP_ERR(arg, "Could not accept IPC client\n");
-                goto done;
-            }
+        if (poll(arg->fds, num_fds, -1) < 0) {
+            if (errno != EINTR)
+                MP_ERR(arg, "Poll error\n");
+            continue;
+        }
 
-            ipc_start_client_json(arg, client_num++, client_fd);
+        if (arg->fds[0].revents & POLLIN)
+            mp_flush_wakeup_pipe(arg->wakeup_pipe[0]);
+
+        if (first_client > 1 && (arg->fds[1].revents & POLLIN))
+            ipc_accept(arg);
+
+        // Accepted clients are only added on the next iteration, so the
+        // indexes match the pollfds.
+        for (int n = 0; n < num_fds - first_client; n++) {
+            struct client_arg *client = arg->clients[n];
+            short revents = arg->fds[first_client + n].revents;
+            if (revents & (POLLHUP | POLLERR))
+                client->hangup = true;
+            if (revents & POLLOUT)
+                client_flush(client);
+            if (revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL))
+                client_read_commands(client);
+            // Output got unblocked.
+            if (!client_blocked(client) && atomic_load(&client->wakeup))
+                ipc_wakeup(arg);
         }
     }
 
-done:
-    if (ipc_fd >= 0)
-        close(ipc_fd);
+    mp_mutex_lock(&arg->lock);
+    bool detached = arg->detached;
+    mp_mutex_unlock(&arg->lock);
+
+    if (detached) {
+        close(arg->wakeup_pipe[0]);
+        close(arg->wakeup_pipe[1]);
+        mp_mutex_destroy(&arg->lock);
+        talloc_free(arg);
+    }
 
     MP_THREAD_RETURN();
 }
 
+// Hand the client to ipc_thread, starting it if needed.
+static bool ipc_start_client(struct mp_ipc_ctx *ctx, struct client_arg *client,
+                             bool free_on_init_fail)
+{
+    client->ctx = ctx;
+
+    if (!client->client)
+        client->client = mp_new_client(ctx->client_api, client->client_name);
+    if (!client->client)
+        goto err;
+
+    client->log = mp_client_get_log(client->client);
+
+    mp_mutex_lock(&ctx->lock);
+    if (!ctx->thread_running && !ctx->terminate) {
+        ctx->thread_running =
+            !mp_thread_create(&ctx->thread, ipc_thread, ctx);
+    }
+    bool ok = ctx->thread_running && !ctx->terminate;
+    if (ok) {
+        MP_TARRAY_APPEND(ctx, ctx->new_clients, ctx->num_new_clients, client);
+        ctx->num_clients++;
+    }
+    mp_mutex_unlock(&ctx->lock);
+    if (!ok)
+        goto err;
+
+    ipc_wakeup(ctx);
+    return true;
+
+err:
+    if (free_on_init_fail) {
+        if (client->client)
+            mpv_destroy(client->client);
+
+        if (client->close_client_fd)
+            close(client->client_fd);
+    }
+
+    talloc_free(client);
+    return false;
+}
+
+bool mp_ipc_start_anon_client(struct mp_ipc_ctx *ctx, struct mpv_handle *h,
+                              int out_fd[2])
+{
+    if (!ctx)
+        return false;
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair))
+        return false;
+    mp_set_cloexec(pair[0]);
+    mp_set_cloexec(pair[1]);
+
+    struct client_arg *client = talloc_ptrtype(NULL, client);
+    *client = (struct client_arg){
+        .client = h,
+        .client_name = mpv_client_name(h),
+        .client_fd   = pair[1],
+        .close_client_fd = true,
+        .writable = true,
+    };
+
+    if (!ipc_start_client(ctx, client, false)) {
+        close(pair[0]);
+        close(pair[1]);
+        return false;
+    }
+
+    out_fd[0] = pair[0];
+    out_fd[1] = -1;
+    return true;
+}
+
 struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
                                struct mpv_global *global)
 {
@@ -390,9 +562,16 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
         .log        = mp_log_new(arg, global->log, "ipc"),
         .client_api = client_api,
         .path       = mp_get_user_path(arg, global, opts->ipc_path),
-        .death_pipe = {-1, -1},
+        .listen_fd  = -1,
     };
 
+    if (mp_make_wakeup_pipe(arg->wakeup_pipe) < 0) {
+        talloc_free(opts);
+        talloc_free(arg);
+        return NULL;
+    }
+    mp_mutex_init(&arg->lock);
+
     if (opts->ipc_client && opts->ipc_client[0]) {
         int fd = -1;
         bstr str = bstr0(opts->ipc_client);
@@ -410,24 +589,15 @@ struct mp_ipc_ctx *mp_init_ipc(struct mp_client_api *client_api,
 
     talloc_free(opts);
 
-    if (!arg->path || !arg->path[0])
-        goto out;
-
-    if (mp_make_wakeup_pipe(arg->death_pipe) < 0)
-        goto out;
-
-    if (mp_thread_create(&arg->thread, ipc_thread, arg))
-        goto out;
+    // The thread is otherwise started by the first client.
+    if (arg->path && arg->path[0]) {
+        mp_mutex_lock(&arg->lock);
+        if (!arg->thread_running)
+            arg->thread_running = !mp_thread_create(&arg->thread, ipc_thread, arg);
+        mp_mutex_unlock(&arg->lock);
+    }
 
     return arg;
-
-out:
-    if (arg->death_pipe[0] >= 0) {
-        close(arg->death_pipe[0]);
-        close(arg->death_pipe[1]);
-    }
-    talloc_free(arg);
-    return NULL;
 }
 
 void mp_uninit_ipc(struct mp_ipc_ctx *arg)
@@ -435,10 +605,31 @@ void mp_uninit_ipc(struct mp_ipc_ctx *arg)
     if (!arg)
         return;
 
-    (void)write(arg->death_pipe[1], &(char){0}, 1);
-    mp_thread_join(arg->thread);
+    // Connected clients are still served until they disconnect. If there are
+    // any, the thread is left running and frees arg on exit.
+    mp_mutex_lock(&arg->lock);
+    arg->terminate = true;
+    bool running = arg->thread_running;
+    mp_thread thread = arg->thread;
+    arg->detached = running && arg->num_clients > 0;
+    bool detached = arg->detached;
+    // With the lock held, the thread can't exit and free arg yet.
+    if (running)
+        ipc_wakeup(arg);
+    mp_mutex_unlock(&arg->lock);
+
+    if (!running)
+        goto done;
 
-    close(arg->death_pipe[0]);
-    close(arg->death_pipe[1]);
+    if (detached) {
+        mp_thread_detach(thread);
+        return;
+    }
+    mp_thread_join(thread);
+
+done:
+    close(arg->wakeup_pipe[0]);
+    close(arg->wakeup_pipe[1]);
+    mp_mutex_destroy(&arg->lock);
     talloc_free(arg);
 }
@@ -18,6 +18,7 @@
 #include "common/msg.h"
 #include "input/input.h"
 #include "misc/json.h"
+#include "misc/msgpack.h"
 #include "misc/node.h"
 #include "options/m_option.h"
 #include "options/options.h"
@@ -87,19 +88,126 @@ static void mpv_format_command_reply(void *ta_parent, mpv_event *event,
     mpv_node_map_add(ta_parent, dst, "data", &cmd->result);
 }
 
-char *mp_json_encode_event(mpv_event *event)
+static void event_to_node(void *ta_parent, mpv_event *event, mpv_node *dst)
 {
-    void *ta_parent = talloc_new(NULL);
-
-    struct mpv_node event_node;
     if (event->event_id == MPV_EVENT_COMMAND_REPLY) {
-        event_node = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
-        mpv_format_command_reply(ta_parent, event, &event_node);
+        *dst = (mpv_node){.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+        mpv_format_command_reply(ta_parent, event, dst);
     } else {
-        mpv_event_to_node(&event_node, event);
+        mpv_event_to_node(dst, event);
         // Abuse mpv_event_to_node() internals.
-        talloc_steal(ta_parent, node_get_alloc(&event_node));
+        talloc_steal(ta_parent, node_get_alloc(dst));
+    }
+}
+
+// Requests that could block are started with the asynchronous client API
+// functions. For clients that did not ask for an async request, the usual reply
+// is sent once the reply event arrives, and further messages are not executed
+// until then.
+enum deferred_reply {
+    REPLY_DATA,                 // normal reply with the event's data
+    REPLY_STRING,               // get_property_string reply
+    REPLY_NONE,                 // text command, no reply
+};
+
+// Async request by the client, started with an internal reply_userdata.
+struct async_request {
+    uint64_t id;
+    int64_t request_id;
+};
+
+struct mp_ipc_conn {
+    struct mpv_handle *client;
+    enum mp_ipc_framing framing;
+    uint64_t next_id;           // reply_userdata for the next request
+
+    // Deferred reply of the blocking request in progress (if sync_id != 0).
+    uint64_t sync_id;
+    enum deferred_reply sync_reply;
+    mpv_node sync_reqid;        // MPV_FORMAT_NONE if there was no request_id
+    void *sync_ta;              // allocations for sync_reqid
+
+    struct async_request *async;
+    int num_async;
+};
+
+struct mp_ipc_conn *mp_ipc_conn_create(void *ta_parent, struct mpv_handle *client)
+{
+    struct mp_ipc_conn *conn = talloc_ptrtype(ta_parent, conn);
+    *conn = (struct mp_ipc_conn){
+        .client = client,
+        .next_id = 1,
+    };
+    return conn;
+}
+
+bool mp_ipc_conn_busy(struct mp_ipc_conn *conn)
+{
+    return conn->sync_id;
+}
+
+// Call after starting a request with reply_userdata set to conn->next_id, with
+// rc being the return value of the API call. Returns whether the request was
+// started (and the reply is deferred).
+static bool defer_reply(struct mp_ipc_conn *conn, int rc, mpv_node *reqid_node,
+                        enum deferred_reply type)
+{
+    if (rc < 0)
+        return false;
+
+    conn->sync_id = conn->next_id++;
+    conn->sync_reply = type;
+    talloc_free(conn->sync_ta);
+    conn->sync_ta = talloc_new(conn);
+    conn->sync_reqid = (mpv_node){.format = MPV_FORMAT_NONE};
+    if (reqid_node) {
+        static const struct m_option type = { .type = CONF_TYPE_NODE };
+        m_option_get_node(&type, conn->sync_ta, &conn->sync_reqid, reqid_node);
+    }
+    return true;
+}
+
+// reply_userdata to use for an async request by the client.
+static uint64_t async_id(struct mp_ipc_conn *conn, int64_t reqid)
+{
+    return conn ? conn->next_id : reqid;
+}
+
+// Call after the async request by the client was started successfully.
+static void async_started(struct mp_ipc_conn *conn, int64_t reqid)
+{
+    if (!conn)
+        return;
+    struct async_request req = {conn->next_id++, reqid};
+    MP_TARRAY_APPEND(conn, conn->async, conn->num_async, req);
+}
+
+// Append a complete message with the given framing to *out.
+static void write_message(void *ta_parent, bstr *out, mpv_node *node,
+                          enum mp_ipc_framing framing)
+{
+    if (framing == MP_IPC_FRAMING_MSGPACK) {
+        size_t start = out->len;
+        bstr_xappend(ta_parent, out, (bstr){(unsigned char[4]){0}, 4});
+        msgpack_write(ta_parent, out, node);
+        uint32_t size = out->len - start - 4;
+        for (int n = 0; n < 4; n++)
+            out->start[start + n] = size >> (8 * (3 - n));
+    } else {
+        char *output = talloc_strdup(NULL, "");
+        json_write(&output, node);
+        bstr_xappend(ta_parent, out, bstr0(output));
+        bstr_xappend(ta_parent, out, bstr0("\n"));
+        talloc_free(output);
     }
+}
+
+char *mp_json_encode_event(mpv_event *event)
+{
+    void *ta_parent = talloc_new(NULL);
+
+    struct mpv_node event_node;
+    event_to_node(ta_parent, event, &event_node);
 
     char *output = talloc_strdup(NULL, "");
     json_write(&output, &event_node);
@@ -110,29 +218,101 @@ char *mp_json_encode_event(mpv_event *event)
     return output;
 }
 
-// Function is allowed to modify src[n].
-static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
-                                  char *src)
+// Write the reply of the blocking request, which finished with the event.
+static void write_deferred_reply(struct mp_ipc_conn *conn, void *ta_parent,
+                                 bstr *out, struct mpv_event *event)
+{
+    void *tmp = talloc_new(NULL);
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    int rc = event->error;
+
+    if (event->event_id == MPV_EVENT_GET_PROPERTY_REPLY) {
+        mpv_event_property *prop = event->data;
+        if (conn->sync_reply == REPLY_STRING) {
+            if (rc >= 0 && prop->format == MPV_FORMAT_STRING) {
+                mpv_node_map_add_string(tmp, &reply_node, "data",
+                                        *(char **)prop->data);
+            } else {
+                mpv_node_map_add_null(tmp, &reply_node, "data");
+            }
+            rc = MPV_ERROR_SUCCESS;
+        } else if (rc >= 0) {
+            mpv_node_map_add(tmp, &reply_node, "data", prop->data);
+        }
+    } else if (event->event_id == MPV_EVENT_COMMAND_REPLY) {
+        mpv_event_command *cmd = event->data;
+        if (rc >= 0)
+            mpv_node_map_add(tmp, &reply_node, "data", &cmd->result);
+    }
+
+    if (conn->sync_reqid.format != MPV_FORMAT_NONE) {
+        mpv_node_map_add(tmp, &reply_node, "request_id", &conn->sync_reqid);
+    } else {
+        mpv_node_map_add_int64(tmp, &reply_node, "request_id", 0);
+    }
+
+    mpv_node_map_add_string(tmp, &reply_node, "error", mpv_error_string(rc));
+
+    if (conn->sync_reply != REPLY_NONE)
+        write_message(ta_parent, out, &reply_node, conn->framing);
+
+    conn->sync_id = 0;
+    TA_FREEP(&conn->sync_ta);
+    talloc_free(tmp);
+}
+
+void mp_ipc_encode_event(struct mp_ipc_conn *conn, void *ta_parent, bstr *out,
+                         struct mpv_event *event)
+{
+    struct mpv_event ev = *event;
+
+    if (ev.event_id == MPV_EVENT_GET_PROPERTY_REPLY ||
+        ev.event_id == MPV_EVENT_SET_PROPERTY_REPLY ||
+        ev.event_id == MPV_EVENT_COMMAND_REPLY)
+    {
+        if (conn->sync_id && ev.reply_userdata == conn->sync_id) {
+            write_deferred_reply(conn, ta_parent, out, &ev);
+            return;
+        }
+        for (int n = 0; n < conn->num_async; n++) {
+            if (conn->async[n].id == ev.reply_userdata) {
+                ev.reply_userdata = conn->async[n].request_id;
+                MP_TARRAY_REMOVE_AT(conn->async, conn->num_async, n);
+                break;
+            }
+        }
+    }
+
+    void *tmp = talloc_new(NULL);
+
+    struct mpv_node event_node;
+    event_to_node(tmp, &ev, &event_node);
+    write_message(ta_parent, out, &event_node, conn->framing);
+
+    talloc_free(tmp);
+}
+
+// Execute the parsed message (NULL if it could not be parsed), and write the
+// reply to *reply_node. Returns false if no reply is to be sent now.
+// If framing is not NULL, the command can change it for the next message.
+// If conn is not NULL, requests that could block are started asynchronously,
+// and their reply is deferred until the reply event arrives.
+static bool execute_command(struct mpv_handle *client, void *ta_parent,
+                            mpv_node *msg, mpv_node *reply_node,
+                            enum mp_ipc_framing *framing,
+                            struct mp_ipc_conn *conn)
 {
     int rc;
     const char *cmd = NULL;
     struct mp_log *log = mp_client_get_log(client);
 
-    mpv_node msg_node;
-    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    mpv_node msg_node = msg ? *msg : (mpv_node){0};
     mpv_node *reqid_node = NULL;
     int64_t reqid = 0;
     mpv_node *async_node = NULL;
     bool async = false;
     bool send_reply = true;
 
-    rc = json_parse(ta_parent, &msg_node, &src, MAX_JSON_DEPTH);
-    if (rc < 0) {
-        mp_err(log, "malformed JSON received: '%s'\n", src);
-        rc = MPV_ERROR_INVALID_PARAMETER;
-        goto error;
-    }
-
     if (msg_node.format != MPV_FORMAT_NODE_MAP) {
         rc = MPV_ERROR_INVALID_PARAMETER;
         goto error;
@@ -177,17 +357,40 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         cmd = cmd_str_node->u.string;
     }
 
-    if (cmd && !strcmp("client_name", cmd)) {
+    if (cmd && !strcmp("set_protocol", cmd)) {
+        if (cmd_node->u.list->num != 2 ||
+            cmd_node->u.list->values[1].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        // Only available if the transport handles framing changes.
+        if (!framing) {
+            rc = MPV_ERROR_NOT_IMPLEMENTED;
+            goto error;
+        }
+
+        const char *name = cmd_node->u.list->values[1].u.string;
+        if (!strcmp(name, "json")) {
+            *framing = MP_IPC_FRAMING_JSON;
+        } else if (!strcmp(name, "msgpack")) {
+            *framing = MP_IPC_FRAMING_MSGPACK;
+        } else {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+        rc = MPV_ERROR_SUCCESS;
+    } else if (cmd && !strcmp("client_name", cmd)) {
         const char *client_name = mpv_client_name(client);
-        mpv_node_map_add_string(ta_parent, &reply_node, "data", client_name);
+        mpv_node_map_add_string(ta_parent, reply_node, "data", client_name);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_time_us", cmd)) {
         int64_t time_us = mpv_get_time_us(client);
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", time_us);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", time_us);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_version", cmd)) {
         int64_t ver = mpv_client_api_version();
-        mpv_node_map_add_int64(ta_parent, &reply_node, "data", ver);
+        mpv_node_map_add_int64(ta_parent, reply_node, "data", ver);
         rc = MPV_ERROR_SUCCESS;
     } else if (cmd && !strcmp("get_property", cmd)) {
         mpv_node result_node;
@@ -202,11 +405,17 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        rc = mpv_get_property(client, cmd_node->u.list->values[1].u.string,
-                              MPV_FORMAT_NODE, &result_node);
-        if (rc >= 0) {
-            mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
-            mpv_free_node_contents(&result_node);
+        const char *name = cmd_node->u.list->values[1].u.string;
+        if (conn) {
+            rc = mpv_get_property_async(client, conn->next_id, name,
+                                        MPV_FORMAT_NODE);
+            send_reply = !defer_reply(conn, rc, reqid_node, REPLY_DATA);
+        } else {
+            rc = mpv_get_property(client, name, MPV_FORMAT_NODE, &result_node);
+            if (rc >= 0) {
+                mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
+                mpv_free_node_contents(&result_node);
+            }
         }
     } else if (cmd && !strcmp("get_property_string", cmd)) {
         if (cmd_node->u.list->num != 2) {
@@ -219,13 +428,58 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        char *result = mpv_get_property_string(client,
-                                        cmd_node->u.list->values[1].u.string);
-        if (result) {
-            mpv_node_map_add_string(ta_parent, &reply_node, "data", result);
-            mpv_free(result);
+        const char *name = cmd_node->u.list->values[1].u.string;
+        if (conn) {
+            rc = mpv_get_property_async(client, conn->next_id, name,
+                                        MPV_FORMAT_STRING);
+            send_reply = !defer_reply(conn, rc, reqid_node, REPLY_STRING);
         } else {
-            mpv_node_map_add_null(ta_parent, &reply_node, "data");
+            char *result = mpv_get_property_string(client, name);
+            if (result) {
+                mpv_node_map_add_string(ta_parent, reply_node, "data", result);
+                mpv_free(result);
+            } else {
+                mpv_node_map_add_null(ta_parent, reply_node, "data");
+            }
+        }
+    } else if (cmd && (!strcmp("get_properties", cmd) ||
+                       !strcmp("command_list", cmd)))
+    {
+        bool get = !strcmp("get_properties", cmd);
+        int num = cmd_node->u.list->num - 1;
+        mpv_node *args = &cmd_node->u.list->values[1];
+        const char **names = talloc_zero_array(ta_parent, const char *, num + 1);
+        mpv_node cmds = {
+            .format = MPV_FORMAT_NODE_ARRAY,
+            .u.list = &(mpv_node_list){.num = num, .values = args},
+        };
+
+        for (int n = 0; get && n < num; n++) {
+            if (args[n].format != MPV_FORMAT_STRING) {
+                rc = MPV_ERROR_INVALID_PARAMETER;
+                goto error;
+            }
+            names[n] = args[n].u.string;
+        }
+
+        if (async || conn) {
+            uint64_t id = async ? async_id(conn, reqid) : conn->next_id;
+            rc = get ? mpv_get_property_list_async(client, id, names)
+                     : mpv_command_list_async(client, id, &cmds);
+            if (!async) {
+                send_reply = !defer_reply(conn, rc, reqid_node, REPLY_DATA);
+            } else if (rc >= 0) {
+                async_started(conn, reqid);
+                send_reply = false;
+            }
+        } else {
+            mpv_node result_node = {0};
+            rc = get ? mpv_get_property_list(client, names, &result_node)
+                     : mpv_command_list(client, &cmds, &result_node);
+            if (rc >= 0) {
+                mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
+                mpv_free_node_contents(&result_node);
+            }
         }
     } else if (cmd && (!strcmp("set_property", cmd) ||
                        !strcmp("set_property_string", cmd)))
@@ -240,8 +494,15 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
             goto error;
         }
 
-        rc = mpv_set_property(client, cmd_node->u.list->values[1].u.string,
-                              MPV_FORMAT_NODE, &cmd_node->u.list->values[2]);
+        const char *name = cmd_node->u.list->values[1].u.string;
+        mpv_node *value = &cmd_node->u.list->values[2];
+        if (conn) {
+            rc = mpv_set_property_async(client, conn->next_id, name,
+                                        MPV_FORMAT_NODE, value);
+            send_reply = !defer_reply(conn, rc, reqid_node, REPLY_DATA);
+        } else {
+            rc = mpv_set_property(client, name, MPV_FORMAT_NODE, value);
+        }
     } else if (cmd && !strcmp("observe_property", cmd)) {
         if (cmd_node->u.list->num != 3) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -282,6 +543,25 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
                                   cmd_node->u.list->values[1].u.int64,
                                   cmd_node->u.list->values[2].u.string,
                                   MPV_FORMAT_STRING);
+    } else if (cmd && !strcmp("observe_property_delta", cmd)) {
+        if (cmd_node->u.list->num != 3) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[1].format != MPV_FORMAT_INT64) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        if (cmd_node->u.list->values[2].format != MPV_FORMAT_STRING) {
+            rc = MPV_ERROR_INVALID_PARAMETER;
+            goto error;
+        }
+
+        rc = mpv_observe_property_delta(client,
+                                        cmd_node->u.list->values[1].u.int64,
+                                        cmd_node->u.list->values[2].u.string);
     } else if (cmd && !strcmp("unobserve_property", cmd)) {
         if (cmd_node->u.list->num != 2) {
             rc = MPV_ERROR_INVALID_PARAMETER;
@@ -345,13 +625,18 @@ static char *json_execute_command(struct mpv_handle *client, void *ta_parent,
         mpv_node result_node = {0};
 
         if (async) {
-            rc = mpv_command_node_async(client, reqid, cmd_node);
-            if (rc >= 0)
+            rc = mpv_command_node_async(client, async_id(conn, reqid), cmd_node);
+            if (rc >= 0) {
+                async_started(conn, reqid);
                 send_reply = false;
+            }
+        } else if (conn) {
+            rc = mpv_command_node_async(client, conn->next_id, cmd_node);
+            send_reply = !defer_reply(conn, rc, reqid_node, REPLY_DATA);
         } else {
             rc = mpv_command_node(client, cmd_node, &result_node);
             if (rc >= 0)
-                mpv_node_map_add(ta_parent, &reply_node, "data", &result_node);
+                mpv_node_map_add(ta_parent, reply_node, "data", &result_node);
         }
 
         mpv_free_node_contents(&result_node);
@@ -363,26 +648,40 @@ error:
      * the original requests.
      */
     if (reqid_node) {
-        mpv_node_map_add(ta_parent, &reply_node, "request_id", reqid_node);
+        mpv_node_map_add(ta_parent, reply_node, "request_id", reqid_node);
     } else {
-        mpv_node_map_add_int64(ta_parent, &reply_node, "request_id", 0);
+        mpv_node_map_add_int64(ta_parent, reply_node, "request_id", 0);
     }
 
-    mpv_node_map_add_string(ta_parent, &reply_node, "error", mpv_error_string(rc));
+    mpv_node_map_add_string(ta_parent, reply_node, "error", mpv_error_string(rc));
 
-    char *output = talloc_strdup(ta_parent, "");
+    return send_reply;
+}
 
-    if (send_reply) {
-        json_write(&output, &reply_node);
-        output = ta_talloc_strdup_append(output, "\n");
+// Function is allowed to modify src[n].
+static bool json_execute_command(struct mpv_handle *client, void *ta_parent,
+                                 char *src, mpv_node *reply_node,
+                                 enum mp_ipc_framing *framing,
+                                 struct mp_ipc_conn *conn)
+{
+    mpv_node msg_node;
+    if (json_parse(ta_parent, &msg_node, &src, MAX_JSON_DEPTH) < 0) {
+        mp_err(mp_client_get_log(client), "malformed JSON received: '%s'\n", src);
+        return execute_command(client, ta_parent, NULL, reply_node, framing, conn);
     }
-
-    return output;
+    return execute_command(client, ta_parent, &msg_node, reply_node, framing,
+                           conn);
 }
 
-static char *text_execute_command(struct mpv_handle *client, void *tmp, char *src)
+static char *text_execute_command(struct mpv_handle *client,
+                                  struct mp_ipc_conn *conn, char *src)
 {
-    mpv_command_string(client, src);
+    if (conn) {
+        int rc = mp_client_command_string_async(client, conn->next_id, src);
+        defer_reply(conn, rc, NULL, REPLY_NONE);
+    } else {
+        mpv_command_string(client, src);
+    }
 
     return NULL;
 }
@@ -403,12 +702,80 @@ char *mp_ipc_consume_next_command(struct mpv_handle *client, void *ctx, bstr *bu
     if (line0[0] == '\0' || line0[0] == '#') {
         // skip
     } else if (line0[0] == '{') {
-        reply_msg = json_execute_command(client, tmp, line0);
+        mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+        reply_msg = talloc_strdup(tmp, "");
+        if (json_execute_command(client, tmp, line0, &reply_node, NULL, NULL)) {
+            json_write(&reply_msg, &reply_node);
+            reply_msg = ta_talloc_strdup_append(reply_msg, "\n");
+        }
     } else {
-        reply_msg = text_execute_command(client, tmp, line0);
+        reply_msg = text_execute_command(client, NULL, line0);
     }
 
     talloc_steal(ctx, reply_msg);
     talloc_free(tmp);
     return reply_msg;
 }
+
+bool mp_ipc_consume_next_message(struct mp_ipc_conn *conn, void *ta_parent,
+                                 bstr *out, bstr *buf)
+{
+    // Keep the order of requests by waiting for the previous one.
+    if (conn->sync_id)
+        return false;
+
+    struct mpv_handle *client = conn->client;
+    void *tmp = talloc_new(NULL);
+    mpv_node reply_node = {.format = MPV_FORMAT_NODE_MAP, .u.list = NULL};
+    enum mp_ipc_framing next_framing = conn->framing;
+    bool send_reply = false;
+
+    if (conn->framing == MP_IPC_FRAMING_MSGPACK) {
+        if (buf->len < 4)
+            goto incomplete;
+        uint32_t size = 0;
+        for (int n = 0; n < 4; n++)
+            size = (size << 8) | buf->start[n];
+        if (buf->len - 4 < size)
+            goto incomplete;
+        bstr frame = {buf->start + 4, size};
+        *buf = bstr_cut(*buf, 4 + (size_t)size);
+
+        mpv_node msg_node;
+        mpv_node *msg = &msg_node;
+        if (msgpack_parse(tmp, msg, &frame, MAX_MSGPACK_DEPTH) < 0 || frame.len) {
+            mp_err(mp_client_get_log(client), "malformed MessagePack received\n");
+            msg = NULL;
+        }
+        send_reply = execute_command(client, tmp, msg, &reply_node,
+                                     &next_framing, conn);
+    } else {
+        int end = bstrchr(*buf, '\n');
+        if (end < 0)
+            goto incomplete;
+        char *line0 = bstrto0(tmp, bstr_splice(*buf, 0, end));
+        *buf = bstr_cut(*buf, end + 1);
+
+        json_skip_whitespace(&line0);
+
+        if (line0[0] == '\0' || line0[0] == '#') {
+            // skip
+        } else if (line0[0] == '{') {
+            send_reply = json_execute_command(client, tmp, line0, &reply_node,
+                                              &next_framing, conn);
+        } else {
+            text_execute_command(client, conn, line0);
+        }
+    }
+
+    // The reply to a framing change still uses the old framing.
+    if (send_reply)
+        write_message(ta_parent, out, &reply_node, conn->framing);
+    conn->framing = next_framing;
+    talloc_free(tmp);
+    return true;
+
+incomplete:
+    talloc_free(tmp);
+    return false;
+}
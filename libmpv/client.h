@@ -248,7 +248,7 @@ extern "C" {
  * relational operators (<, >, <=, >=).
  */
 #define MPV_MAKE_VERSION(major, minor) (((major) << 16) | (minor) | 0UL)
-#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(2, 3)
+#define MPV_CLIENT_API_VERSION MPV_MAKE_VERSION(2, 6)
 
 /**
  * The API user is allowed to "#define MPV_ENABLE_DEPRECATED 0" before
@@ -1008,6 +1008,44 @@ MPV_EXPORT int mpv_command_async(mpv_handle *ctx, uint64_t reply_userdata,
 MPV_EXPORT int mpv_command_node_async(mpv_handle *ctx, uint64_t reply_userdata,
                                       mpv_node *args);
 
+/**
+ * Run a list of commands. This is like calling mpv_command_node() for each
+ * command, except that all commands are started in order while the player
+ * is locked only once, which is much cheaper when running many commands.
+ *
+ * Commands which complete asynchronously (like with mpv_command_node()) may
+ * still be running when the next command in the list starts. This function
+ * returns once all commands have completed.
+ *
+ * The result is a MPV_FORMAT_NODE_ARRAY with one MPV_FORMAT_NODE_MAP per
+ * command, with the fields "error" (MPV_FORMAT_STRING, as returned by
+ * mpv_error_string()) and, on success, "data" (the command result).
+ *
+ * @param cmds MPV_FORMAT_NODE_ARRAY of commands, each as the args parameter
+ *             in mpv_command_node()
+ * @param result Optional, receives the result. Must be freed with
+ *               mpv_free_node_contents().
+ * @return error code if the list itself is invalid; errors of the individual
+ *         commands are only returned in result
+ */
+MPV_EXPORT int mpv_command_list(mpv_handle *ctx, mpv_node *cmds, mpv_node *result);
+
+/**
+ * Same as mpv_command_list(), but run asynchronously. Once all commands have
+ * completed, a MPV_EVENT_COMMAND_REPLY is sent, with the result array (as
+ * described in mpv_command_list()) in mpv_event_command.result.
+ *
+ * Cancellation with mpv_abort_async_command() applies to all commands of the
+ * list.
+ *
+ * @param reply_userdata the value mpv_event.reply_userdata of the reply will
+ *                       be set to
+ * @param cmds as in mpv_command_list()
+ * @return error code (if queuing the request fails)
+ */
+MPV_EXPORT int mpv_command_list_async(mpv_handle *ctx, uint64_t reply_userdata,
+                                      mpv_node *cmds);
+
 /**
  * Signal to all async requests with the matching ID to abort. This affects
  * the following API calls:
@@ -1169,6 +1207,39 @@ MPV_EXPORT char *mpv_get_property_osd_string(mpv_handle *ctx, const char *name);
 MPV_EXPORT int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
                                       const char *name, mpv_format format);
 
+/**
+ * Read the values of a list of properties, while the player is locked only
+ * once. This is much cheaper than calling mpv_get_property() for each of
+ * them, e.g. when refreshing a UI.
+ *
+ * The result is a MPV_FORMAT_NODE_ARRAY with one MPV_FORMAT_NODE_MAP per
+ * property, with the fields "error" (MPV_FORMAT_STRING, as returned by
+ * mpv_error_string()) and, on success, "data" (the value, as with
+ * MPV_FORMAT_NODE).
+ *
+ * @param names NULL-terminated list of property names
+ * @param result Receives the result. Must be freed with
+ *               mpv_free_node_contents().
+ * @return error code if the request itself is invalid; errors of the
+ *         individual properties are only returned in result
+ */
+MPV_EXPORT int mpv_get_property_list(mpv_handle *ctx, const char **names,
+                                     mpv_node *result);
+
+/**
+ * Same as mpv_get_property_list(), but run asynchronously. The result is
+ * sent as MPV_EVENT_COMMAND_REPLY, with the result array in
+ * mpv_event_command.result.
+ *
+ * @param reply_userdata the value mpv_event.reply_userdata of the reply will
+ *                       be set to
+ * @param names NULL-terminated list of property names
+ * @return error code if sending the request failed
+ */
+MPV_EXPORT int mpv_get_property_list_async(mpv_handle *ctx,
+                                           uint64_t reply_userdata,
+                                           const char **names);
+
 /**
  * Get a notification whenever the given property changes. You will receive
  * updates as MPV_EVENT_PROPERTY_CHANGE. Note that this is not very precise:
@@ -1227,6 +1298,38 @@ MPV_EXPORT int mpv_get_property_async(mpv_handle *ctx, uint64_t reply_userdata,
 MPV_EXPORT int mpv_observe_property(mpv_handle *mpv, uint64_t reply_userdata,
                                     const char *name, mpv_format format);
 
+/**
+ * Like mpv_observe_property() with MPV_FORMAT_NODE, but for list properties
+ * the change events contain only what changed since the previous event,
+ * instead of the full value. This makes tracking very large lists cheap.
+ *
+ * Supported properties are "playlist", "track-list" and "chapter-list".
+ *
+ * The event data is a MPV_FORMAT_NODE_MAP with the following fields:
+ *  "ops":   MPV_FORMAT_NODE_ARRAY of operations, to be applied in order.
+ *           Each is a MPV_FORMAT_NODE_MAP, with the type in the "op" field:
+ *            "reset":  replace the whole list with the "entries" array
+ *            "insert": insert the "entries" array before the entry at "index"
+ *            "remove": remove "count" entries, starting at "index"
+ *            "move":   move the entry at "from" so that it ends up at "to"
+ *            "update": replace the entry at "index" with "entry"
+ *           Entries have the same format as in the full property value.
+ *  "count": MPV_FORMAT_INT64, number of entries after applying the ops.
+ *
+ * The first event always starts with a "reset". The player may send a
+ * "reset" at any time, for example if the client fell too far behind.
+ *
+ * The changes are computed once in the player, no matter how many clients
+ * observe the property. Use mpv_unobserve_property() to stop observing.
+ *
+ * @param name The property name.
+ * @return error code (MPV_ERROR_NOT_IMPLEMENTED if the property does not
+ *         support delta observation)
+ */
+MPV_EXPORT int mpv_observe_property_delta(mpv_handle *mpv,
+                                          uint64_t reply_userdata,
+                                          const char *name);
+
 /**
  * Undo mpv_observe_property(). This will remove all observed properties for
  * which the given number was passed as reply_userdata to mpv_observe_property.
@@ -1978,6 +2081,10 @@ MPV_DEFINE_SYM_PTR(mpv_command_async)
 #define mpv_command_async pfn_mpv_command_async
 MPV_DEFINE_SYM_PTR(mpv_command_node_async)
 #define mpv_command_node_async pfn_mpv_command_node_async
+MPV_DEFINE_SYM_PTR(mpv_command_list)
+#define mpv_command_list pfn_mpv_command_list
+MPV_DEFINE_SYM_PTR(mpv_command_list_async)
+#define mpv_command_list_async pfn_mpv_command_list_async
 MPV_DEFINE_SYM_PTR(mpv_abort_async_command)
 #define mpv_abort_async_command pfn_mpv_abort_async_command
 MPV_DEFINE_SYM_PTR(mpv_set_property)
@@ -1996,8 +2103,14 @@ MPV_DEFINE_SYM_PTR(mpv_get_property_osd_string)
 #define mpv_get_property_osd_string pfn_mpv_get_property_osd_string
 MPV_DEFINE_SYM_PTR(mpv_get_property_async)
 #define mpv_get_property_async pfn_mpv_get_property_async
+MPV_DEFINE_SYM_PTR(mpv_get_property_list)
+#define mpv_get_property_list pfn_mpv_get_property_list
+MPV_DEFINE_SYM_PTR(mpv_get_property_list_async)
+#define mpv_get_property_list_async pfn_mpv_get_property_list_async
 MPV_DEFINE_SYM_PTR(mpv_observe_property)
 #define mpv_observe_property pfn_mpv_observe_property
+MPV_DEFINE_SYM_PTR(mpv_observe_property_delta)
+#define mpv_observe_property_delta pfn_mpv_observe_property_delta
 MPV_DEFINE_SYM_PTR(mpv_unobserve_property)
 #define mpv_unobserve_property pfn_mpv_unobserve_property
 MPV_DEFINE_SYM_PTR(mpv_event_name)
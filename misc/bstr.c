@@ -348,6 +348,14 @@ struct bstr bstr_sanitize_utf8_latin1(void *talloc_ctx, struct bstr s)
     return new;
 }
 
+uint32_t bstr_hash(struct bstr str)
+{
+    uint32_t h = 2166136261u;
+    for (size_t n = 0; n < str.len; n++)
+        h = (h ^ str.start[n]) * 16777619u;
+    return h;
+}
+
 static void resize_append(void *talloc_ctx, bstr *s, size_t append_min)
 {
     size_t size = talloc_get_size(s->start);
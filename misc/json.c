@@ -103,13 +103,15 @@ static int read_str(void *ta_parent, struct mpv_node *dst, char **src)
     char *str = *src;
     char *cur = str;
     bool has_escapes = false;
-    while (cur[0] && cur[0] != '"') {
-        if (cur[0] == '\\') {
-            has_escapes = true;
-            // skip >\"< and >\\< (latter to handle >\\"< correctly)
-            if (cur[1] == '"' || cur[1] == '\\')
-                cur++;
-        }
+    while (1) {
+        // strcspn() is vectorized in the common libcs; it also stops at '\0'.
+        cur += strcspn(cur, "\"\\");
+        if (cur[0] != '\\')
+            break;
+        has_escapes = true;
+        // skip >\"< and >\\< (latter to handle >\\"< correctly)
+        if (cur[1] == '"' || cur[1] == '\\')
+            cur++;
         cur++;
     }
     if (cur[0] != '"')
@@ -253,16 +255,43 @@ static const char special_escape[] = {
     ['\t'] = 't',
 };
 
+static bool needs_escape(unsigned char c)
+{
+    return c < 32 || c == '"' || c == '\\';
+}
+
+// Return the number of bytes at the start of str that can be written as they
+// are. This tests 8 bytes at a time, using the usual "has zero byte" and "has
+// byte less than n" bit tricks.
+static size_t plain_span(const unsigned char *str, size_t len)
+{
+    const uint64_t ones = UINT64_C(0x0101010101010101);
+    const uint64_t high = ones * 0x80;
+    size_t n = 0;
+    for (; len - n >= 8; n += 8) {
+        uint64_t w;
+        memcpy(&w, str + n, 8);
+        uint64_t quote = w ^ (ones * '"');
+        uint64_t bslash = w ^ (ones * '\\');
+        if ((((w - ones * 32) & ~w) | ((quote - ones) & ~quote) |
+             ((bslash - ones) & ~bslash)) & high)
+            break;
+    }
+    while (n < len && !needs_escape(str[n]))
+        n++;
+    return n;
+}
+
 static void write_json_str(bstr *b, unsigned char *str)
 {
     assert(str);
 
+    size_t len = strlen(str);
     APPEND(b, "\"");
     while (1) {
-        unsigned char *cur = str;
-        while (cur[0] >= 32 && cur[0] != '"' && cur[0] != '\\')
-            cur++;
-        if (!cur[0])
+        size_t plain = plain_span(str, len);
+        unsigned char *cur = str + plain;
+        if (plain == len)
             break;
         bstr_xappend(NULL, b, (bstr){str, cur - str});
         if (cur[0] == '\"') {
@@ -274,9 +303,10 @@ static void write_json_str(bstr *b, unsigned char *str)
         } else {
             bstr_xappend_asprintf(NULL, b, "\\u%04x", (unsigned char)cur[0]);
         }
+        len -= plain + 1;
         str = cur + 1;
     }
-    APPEND(b, str);
+    bstr_xappend(NULL, b, (bstr){str, len});
     APPEND(b, "\"");
 }
 
@@ -0,0 +1,314 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* MessagePack (https://msgpack.org/) conversion for mpv_node, as a compact
+ * alternative to JSON:
+ *  - nil, bool, int, float 64, str, bin, array and map map to the obvious
+ *    mpv_node types (bin is MPV_FORMAT_BYTE_ARRAY)
+ *  - float 32 is read as double, and uint 64 values above INT64_MAX are
+ *    rejected
+ *  - map keys must be strings, and strings must not contain '\0'
+ *  - ext types (including timestamps) are not supported
+ * Integers are always written in the shortest form.
+ */
+
+#include <string.h>
+
+#include "common/common.h"
+#include "misc/msgpack.h"
+
+static bool read_uint(bstr *src, int size, uint64_t *out)
+{
+    if (src->len < size)
+        return false;
+    uint64_t v = 0;
+    for (int n = 0; n < size; n++)
+        v = (v << 8) | src->start[n];
+    *src = bstr_cut(*src, size);
+    *out = v;
+    return true;
+}
+
+// The string data is always preceded by at least 1 header byte, so it can be
+// moved back by 1 byte to make room for the terminating '\0'.
+static int read_str(char **dst, bstr *src, uint64_t len)
+{
+    if (src->len < len || memchr(src->start, '\0', len))
+        return -1;
+    char *str = (char *)src->start - 1;
+    memmove(str, src->start, len);
+    str[len] = '\0';
+    *dst = str;
+    *src = bstr_cut(*src, len);
+    return 0;
+}
+
+static int read_sub(void *ta_parent, struct mpv_node *dst, bstr *src,
+                    int max_depth, bool is_obj, uint64_t num)
+{
+    // Every entry needs at least 1 byte, which bounds the allocation.
+    if (num > src->len)
+        return -1;
+    struct mpv_node_list *list = talloc_zero(ta_parent, struct mpv_node_list);
+    if (num) {
+        list->values = talloc_array(list, struct mpv_node, num);
+        if (is_obj)
+            list->keys = talloc_array(list, char *, num);
+    }
+    for (list->num = 0; list->num < num; list->num++) {
+        if (is_obj) {
+            struct mpv_node keynode;
+            if (msgpack_parse(list, &keynode, src, max_depth) < 0 ||
+                keynode.format != MPV_FORMAT_STRING)
+                return -1; // key is not a string
+            list->keys[list->num] = keynode.u.string;
+        }
+        if (msgpack_parse(list, &list->values[list->num], src, max_depth) < 0)
+            return -1;
+    }
+    dst->format = is_obj ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+    dst->u.list = list;
+    return 0;
+}
+
+/* Parse a single MessagePack value from the start of *src into *dst, and
+ * advance *src past it.
+ * max_depth limits the recursion and tree depth.
+ * Warning: like json_parse(), this overwrites the input data!
+ * Returns:
+ *   0: success, *dst is valid
+ *  -1: failure (invalid or truncated input), *dst is invalid, there may be
+ *      dead allocs under ta_parent
+ * The input data can be mutated in both cases. *dst might contain string
+ * elements, which point into the (mutated) input data.
+ */
+int msgpack_parse(void *ta_parent, struct mpv_node *dst, bstr *src,
+                  int max_depth)
+{
+    max_depth -= 1;
+    if (max_depth < 0)
+        return -1;
+
+    if (!src->len)
+        return -1; // early EOF
+    uint8_t c = src->start[0];
+    *src = bstr_cut(*src, 1);
+
+    uint64_t len;
+    if (c <= 0x7f || c >= 0xe0) {
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = (int8_t)c;
+        return 0;
+    } else if (c <= 0x8f) {
+        return read_sub(ta_parent, dst, src, max_depth, true, c & 0x0f);
+    } else if (c <= 0x9f) {
+        return read_sub(ta_parent, dst, src, max_depth, false, c & 0x0f);
+    } else if (c <= 0xbf) {
+        dst->format = MPV_FORMAT_STRING;
+        return read_str(&dst->u.string, src, c & 0x1f);
+    }
+
+    switch (c) {
+    case 0xc0:
+        dst->format = MPV_FORMAT_NONE;
+        return 0;
+    case 0xc2:
+    case 0xc3:
+        dst->format = MPV_FORMAT_FLAG;
+        dst->u.flag = c == 0xc3;
+        return 0;
+    case 0xc4:
+    case 0xc5:
+    case 0xc6: {
+        if (!read_uint(src, 1 << (c - 0xc4), &len) || src->len < len)
+            return -1;
+        struct mpv_byte_array *ba = talloc_zero(ta_parent, struct mpv_byte_array);
+        ba->data = talloc_memdup(ba, src->start, len);
+        ba->size = len;
+        *src = bstr_cut(*src, len);
+        dst->format = MPV_FORMAT_BYTE_ARRAY;
+        dst->u.ba = ba;
+        return 0;
+    }
+    case 0xca: {
+        uint64_t bits;
+        if (!read_uint(src, 4, &bits))
+            return -1;
+        float f;
+        uint32_t bits32 = bits;
+        memcpy(&f, &bits32, sizeof(f));
+        dst->format = MPV_FORMAT_DOUBLE;
+        dst->u.double_ = f;
+        return 0;
+    }
+    case 0xcb: {
+        uint64_t bits;
+        if (!read_uint(src, 8, &bits))
+            return -1;
+        dst->format = MPV_FORMAT_DOUBLE;
+        memcpy(&dst->u.double_, &bits, sizeof(double));
+        return 0;
+    }
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf: {
+        uint64_t v;
+        if (!read_uint(src, 1 << (c - 0xcc), &v) || v > INT64_MAX)
+            return -1;
+        dst->format = MPV_FORMAT_INT64;
+        dst->u.int64 = v;
+        return 0;
+    }
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3: {
+        int size = 1 << (c - 0xd0);
+        uint64_t v;
+        if (!read_uint(src, size, &v))
+            return -1;
+        dst->format = MPV_FORMAT_INT64;
+        switch (size) {
+        case 1: dst->u.int64 = (int8_t)v; break;
+        case 2: dst->u.int64 = (int16_t)v; break;
+        case 4: dst->u.int64 = (int32_t)v; break;
+        default: dst->u.int64 = (int64_t)v;
+        }
+        return 0;
+    }
+    case 0xd9:
+    case 0xda:
+    case 0xdb:
+        if (!read_uint(src, 1 << (c - 0xd9), &len))
+            return -1;
+        dst->format = MPV_FORMAT_STRING;
+        return read_str(&dst->u.string, src, len);
+    case 0xdc:
+    case 0xdd:
+        if (!read_uint(src, c == 0xdc ? 2 : 4, &len))
+            return -1;
+        return read_sub(ta_parent, dst, src, max_depth, false, len);
+    case 0xde:
+    case 0xdf:
+        if (!read_uint(src, c == 0xde ? 2 : 4, &len))
+            return -1;
+        return read_sub(ta_parent, dst, src, max_depth, true, len);
+    }
+    return -1; // ext types, or reserved
+}
+
+static void append_be(void *ta_parent, bstr *b, uint8_t type, uint64_t v,
+                      int size)
+{
+    uint8_t buf[9] = {type};
+    for (int n = 0; n < size; n++)
+        buf[1 + n] = v >> (8 * (size - 1 - n));
+    bstr_xappend(ta_parent, b, (bstr){buf, 1 + size});
+}
+
+// Append a type with a length; fix is the fixed-size variant (or 0).
+static void append_len(void *ta_parent, bstr *b, uint8_t fix, int fix_max,
+                       uint8_t t8, uint8_t t16, uint8_t t32, uint64_t len)
+{
+    if (fix && len <= fix_max) {
+        append_be(ta_parent, b, fix | len, 0, 0);
+    } else if (t8 && len <= UINT8_MAX) {
+        append_be(ta_parent, b, t8, len, 1);
+    } else if (len <= UINT16_MAX) {
+        append_be(ta_parent, b, t16, len, 2);
+    } else {
+        append_be(ta_parent, b, t32, len, 4);
+    }
+}
+
+static void append_str(void *ta_parent, bstr *b, const char *str)
+{
+    size_t len = strlen(str);
+    append_len(ta_parent, b, 0xa0, 31, 0xd9, 0xda, 0xdb, len);
+    bstr_xappend(ta_parent, b, (bstr){(unsigned char *)str, len});
+}
+
+static int msgpack_append(void *ta_parent, bstr *b, const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_NONE:
+        append_be(ta_parent, b, 0xc0, 0, 0);
+        return 0;
+    case MPV_FORMAT_FLAG:
+        append_be(ta_parent, b, src->u.flag ? 0xc3 : 0xc2, 0, 0);
+        return 0;
+    case MPV_FORMAT_INT64: {
+        int64_t v = src->u.int64;
+        if (v >= -32 && v <= 127) {
+            append_be(ta_parent, b, (uint8_t)v, 0, 0);
+        } else if (v >= 0) {
+            int size = v <= UINT8_MAX ? 1 : v <= UINT16_MAX ? 2 :
+                       v <= UINT32_MAX ? 4 : 8;
+            append_be(ta_parent, b, 0xcc + mp_log2(size), v, size);
+        } else {
+            int size = v >= INT8_MIN ? 1 : v >= INT16_MIN ? 2 :
+                       v >= INT32_MIN ? 4 : 8;
+            append_be(ta_parent, b, 0xd0 + mp_log2(size), v, size);
+        }
+        return 0;
+    }
+    case MPV_FORMAT_DOUBLE: {
+        uint64_t bits;
+        memcpy(&bits, &src->u.double_, sizeof(bits));
+        append_be(ta_parent, b, 0xcb, bits, 8);
+        return 0;
+    }
+    case MPV_FORMAT_STRING:
+        append_str(ta_parent, b, src->u.string);
+        return 0;
+    case MPV_FORMAT_BYTE_ARRAY: {
+        struct mpv_byte_array *ba = src->u.ba;
+        append_len(ta_parent, b, 0, 0, 0xc4, 0xc5, 0xc6, ba->size);
+        bstr_xappend(ta_parent, b, (bstr){ba->data, ba->size});
+        return 0;
+    }
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        struct mpv_node_list *list = src->u.list;
+        bool is_obj = src->format == MPV_FORMAT_NODE_MAP;
+        if (is_obj) {
+            append_len(ta_parent, b, 0x80, 15, 0, 0xde, 0xdf, list->num);
+        } else {
+            append_len(ta_parent, b, 0x90, 15, 0, 0xdc, 0xdd, list->num);
+        }
+        for (int n = 0; n < list->num; n++) {
+            if (is_obj)
+                append_str(ta_parent, b, list->keys[n]);
+            if (msgpack_append(ta_parent, b, &list->values[n]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+    }
+    return -1; // unknown format
+}
+
+/* Write the contents of *src as MessagePack, and append it to *dst. dst->start
+ * must be NULL or a talloc allocation, which is extended with ta_parent as
+ * parent.
+ * Returns: 0 on success, <0 on failure.
+ */
+int msgpack_write(void *ta_parent, bstr *dst, const struct mpv_node *src)
+{
+    return msgpack_append(ta_parent, dst, src);
+}
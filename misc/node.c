@@ -115,6 +115,108 @@ mpv_node *node_map_bget(mpv_node *src, struct bstr key)
     return NULL;
 }
 
+// Maps with fewer entries are searched linearly by node_map_index_get().
+#define NODE_MAP_INDEX_MIN 16
+
+struct map_index {
+    struct mpv_node_list *list; // NULL if unused
+    int num;                    // number of indexed entries
+    int *slots;                 // entry position + 1, or 0 if empty
+    unsigned mask;              // number of slots - 1
+};
+
+struct node_map_index {
+    struct map_index maps[4];
+    int next;                   // next entry in maps[] to replace
+};
+
+// Insert the entry at pos, unless an entry with the same key already exists
+// (node_map_bget() returns the first entry too).
+static void map_index_insert(struct map_index *mi, int pos)
+{
+    char **keys = mi->list->keys;
+    bstr key = bstr0(keys[pos]);
+    unsigned h = bstr_hash(key) & mi->mask;
+    while (mi->slots[h]) {
+        if (bstr_equals0(key, keys[mi->slots[h] - 1]))
+            return;
+        h = (h + 1) & mi->mask;
+    }
+    mi->slots[h] = pos + 1;
+}
+
+// Index all entries that were appended since the last update.
+static void map_index_update(void *ta_parent, struct map_index *mi)
+{
+    int num = mi->list->num;
+    if (mi->num > num)
+        mi->num = 0; // entries were removed; the caller should have reset it
+    if (num * 2 > mi->mask + 1 || !mi->num) {
+        unsigned size = 2 * NODE_MAP_INDEX_MIN;
+        while (size < num * 2)
+            size *= 2;
+        if (size != mi->mask + 1)
+            mi->slots = talloc_realloc(ta_parent, mi->slots, int, size);
+        mi->mask = size - 1;
+        memset(mi->slots, 0, size * sizeof(mi->slots[0]));
+        mi->num = 0;
+    }
+    for (; mi->num < num; mi->num++)
+        map_index_insert(mi, mi->num);
+}
+
+// Create an optional hash index for fast key lookups in large
+// MPV_FORMAT_NODE_MAPs with node_map_index_get(). mpv_node_list is public API
+// and can't hold it, so the owner of the maps keeps the index next to them.
+// It caches the hash tables of the last few maps it was used with.
+struct node_map_index *node_map_index_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct node_map_index);
+}
+
+// Drop all cached tables. This must be called if an indexed map had entries
+// removed or reordered, or was freed. Appending entries with node_map_add()
+// and node_map_badd() is picked up automatically.
+void node_map_index_reset(struct node_map_index *index)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(index->maps); n++) {
+        index->maps[n].list = NULL;
+        index->maps[n].num = 0;
+    }
+}
+
+// Same as node_map_bget(), but O(1) on average for large maps.
+mpv_node *node_map_index_get(struct node_map_index *index, mpv_node *src,
+                             struct bstr key)
+{
+    if (src->format != MPV_FORMAT_NODE_MAP ||
+        src->u.list->num < NODE_MAP_INDEX_MIN)
+        return node_map_bget(src, key);
+
+    struct mpv_node_list *list = src->u.list;
+    struct map_index *mi = NULL;
+    for (int n = 0; n < MP_ARRAY_SIZE(index->maps); n++) {
+        if (index->maps[n].list == list)
+            mi = &index->maps[n];
+    }
+    if (!mi) {
+        mi = &index->maps[index->next];
+        index->next = (index->next + 1) % MP_ARRAY_SIZE(index->maps);
+        mi->list = list;
+        mi->num = 0;
+    }
+    map_index_update(index, mi);
+
+    unsigned h = bstr_hash(key) & mi->mask;
+    while (mi->slots[h]) {
+        int pos = mi->slots[h] - 1;
+        if (bstr_equals0(key, list->keys[pos]))
+            return &list->values[pos];
+        h = (h + 1) & mi->mask;
+    }
+    return NULL;
+}
+
 // Note: for MPV_FORMAT_NODE_MAP, this (incorrectly) takes the order into
 //       account, instead of treating it as set.
 bool equal_mpv_value(const void *a, const void *b, mpv_format format)
@@ -134,7 +236,8 @@ bool equal_mpv_value(const void *a, const void *b, mpv_format format)
     case MPV_FORMAT_NODE:
         return equal_mpv_node(a, b);
     case MPV_FORMAT_BYTE_ARRAY: {
-        const struct mpv_byte_array *a_r = a, *b_r = b;
+        const struct mpv_byte_array *a_r = *(struct mpv_byte_array **)a,
+                                    *b_r = *(struct mpv_byte_array **)b;
         if (a_r->size != b_r->size)
             return false;
         return memcmp(a_r->data, b_r->data, a_r->size) == 0;
@@ -166,3 +269,165 @@ bool equal_mpv_node(const struct mpv_node *a, const struct mpv_node *b)
         return false;
     return equal_mpv_value(&a->u, &b->u, a->format);
 }
+
+// Deep-copy src to dst. If parent is not NULL, it is set as parent allocation
+// according to m_option_type_node rules (like with node_init()).
+void node_copy(struct mpv_node *dst, struct mpv_node *parent,
+               const struct mpv_node *src)
+{
+    switch (src->format) {
+    case MPV_FORMAT_STRING:
+        *dst = (struct mpv_node){
+            .format = MPV_FORMAT_STRING,
+            .u.string = talloc_strdup(parent ? parent->u.list : NULL,
+                                      src->u.string),
+        };
+        break;
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+        node_init(dst, src->format, parent);
+        struct mpv_node_list *list = src->u.list;
+        for (int n = 0; n < list->num; n++) {
+            struct mpv_node *entry = src->format == MPV_FORMAT_NODE_MAP
+                ? node_map_add(dst, list->keys[n], MPV_FORMAT_NONE)
+                : node_array_add(dst, MPV_FORMAT_NONE);
+            node_copy(entry, dst, &list->values[n]);
+        }
+        break;
+    }
+    case MPV_FORMAT_BYTE_ARRAY:
+        node_init(dst, MPV_FORMAT_BYTE_ARRAY, parent);
+        dst->u.ba->data = talloc_memdup(dst->u.ba, src->u.ba->data,
+                                        src->u.ba->size);
+        dst->u.ba->size = src->u.ba->size;
+        break;
+    default:
+        *dst = *src;
+    }
+}
+
+static bool same_entry_key(struct mpv_node *a, struct mpv_node *b,
+                           const char *const *keys)
+{
+    if (!keys)
+        return true;
+    for (int n = 0; keys[n]; n++) {
+        struct mpv_node *ka = node_map_get(a, keys[n]);
+        struct mpv_node *kb = node_map_get(b, keys[n]);
+        if (!ka || !kb || !equal_mpv_node(ka, kb))
+            return false;
+    }
+    return true;
+}
+
+// Whether moving the first of the len entries at a[ia] to the end results in
+// the order of the entries at b[ib].
+static bool is_rotation(struct mpv_node_list *a, int ia, struct mpv_node_list *b,
+                        int ib, int len, const char *const *keys)
+{
+    if (!same_entry_key(&a->values[ia], &b->values[ib + len - 1], keys))
+        return false;
+    for (int n = 0; n < len - 1; n++) {
+        if (!same_entry_key(&a->values[ia + 1 + n], &b->values[ib + n], keys))
+            return false;
+    }
+    return true;
+}
+
+static struct mpv_node *add_diff_op(struct mpv_node *ops, const char *op)
+{
+    struct mpv_node *entry = node_array_add(ops, MPV_FORMAT_NODE_MAP);
+    node_map_add_string(entry, "op", op);
+    return entry;
+}
+
+static void add_diff_updates(struct mpv_node *ops, struct mpv_node_list *a,
+                             int ia, struct mpv_node_list *b, int ib, int count)
+{
+    for (int n = 0; n < count; n++) {
+        struct mpv_node *src = &b->values[ib + n];
+        if (equal_mpv_node(&a->values[ia + n], src))
+            continue;
+        struct mpv_node *op = add_diff_op(ops, "update");
+        node_map_add_int64(op, "index", ib + n);
+        node_copy(node_map_add(op, "entry", MPV_FORMAT_NONE), op, src);
+    }
+}
+
+static void add_diff_move(struct mpv_node *ops, int from, int to)
+{
+    struct mpv_node *op = add_diff_op(ops, "move");
+    node_map_add_int64(op, "from", from);
+    node_map_add_int64(op, "to", to);
+}
+
+// Append operations to ops (a MPV_FORMAT_NODE_ARRAY), which turn the array a
+// into the array b when applied in order. Non-array values are treated as
+// empty arrays. Entries are maps, and are identified by the values of the
+// given NULL-terminated list of keys; if keys is NULL, by their position.
+// Operations are maps with an "op" field, and one of:
+//  "insert": insert the "entries" array before "index"
+//  "remove": remove "count" entries starting at "index"
+//  "move":   move the entry at "from" so that it ends up at "to"
+//  "update": replace the entry at "index" with "entry"
+// The operations are O(change) for typical list edits (appending, removing
+// a range, moving a single entry, changing entries), but the comparison
+// itself is O(n).
+void node_array_diff(struct mpv_node *ops, struct mpv_node *a,
+                     struct mpv_node *b, const char *const *keys)
+{
+    struct mpv_node_list empty = {0};
+    struct mpv_node_list *la =
+        a->format == MPV_FORMAT_NODE_ARRAY ? a->u.list : &empty;
+    struct mpv_node_list *lb =
+        b->format == MPV_FORMAT_NODE_ARRAY ? b->u.list : &empty;
+    int min = MPMIN(la->num, lb->num);
+
+    int prefix = 0;
+    while (prefix < min &&
+           same_entry_key(&la->values[prefix], &lb->values[prefix], keys))
+        prefix++;
+    int suffix = 0;
+    while (suffix < min - prefix &&
+           same_entry_key(&la->values[la->num - 1 - suffix],
+                          &lb->values[lb->num - 1 - suffix], keys))
+        suffix++;
+    int mid_a = la->num - prefix - suffix;
+    int mid_b = lb->num - prefix - suffix;
+
+    add_diff_updates(ops, la, 0, lb, 0, prefix);
+
+    if (mid_a == mid_b && mid_a >= 2 &&
+        is_rotation(la, prefix, lb, prefix, mid_a, keys))
+    {
+        int last = prefix + mid_a - 1;
+        add_diff_move(ops, prefix, last);
+        add_diff_updates(ops, la, prefix + 1, lb, prefix, mid_a - 1);
+        add_diff_updates(ops, la, prefix, lb, last, 1);
+    } else if (mid_a == mid_b && mid_a >= 2 &&
+               is_rotation(lb, prefix, la, prefix, mid_a, keys))
+    {
+        int last = prefix + mid_a - 1;
+        add_diff_move(ops, last, prefix);
+        add_diff_updates(ops, la, last, lb, prefix, 1);
+        add_diff_updates(ops, la, prefix, lb, prefix + 1, mid_a - 1);
+    } else {
+        if (mid_a) {
+            struct mpv_node *op = add_diff_op(ops, "remove");
+            node_map_add_int64(op, "index", prefix);
+            node_map_add_int64(op, "count", mid_a);
+        }
+        if (mid_b) {
+            struct mpv_node *op = add_diff_op(ops, "insert");
+            node_map_add_int64(op, "index", prefix);
+            struct mpv_node *entries =
+                node_map_add(op, "entries", MPV_FORMAT_NODE_ARRAY);
+            for (int n = 0; n < mid_b; n++) {
+                node_copy(node_array_add(entries, MPV_FORMAT_NONE), entries,
+                          &lb->values[prefix + n]);
+            }
+        }
+    }
+
+    add_diff_updates(ops, la, la->num - suffix, lb, lb->num - suffix, suffix);
+}
@@ -15,7 +15,15 @@ void node_map_add_double(struct mpv_node *dst, const char *key, double v);
 void node_map_add_flag(struct mpv_node *dst, const char *key, bool v);
 mpv_node *node_map_get(mpv_node *src, const char *key);
 mpv_node *node_map_bget(mpv_node *src, struct bstr key);
+struct node_map_index *node_map_index_create(void *ta_parent);
+void node_map_index_reset(struct node_map_index *index);
+mpv_node *node_map_index_get(struct node_map_index *index, mpv_node *src,
+                             struct bstr key);
 bool equal_mpv_value(const void *a, const void *b, mpv_format format);
 bool equal_mpv_node(const struct mpv_node *a, const struct mpv_node *b);
+void node_copy(struct mpv_node *dst, struct mpv_node *parent,
+               const struct mpv_node *src);
+void node_array_diff(struct mpv_node *ops, struct mpv_node *a,
+                     struct mpv_node *b, const char *const *keys);
 
 #endif
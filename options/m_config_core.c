@@ -32,6 +32,16 @@
 #include "options/m_option.h"
 #include "osdep/threads.h"
 
+// Number of option writes remembered for m_config_cache updates. Caches that
+// fall further behind compare all options of the changed groups instead.
+#define CHANGE_LOG_SIZE 64
+
+struct opt_change {
+    uint64_t ts;        // timestamp of the write
+    int group_index;
+    int opt_index;
+};
+
 // For use with m_config_cache.
 struct m_config_shadow {
     mp_mutex lock;
@@ -48,6 +58,9 @@ struct m_config_shadow {
     struct m_config_data *data; // protected shadow copy of the option data
     struct config_cache **listeners;
     int num_listeners;
+    // Ring buffer of the last option writes; the write with timestamp ts is at
+    // changes[ts % CHANGE_LOG_SIZE].
+    struct opt_change changes[CHANGE_LOG_SIZE];
 };
 
 // Represents a sub-struct (OPT_SUBSTRUCT()).
@@ -64,6 +77,9 @@ struct m_config_group {
                         // none
     const char *prefix; // concat_name(_, prefix, opt->name) => full name
                         // (the parent names are already included in this)
+    uint16_t *opt_at_offset; // option index + 1 for each byte offset into the
+                             // group struct that starts an option, or 0
+                             // (group->size entries, NULL if size is 0)
 };
 
 // A copy of option data. Used for the main option struct, the shadow data,
@@ -73,6 +89,12 @@ struct m_config_data {
     int group_index;                // start index into m_config.groups[]
     struct m_group_data *gdata;     // user struct allocation (our copy of data)
     int num_gdata;                  // (group_index+num_gdata = end index)
+    struct gdata_addr *by_addr;     // gdata sorted by udata address
+};
+
+struct gdata_addr {
+    uintptr_t addr;                 // m_group_data.udata
+    int index;                      // into m_config_data.gdata[]
 };
 
 struct config_cache {
@@ -86,6 +108,8 @@ struct config_cache {
     bool in_list;                   // part of m_config_shadow->listeners[]
     int upd_group;                  // for "incremental" change notification
     int upd_opt;
+    uint64_t upd_log;               // next m_config_shadow.changes[] entry to
+                                    // apply, or 0 if not using the change log
 
 
     // --- Implicitly synchronized by setting/unsetting wakeup_cb.
@@ -403,6 +427,12 @@ static void free_option_data(void *p)
     }
 }
 
+static int compare_gdata_addr(const void *pa, const void *pb)
+{
+    const struct gdata_addr *a = pa, *b = pb;
+    return a->addr < b->addr ? -1 : a->addr > b->addr;
+}
+
 // Allocate data using the option description in shadow, starting at group_index
 // (index into m_config.groups[]).
 // If copy is not NULL, copy all data from there (for groups which are in both
@@ -425,6 +455,16 @@ static struct m_config_data *allocate_option_data(void *ta_parent,
     for (int n = group_index; n < group_index + root_group->group_count; n++)
         alloc_group(data, n, copy);
 
+    data->by_addr = talloc_array(data, struct gdata_addr, data->num_gdata);
+    for (int n = 0; n < data->num_gdata; n++) {
+        data->by_addr[n] = (struct gdata_addr){
+            .addr = (uintptr_t)data->gdata[n].udata,
+            .index = n,
+        };
+    }
+    qsort(data->by_addr, data->num_gdata, sizeof(data->by_addr[0]),
+          compare_gdata_addr);
+
     return data;
 }
 
@@ -532,6 +572,18 @@ static void add_sub_group(struct m_config_shadow *shadow, const char *name_prefi
         shadow->groups[group_index].opt_count = i + 1;
     }
 
+    // For find_opt(). Options sharing a field resolve to the first one.
+    if (subopts->size) {
+        uint16_t *table = talloc_zero_array(shadow, uint16_t, subopts->size);
+        for (int i = shadow->groups[group_index].opt_count - 1; i >= 0; i--) {
+            const struct m_option *opt = &subopts->opts[i];
+            if (opt->offset >= 0 && opt->type->size &&
+                opt->offset < subopts->size)
+                table[opt->offset] = i + 1;
+        }
+        shadow->groups[group_index].opt_at_offset = table;
+    }
+
     if (subopts->get_sub_options) {
         for (int i = 0; ; i++) {
             const struct m_sub_options *sub = NULL;
@@ -587,6 +639,7 @@ struct m_config_cache *m_config_cache_from_shadow(void *ta_parent,
 
     mp_mutex_lock(&shadow->lock);
     in->data = allocate_option_data(cache, shadow, group_index, in->src);
+    in->ts = atomic_load(&shadow->ts);
     mp_mutex_unlock(&shadow->lock);
 
     cache->opts = in->data->gdata[0].udata;
@@ -635,6 +688,94 @@ static bool check_force_update(struct m_group_data *gdata, const char *opt_name,
     return false;
 }
 
+// Copy the option from the shadow data if it changed, and return its data in
+// the cache, or NULL if it didn't change.
+static void *update_opt(struct m_config_cache *cache, int group_index,
+                        int opt_index)
+{
+    struct config_cache *in = cache->internal;
+    struct m_config_data *dst = in->data;
+    struct m_group_data *gsrc = m_config_gdata(in->src, group_index);
+    struct m_group_data *gdst = m_config_gdata(dst, group_index);
+    assert(gsrc && gdst);
+
+    struct m_config_group *g = &dst->shadow->groups[group_index];
+    const struct m_option *opt = &g->group->opts[opt_index];
+    if (opt->offset < 0 || !opt->type->size)
+        return NULL;
+
+    void *dsrc = gsrc->udata + opt->offset;
+    void *ddst = gdst->udata + opt->offset;
+    bool opt_equal = m_option_equal(opt, ddst, dsrc);
+    bool force_update = opt->force_update &&
+                        check_force_update(gsrc, opt->name, in->ts);
+    if (opt_equal && !force_update)
+        return NULL;
+
+    uint64_t ch = get_opt_change_mask(dst->shadow, group_index,
+                                      dst->group_index, opt);
+
+    if (cache->debug && !opt_equal) {
+        char *vdst = m_option_print(opt, ddst);
+        char *vsrc = m_option_print(opt, dsrc);
+        mp_warn(cache->debug, "Option '%s' changed from "
+                "'%s' to' %s' (flags = 0x%"PRIx64")\n",
+                opt->name, vdst, vsrc, ch);
+        talloc_free(vdst);
+        talloc_free(vsrc);
+    }
+
+    m_option_copy(opt, ddst, dsrc);
+    cache->change_flags |= ch;
+    return ddst;
+}
+
+// Whether the change log has another write of the same option up to in->ts.
+static bool rewritten_later(struct config_cache *in, struct opt_change *ch)
+{
+    for (uint64_t ts = ch->ts + 1; ts <= in->ts; ts++) {
+        struct opt_change *next = &in->shadow->changes[ts % CHANGE_LOG_SIZE];
+        if (next->ts == ts && next->group_index == ch->group_index &&
+            next->opt_index == ch->opt_index)
+            return true;
+    }
+    return false;
+}
+
+// Apply the logged writes up to in->ts. Returns false if the log entries
+// were overwritten in the meantime, in which case all options need to be
+// compared.
+static bool update_from_log(struct m_config_cache *cache, void **p_opt)
+{
+    struct config_cache *in = cache->internal;
+
+    while (in->upd_log <= in->ts) {
+        uint64_t ts = in->upd_log;
+        struct opt_change *ch = &in->shadow->changes[ts % CHANGE_LOG_SIZE];
+        if (ch->ts != ts)
+            return false;
+        in->upd_log++;
+
+        if (ch->group_index < in->group_start ||
+            ch->group_index >= in->group_end)
+            continue;
+
+        // Options with force_update are reported even if they're equal, so
+        // skip writes that are followed by another write to the same option.
+        const struct m_option *opt =
+            &in->shadow->groups[ch->group_index].group->opts[ch->opt_index];
+        if (opt->force_update && rewritten_later(in, ch))
+            continue;
+
+        *p_opt = update_opt(cache, ch->group_index, ch->opt_index);
+        if (*p_opt)
+            return true;
+    }
+
+    in->upd_log = 0;
+    return true;
+}
+
 static void update_next_option(struct m_config_cache *cache, void **p_opt)
 {
     struct config_cache *in = cache->internal;
@@ -645,48 +786,30 @@ static void update_next_option(struct m_config_cache *cache, void **p_opt)
 
     *p_opt = NULL;
 
-    while (in->upd_group < dst->group_index + dst->num_gdata) {
+    if (in->upd_log) {
+        if (update_from_log(cache, p_opt))
+            return;
+        // The cache fell too far behind; compare everything.
+        in->upd_log = 0;
+        in->upd_group = dst->group_index;
+        in->upd_opt = 0;
+    }
+
+    while (in->upd_group >= 0 &&
+           in->upd_group < dst->group_index + dst->num_gdata)
+    {
         struct m_group_data *gsrc = m_config_gdata(src, in->upd_group);
         struct m_group_data *gdst = m_config_gdata(dst, in->upd_group);
         assert(gsrc && gdst);
 
         if (gdst->ts < gsrc->ts) {
             struct m_config_group *g = &dst->shadow->groups[in->upd_group];
-            const struct m_option *opts = g->group->opts;
-
-            while (opts && opts[in->upd_opt].name) {
-                const struct m_option *opt = &opts[in->upd_opt];
-                void *dsrc = gsrc->udata + opt->offset;
-                void *ddst = gdst->udata + opt->offset;
-
-                if (opt->offset >= 0 && opt->type->size) {
-                    bool opt_equal = m_option_equal(opt, ddst, dsrc);
-                    bool force_update = opt->force_update &&
-                                        check_force_update(gsrc, opt->name, in->ts);
-                    if (!opt_equal || force_update) {
-                        uint64_t ch = get_opt_change_mask(dst->shadow,
-                                        in->upd_group, dst->group_index, opt);
-
-                        if (cache->debug && !opt_equal) {
-                            char *vdst = m_option_print(opt, ddst);
-                            char *vsrc = m_option_print(opt, dsrc);
-                            mp_warn(cache->debug, "Option '%s' changed from "
-                                    "'%s' to' %s' (flags = 0x%"PRIx64")\n",
-                                    opt->name, vdst, vsrc, ch);
-                            talloc_free(vdst);
-                            talloc_free(vsrc);
-                        }
-
-                        m_option_copy(opt, ddst, dsrc);
-                        cache->change_flags |= ch;
-
-                        in->upd_opt++; // skip this next time
-                        *p_opt = ddst;
-                        return;
-                    }
-                }
-
-                in->upd_opt++;
+
+            while (in->upd_opt < g->opt_count) {
+                *p_opt = update_opt(cache, in->upd_group, in->upd_opt);
+                in->upd_opt++; // skip this next time
+                if (*p_opt)
+                    return;
             }
 
             gdst->ts = gsrc->ts;
@@ -710,9 +833,16 @@ static bool cache_check_update(struct m_config_cache *cache)
     if (in->ts >= new_ts)
         return false;
 
+    // Continue an unfinished update from the change log, or start a new one
+    // if the log still has all writes since the last update.
+    if (!in->upd_log && in->upd_group < 0 &&
+        new_ts - in->ts <= CHANGE_LOG_SIZE)
+        in->upd_log = in->ts + 1;
+    if (!in->upd_log) {
+        in->upd_group = in->data->group_index;
+        in->upd_opt = 0;
+    }
     in->ts = new_ts;
-    in->upd_group = in->data->group_index;
-    in->upd_opt = 0;
     return true;
 }
 
@@ -743,7 +873,7 @@ bool m_config_cache_get_next_changed(struct m_config_cache *cache, void **opt)
     struct m_config_shadow *shadow = in->shadow;
 
     *opt = NULL;
-    if (!cache_check_update(cache) && in->upd_group < 0)
+    if (!cache_check_update(cache) && in->upd_group < 0 && !in->upd_log)
         return false;
 
     mp_mutex_lock(&shadow->lock);
@@ -758,24 +888,28 @@ static void find_opt(struct m_config_shadow *shadow, struct m_config_data *data,
     *group_idx = -1;
     *opt_idx = -1;
 
-    for (int n = data->group_index; n < data->group_index + data->num_gdata; n++)
-    {
-        struct m_group_data *gd = m_config_gdata(data, n);
-        struct m_config_group *g = &shadow->groups[n];
-        const struct m_option *opts = g->group->opts;
-
-        for (int i = 0; opts && opts[i].name; i++) {
-            const struct m_option *opt = &opts[i];
-
-            if (opt->offset >= 0 && opt->type->size &&
-                ptr == gd->udata + opt->offset)
-            {
-                *group_idx = n;
-                *opt_idx = i;
-                return;
-            }
+    // Find the last group struct that starts at or before ptr.
+    uintptr_t addr = (uintptr_t)ptr;
+    int lo = 0, hi = data->num_gdata;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (data->by_addr[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
+    if (!lo)
+        return;
+
+    const struct gdata_addr *ga = &data->by_addr[lo - 1];
+    struct m_config_group *g = &shadow->groups[data->group_index + ga->index];
+    uintptr_t offset = addr - ga->addr;
+    if (offset >= g->group->size || !g->opt_at_offset[offset])
+        return;
+
+    *group_idx = data->group_index + ga->index;
+    *opt_idx = g->opt_at_offset[offset] - 1;
 }
 
 bool m_config_cache_write_opt(struct m_config_cache *cache, void *ptr)
@@ -805,6 +939,11 @@ bool m_config_cache_write_opt(struct m_config_cache *cache, void *ptr)
         m_option_copy(opt, gsrc->udata + opt->offset, ptr);
 
         gsrc->ts = atomic_fetch_add(&shadow->ts, 1) + 1;
+        shadow->changes[gsrc->ts % CHANGE_LOG_SIZE] = (struct opt_change){
+            .ts = gsrc->ts,
+            .group_index = group_idx,
+            .opt_index = opt_idx,
+        };
 
         for (int n = 0; n < shadow->num_listeners; n++) {
             struct config_cache *listener = shadow->listeners[n];
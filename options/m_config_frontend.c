@@ -272,17 +272,67 @@ void m_config_backup_watch_later_opts(struct m_config *config)
         ensure_backup(&config->watch_later_backup_opts, 0, &config->opts[n]);
 }
 
+static unsigned data_hash(const void *ptr)
+{
+    return ((uint64_t)(uintptr_t)ptr * UINT64_C(0x9E3779B97F4A7C15)) >> 32;
+}
+
+static void index_insert(int *table, unsigned mask, unsigned h, int n)
+{
+    h &= mask;
+    while (table[h])
+        h = (h + 1) & mask;
+    table[h] = n + 1;
+}
+
+// Build the lookup tables. Options are inserted in order, so that duplicate
+// names or data pointers resolve to the first option, as with a linear search.
+static void build_index(struct m_config *config)
+{
+    unsigned size = 16;
+    while (size < config->num_opts * 2)
+        size *= 2;
+    config->index_mask = size - 1;
+    config->name_index = talloc_zero_array(config, int, size);
+    config->data_index = talloc_zero_array(config, int, size);
+
+    for (int n = 0; n < config->num_opts; n++) {
+        struct m_config_option *co = &config->opts[n];
+        index_insert(config->name_index, config->index_mask,
+                     bstr_hash(bstr0(co->name)), n);
+        if (co->data) {
+            index_insert(config->data_index, config->index_mask,
+                         data_hash(co->data), n);
+        }
+    }
+}
+
 struct m_config_option *m_config_get_co_raw(const struct m_config *config,
                                             struct bstr name)
 {
     if (!name.len)
         return NULL;
 
-    for (int n = 0; n < config->num_opts; n++) {
-        struct m_config_option *co = &config->opts[n];
-        struct bstr coname = bstr0(co->name);
-        if (bstrcmp(coname, name) == 0)
+    unsigned h = bstr_hash(name) & config->index_mask;
+    while (config->name_index[h]) {
+        struct m_config_option *co = &config->opts[config->name_index[h] - 1];
+        if (bstr_equals0(name, co->name))
+            return co;
+        h = (h + 1) & config->index_mask;
+    }
+
+    return NULL;
+}
+
+static struct m_config_option *get_co_by_data(const struct m_config *config,
+                                              void *ptr)
+{
+    unsigned h = data_hash(ptr) & config->index_mask;
+    while (config->data_index[h]) {
+        struct m_config_option *co = &config->opts[config->data_index[h] - 1];
+        if (co->data == ptr)
             return co;
+        h = (h + 1) & config->index_mask;
     }
 
     return NULL;
@@ -565,6 +615,8 @@ struct m_config *m_config_new(void *talloc_ctx, struct mp_log *log,
         MP_TARRAY_APPEND(config, config->opts, config->num_opts, co);
     }
 
+    build_index(config);
+
     return config;
 }
 
@@ -585,17 +637,13 @@ static void force_self_notify_change_opt(struct m_config *config,
 
 static void notify_opt(struct m_config *config, void *ptr, bool self_notification)
 {
-    for (int n = 0; n < config->num_opts; n++) {
-        struct m_config_option *co = &config->opts[n];
-        if (co->data == ptr) {
-            if (m_config_cache_write_opt(config->cache, co->data))
-                force_self_notify_change_opt(config, co, self_notification);
-            return;
-        }
-    }
+    struct m_config_option *co = get_co_by_data(config, ptr);
     // ptr doesn't point to any config->optstruct field declared in the
     // option list?
-    assert(false);
+    assert(co);
+
+    if (m_config_cache_write_opt(config->cache, co->data))
+        force_self_notify_change_opt(config, co, self_notification);
 }
 
 void m_config_notify_change_opt_ptr(struct m_config *config, void *ptr)
@@ -680,13 +728,14 @@ static struct m_config_option *m_config_mogrify_cli_opt(struct m_config *config,
     if (co && co->opt->type == &m_option_type_cli_alias)
         *name = bstr0((char *)co->opt->priv);
 
-    // Might be a suffix "action", like "--vf-add". Expensively check for
-    // matches. (We don't allow you to combine them with "--no-".)
-    for (int n = 0; n < config->num_opts; n++) {
-        co = &config->opts[n];
-        struct bstr basename = bstr0(co->name);
-
-        if (!bstr_startswith(*name, basename))
+    // Might be a suffix "action", like "--vf-add". Check every split at a
+    // '-'. (We don't allow you to combine them with "--no-".)
+    for (int len = name->len - 1; len > 0; len--) {
+        if (name->start[len] != '-')
+            continue;
+        struct bstr basename = bstr_splice(*name, 0, len);
+        co = m_config_get_co_raw(config, basename);
+        if (!co)
             continue;
 
         // Aliased option + a suffix action, e.g. --opengl-shaders-append
@@ -947,7 +996,7 @@ struct m_profile *m_config_add_profile(struct m_config *config, char *name)
 }
 
 int m_config_set_profile_option(struct m_config *config, struct m_profile *p,
-                                bstr name, bstr val)
+                                bstr name, bstr val, bool check)
 {
     if (bstr_equals0(name, "profile-desc")) {
         talloc_free(p->desc);
@@ -966,11 +1015,13 @@ int m_config_set_profile_option(struct m_config *config, struct m_profile *p,
                               &p->restore_mode);
     }
 
-    int i = m_config_set_option_cli(config, name, val,
-                                    M_SETOPT_CHECK_ONLY |
-                                    M_SETOPT_FROM_CONFIG_FILE);
-    if (i < 0)
-        return i;
+    if (check) {
+        int i = m_config_set_option_cli(config, name, val,
+                                        M_SETOPT_CHECK_ONLY |
+                                        M_SETOPT_FROM_CONFIG_FILE);
+        if (i < 0)
+            return i;
+    }
     p->opts = talloc_realloc(p, p->opts, char *, 2 * (p->num_opts + 2));
     p->opts[p->num_opts * 2] = bstrto0(p, name);
     p->opts[p->num_opts * 2 + 1] = bstrto0(p, val);
@@ -65,6 +65,12 @@ typedef struct m_config {
     struct m_config_option *opts; // all options, even suboptions
     int num_opts;
 
+    // Hash tables for looking up opts[] by name and by data pointer. Entries
+    // are opts[] index + 1, or 0 if unused. Both have index_mask + 1 entries.
+    int *name_index;
+    int *data_index;
+    unsigned index_mask;
+
     // List of defined profiles.
     struct m_profile *profiles;
     // Depth when recursively including profiles.
@@ -241,9 +247,11 @@ struct m_profile *m_config_add_profile(struct m_config *config, char *name);
  *  \param p The profile object.
  *  \param name The option's name.
  *  \param val The option's value.
+ *  \param check Validate the option and value first. Skipping this is only
+ *               safe for values that were validated before (config snapshots).
  */
 int m_config_set_profile_option(struct m_config *config, struct m_profile *p,
-                                bstr name, bstr val);
+                                bstr name, bstr val, bool check);
 
 /*  Enables profile usage
  *  Used by the config file parser when loading a profile.
@@ -35,7 +35,7 @@
 #include "common/common.h"
 
 static int m_property_multiply(struct mp_log *log,
-                               const struct m_property *prop_list,
+                               const struct m_property_index *prop_list,
                                const char *property, double f, void *ctx)
 {
     union m_option_value val = m_option_value_default;
@@ -70,16 +70,76 @@ struct m_property *m_property_list_find(const struct m_property *list,
     return NULL;
 }
 
-static int do_action(const struct m_property *prop_list, const char *name,
+struct m_property_index {
+    const struct m_property *list;
+    struct m_property **sorted;
+    int num_sorted;
+};
+
+static int compare_prop(const void *a, const void *b)
+{
+    const struct m_property *pa = *(struct m_property **)a;
+    const struct m_property *pb = *(struct m_property **)b;
+    int r = strcmp(pa->name, pb->name);
+    // Keep the first of duplicate names, like m_property_list_find().
+    return r ? r : (pa > pb) - (pa < pb);
+}
+
+static int compare_prop_name(const void *key, const void *elem)
+{
+    const struct m_property *p = *(struct m_property **)elem;
+    return bstrcmp(*(const bstr *)key, bstr0(p->name));
+}
+
+struct m_property_index *m_property_index_create(void *ta_parent,
+                                                 const struct m_property *list)
+{
+    struct m_property_index *index = talloc_zero(ta_parent, struct m_property_index);
+    index->list = list;
+    for (int n = 0; list[n].name; n++) {
+        MP_TARRAY_APPEND(index, index->sorted, index->num_sorted,
+                         (struct m_property *)&list[n]);
+    }
+    if (index->num_sorted) {
+        qsort(index->sorted, index->num_sorted, sizeof(index->sorted[0]),
+              compare_prop);
+    }
+    return index;
+}
+
+struct m_property *m_property_index_find(const struct m_property_index *index,
+                                         bstr name)
+{
+    // Find the lowest entry with a matching name; duplicates are adjacent.
+    int lo = 0, hi = index->num_sorted;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (compare_prop_name(&name, &index->sorted[mid]) > 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < index->num_sorted && compare_prop_name(&name, &index->sorted[lo]) == 0)
+        return index->sorted[lo];
+    return NULL;
+}
+
+int m_property_index_get_pos(const struct m_property_index *index, bstr name)
+{
+    struct m_property *prop = m_property_index_find(index, name);
+    return prop ? prop - index->list : -1;
+}
+
+static int do_action(const struct m_property_index *prop_list, const char *name,
                      int action, void *arg, void *ctx)
 {
     struct m_property *prop;
     struct m_property_action_arg ka;
     const char *sep = strchr(name, '/');
     if (sep && sep[1]) {
-        char base[128];
-        snprintf(base, sizeof(base), "%.*s", (int)(sep - name), name);
-        prop = m_property_list_find(prop_list, base);
+        bstr base = bstr_splice(bstr0(name), 0, sep - name);
+        prop = m_property_index_find(prop_list, base);
         ka = (struct m_property_action_arg) {
             .key = sep + 1,
             .action = action,
@@ -88,14 +148,14 @@ static int do_action(const struct m_property *prop_list, const char *name,
         action = M_PROPERTY_KEY_ACTION;
         arg = &ka;
     } else
-        prop = m_property_list_find(prop_list, name);
+        prop = m_property_index_find(prop_list, bstr0(name));
     if (!prop)
         return M_PROPERTY_UNKNOWN;
     return prop->call(ctx, prop, action, arg);
 }
 
 // (as a hack, log can be NULL on read-only paths)
-int m_property_do(struct mp_log *log, const struct m_property *prop_list,
+int m_property_do(struct mp_log *log, const struct m_property_index *prop_list,
                   const char *name, int action, void *arg, void *ctx)
 {
     union m_option_value val = m_option_value_default;
@@ -235,7 +295,7 @@ static void m_property_unkey(int *action, void **arg)
     }
 }
 
-static int m_property_do_bstr(const struct m_property *prop_list, bstr name,
+static int m_property_do_bstr(const struct m_property_index *prop_list, bstr name,
                               int action, void *arg, void *ctx)
 {
     char *name0 = bstrdup0(NULL, name);
@@ -252,7 +312,7 @@ static void append_str(char **s, int *len, bstr append)
     *len = *len + append.len;
 }
 
-static int expand_property(const struct m_property *prop_list, char **ret,
+static int expand_property(const struct m_property_index *prop_list, char **ret,
                            int *ret_len, bstr prop, bool silent_error, void *ctx)
 {
     bool cond_yes = bstr_eatstart0(&prop, "?");
@@ -285,7 +345,7 @@ static int expand_property(const struct m_property *prop_list, char **ret,
     return skip;
 }
 
-char *m_properties_expand_string(const struct m_property *prop_list,
+char *m_properties_expand_string(const struct m_property_index *prop_list,
                                  const char *str0, void *ctx)
 {
     char *ret = NULL;
@@ -549,6 +549,8 @@ static const m_option_t mp_opts[] = {
     {"media-controls", OPT_CHOICE(media_controls,
         {"no", 0}, {"player", 1}, {"yes", 2})},
     {"config", OPT_BOOL(load_config), .flags = CONF_PRE_PARSE},
+    {"config-snapshot", OPT_BOOL(config_snapshot),
+        .flags = CONF_NOCFG | CONF_PRE_PARSE},
     {"config-dir", OPT_STRING(force_configdir),
         .flags = CONF_NOCFG | CONF_PRE_PARSE | M_OPT_FILE},
     {"reset-on-next-file", OPT_STRINGLIST(reset_options)},
@@ -807,6 +809,9 @@ static const m_option_t mp_opts[] = {
     {"video-latency-hacks", OPT_BOOL(video_latency_hacks)},
 
     {"untimed", OPT_BOOL(untimed)},
+    {"benchmark-report", OPT_STRING(benchmark_report), .flags = M_OPT_FILE},
+    {"stats-trace", OPT_STRING(stats_trace), .flags = M_OPT_FILE},
+    {"startup-timeline", OPT_STRING(startup_timeline), .flags = M_OPT_FILE},
 
     {"stream-dump", OPT_STRING(stream_dump), .flags = M_OPT_FILE},
 
@@ -226,6 +226,9 @@ typedef struct MPOpts {
     bool video_osd;
 
     bool untimed;
+    char *benchmark_report;
+    char *stats_trace;
+    char *startup_timeline;
     char *stream_dump;
     bool stop_playback_on_init_failure;
     int loop_times;
@@ -239,6 +242,7 @@ typedef struct MPOpts {
     bool merge_files;
     bool quiet;
     bool load_config;
+    bool config_snapshot;
     char *force_configdir;
     bool use_filedir_conf;
     int hls_bitrate;
@@ -20,13 +20,18 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <time.h>
 
 #include "osdep/io.h"
+#include "osdep/timer.h"
 
 #include "parse_configfile.h"
 #include "common/common.h"
 #include "common/msg.h"
 #include "misc/ctype.h"
+#include "misc/io_utils.h"
+#include "misc/msgpack.h"
+#include "misc/node.h"
 #include "m_option.h"
 #include "m_config.h"
 #include "stream/stream.h"
@@ -40,10 +45,25 @@ static bool skip_ws(bstr *s)
     return s->len;
 }
 
-int m_config_parse(m_config_t *config, const char *location, bstr data,
-                   char *initial_section, int flags)
+static void add_item(struct mpv_node *items, bstr name, bstr value)
+{
+    struct mpv_node *item = node_array_add(items, MPV_FORMAT_NODE_ARRAY);
+    bstr strs[2] = {name, value};
+    for (int n = 0; n < (value.start ? 2 : 1); n++) {
+        struct mpv_node *str = node_array_add(item, MPV_FORMAT_NONE);
+        str->format = MPV_FORMAT_STRING;
+        str->u.string = bstrto0(item->u.list, strs[n]);
+    }
+}
+
+// If items is not NULL, every profile switch is appended to it as [name], and
+// every option added to a profile as [name, value]. Returns the error count.
+static int parse_config(m_config_t *config, const char *location, bstr data,
+                        char *initial_section, int flags, struct mpv_node *items)
 {
     m_profile_t *profile = m_config_add_profile(config, initial_section);
+    if (items)
+        add_item(items, bstr0(initial_section), (bstr){0});
     void *tmp = talloc_new(NULL);
     int line_no = 0;
     int errors = 0;
@@ -75,6 +95,8 @@ int m_config_parse(m_config_t *config, const char *location, bstr data,
                 goto error;
             }
             profile = m_config_add_profile(config, bstrto0(tmp, profilename));
+            if (items)
+                add_item(items, profilename, (bstr){0});
             continue;
         }
 
@@ -126,12 +148,15 @@ int m_config_parse(m_config_t *config, const char *location, bstr data,
             goto error;
         }
 
-        int res = m_config_set_profile_option(config, profile, option, value);
+        int res = m_config_set_profile_option(config, profile, option, value,
+                                              true);
         if (res < 0) {
             MP_ERR(config, "%s setting option %.*s='%.*s' failed.\n",
                    loc, BSTR_P(option), BSTR_P(value));
             goto error;
         }
+        if (items)
+            add_item(items, option, value.start ? value : bstr0(""));
 
         ok = true;
     error:
@@ -147,34 +172,205 @@ int m_config_parse(m_config_t *config, const char *location, bstr data,
         m_config_finish_default_profile(config, flags);
 
     talloc_free(tmp);
+    return errors;
+}
+
+int m_config_parse(m_config_t *config, const char *location, bstr data,
+                   char *initial_section, int flags)
+{
+    parse_config(config, location, data, initial_section, flags, NULL);
     return 1;
 }
 
-// Load options and profiles from a config file.
-//  conffile: path to the config file
-//  initial_section: default section where to add normal options
-//  flags: M_SETOPT_* bits
-//  returns: 1 on success, -1 on error, 0 if file not accessible.
-int m_config_parse_config_file(m_config_t *config, struct mpv_global *global,
-                               const char *conffile, char *initial_section,
-                               int flags)
+/* Config snapshots store the result of parse_config() for a local config file,
+ * so that a later load can skip parsing and validating the option values:
+ *   {"version": mpv_version, "source": path, "size": file size,
+ *    "mtime": file mtime, "created": time the snapshot was written,
+ *    "items": [[profile], [option, value], ...]}
+ * A snapshot is only used if version, path, size and mtime match. Sources with
+ * an mtime not older than the snapshot itself are always parsed, because a
+ * change within the same second can't be detected.
+ */
+
+static int64_t snapshot_get_int(struct mpv_node *root, const char *key)
+{
+    struct mpv_node *v = node_map_get(root, key);
+    return v && v->format == MPV_FORMAT_INT64 ? v->u.int64 : -1;
+}
+
+static bool snapshot_check_str(struct mpv_node *root, const char *key,
+                               const char *val)
+{
+    struct mpv_node *v = node_map_get(root, key);
+    return v && v->format == MPV_FORMAT_STRING && strcmp(v->u.string, val) == 0;
+}
+
+// Returns the item list, or NULL if the snapshot is missing, stale or invalid.
+static struct mpv_node_list *load_snapshot(void *ta_parent,
+                                           struct mpv_global *global,
+                                           const char *snapshot,
+                                           const char *conffile,
+                                           const char *initial_section,
+                                           const struct stat *st)
+{
+    if (stat(snapshot, &(struct stat){0}))
+        return NULL;
+    bstr data = stream_read_file(snapshot, ta_parent, global, 100000000);
+    struct mpv_node root;
+    if (!data.start || msgpack_parse(ta_parent, &root, &data, 4) < 0 ||
+        data.len || root.format != MPV_FORMAT_NODE_MAP)
+        return NULL;
+
+    if (!snapshot_check_str(&root, "version", mpv_version) ||
+        !snapshot_check_str(&root, "source", conffile) ||
+        snapshot_get_int(&root, "size") != st->st_size ||
+        snapshot_get_int(&root, "mtime") != st->st_mtime ||
+        snapshot_get_int(&root, "created") <= st->st_mtime)
+        return NULL;
+
+    struct mpv_node *items = node_map_get(&root, "items");
+    if (!items || items->format != MPV_FORMAT_NODE_ARRAY)
+        return NULL;
+    struct mpv_node_list *list = items->u.list;
+    for (int n = 0; n < list->num; n++) {
+        struct mpv_node *item = &list->values[n];
+        if (item->format != MPV_FORMAT_NODE_ARRAY || item->u.list->num < 1 ||
+            item->u.list->num > 2)
+            return NULL;
+        for (int i = 0; i < item->u.list->num; i++) {
+            if (item->u.list->values[i].format != MPV_FORMAT_STRING)
+                return NULL;
+        }
+    }
+    // The first item is the initial section, which depends on the caller.
+    if (!list->num || list->values[0].u.list->num != 1 ||
+        strcmp(list->values[0].u.list->values[0].u.string,
+               initial_section ? initial_section : "") != 0)
+        return NULL;
+    return list;
+}
+
+static void apply_snapshot(m_config_t *config, struct mpv_node_list *items,
+                           int flags)
+{
+    m_profile_t *profile = NULL;
+    for (int n = 0; n < items->num; n++) {
+        struct mpv_node_list *item = items->values[n].u.list;
+        if (item->num == 1) {
+            profile = m_config_add_profile(config, item->values[0].u.string);
+        } else {
+            m_config_set_profile_option(config, profile,
+                                        bstr0(item->values[0].u.string),
+                                        bstr0(item->values[1].u.string), false);
+        }
+    }
+
+    if (config->recursion_depth == 0)
+        m_config_finish_default_profile(config, flags);
+}
+
+static void write_snapshot(m_config_t *config, const char *snapshot,
+                           const char *conffile, const struct stat *st,
+                           struct mpv_node *items)
+{
+    int64_t now = time(NULL);
+    if (st->st_mtime >= now)
+        return; // would never be used
+
+    void *tmp = talloc_new(NULL);
+    struct mpv_node root;
+    node_init(&root, MPV_FORMAT_NODE_MAP, NULL);
+    talloc_steal(tmp, root.u.list);
+    node_map_add_string(&root, "version", mpv_version);
+    node_map_add_string(&root, "source", conffile);
+    node_map_add_int64(&root, "size", st->st_size);
+    node_map_add_int64(&root, "mtime", st->st_mtime);
+    node_map_add_int64(&root, "created", now);
+    *node_map_add(&root, "items", MPV_FORMAT_NONE) = *items;
+
+    bstr data = {0};
+    if (msgpack_write(tmp, &data, &root) < 0 ||
+        !mp_save_to_file(snapshot, data.start, data.len))
+    {
+        MP_WARN(config, "Could not write config snapshot %s\n", snapshot);
+    }
+    talloc_free(tmp);
+}
+
+static int parse_config_file(m_config_t *config, struct mpv_global *global,
+                             const char *conffile, const char *snapshot,
+                             char *initial_section, int flags)
 {
     flags = flags | M_SETOPT_FROM_CONFIG_FILE;
 
     MP_VERBOSE(config, "Reading config file %s\n", conffile);
 
+    int64_t start = mp_time_ns();
+    void *tmp = talloc_new(NULL);
     int r = 0;
 
+    struct stat st;
+    if (snapshot && stat(conffile, &st) == 0) {
+        struct mpv_node_list *items =
+            load_snapshot(tmp, global, snapshot, conffile, initial_section, &st);
+        if (items) {
+            apply_snapshot(config, items, flags);
+            MP_VERBOSE(config, "Loaded %s from snapshot in %.3f ms.\n",
+                       conffile, MP_TIME_NS_TO_MS(mp_time_ns() - start));
+            r = 1;
+            goto done;
+        }
+    } else {
+        snapshot = NULL;
+    }
+
     struct stream *s = stream_create(conffile, STREAM_READ | STREAM_ORIGIN_DIRECT,
                                      NULL, global);
     if (!s)
         goto done;
-    bstr data = stream_read_complete(s, s, 1000000000);
+    bstr data = stream_read_complete(s, tmp, 1000000000);
+    free_stream(s);
     if (!data.start)
         goto done;
-    r = m_config_parse(config, conffile, data, initial_section, flags);
+
+    struct mpv_node items;
+    node_init(&items, MPV_FORMAT_NODE_ARRAY, NULL);
+    talloc_steal(tmp, items.u.list);
+    int errors = parse_config(config, conffile, data, initial_section, flags,
+                              snapshot ? &items : NULL);
+    if (snapshot && !errors)
+        write_snapshot(config, snapshot, conffile, &st, &items);
+    MP_VERBOSE(config, "Parsed %s in %.3f ms.\n",
+               conffile, MP_TIME_NS_TO_MS(mp_time_ns() - start));
+    r = 1;
 
 done:
-    free_stream(s);
+    talloc_free(tmp);
     return r;
 }
+
+// Load options and profiles from a config file.
+//  conffile: path to the config file
+//  initial_section: default section where to add normal options
+//  flags: M_SETOPT_* bits
+//  returns: 1 on success, -1 on error, 0 if file not accessible.
+int m_config_parse_config_file(m_config_t *config, struct mpv_global *global,
+                               const char *conffile, char *initial_section,
+                               int flags)
+{
+    return parse_config_file(config, global, conffile, NULL, initial_section,
+                             flags);
+}
+
+// Like m_config_parse_config_file(), but if snapshot is not NULL, try to load
+// the parsed file from the snapshot at this path, and write it there if it's
+// stale or missing.
+int m_config_parse_config_file_snapshot(m_config_t *config,
+                                        struct mpv_global *global,
+                                        const char *conffile,
+                                        const char *snapshot,
+                                        char *initial_section, int flags)
+{
+    return parse_config_file(config, global, conffile, snapshot,
+                             initial_section, flags);
+}
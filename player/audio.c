@@ -443,9 +443,11 @@ static int reinit_audio_filters_and_output(struct MPContext *mpctx)
 
     mpctx->ao_filter_fmt = out_fmt;
 
+    mp_startup_begin(mpctx, "ao-init");
     mpctx->ao = ao_init_best(mpctx->global, ao_flags, mp_wakeup_core_cb,
                              mpctx, mpctx->encode_lavc_ctx, out_rate,
                              out_format, out_channels);
+    mp_startup_end(mpctx, "ao-init");
 
     int ao_rate = 0;
     int ao_format = 0;
@@ -589,7 +591,10 @@ void reinit_audio_chain_src(struct MPContext *mpctx, struct track *track)
     if (track) {
         ao_c->track = track;
         track->ao_c = ao_c;
-        if (!init_audio_decoder(mpctx, track))
+        mp_startup_begin(mpctx, "audio-decoder-init");
+        int r = init_audio_decoder(mpctx, track);
+        mp_startup_end(mpctx, "audio-decoder-init");
+        if (!r)
             goto init_error;
         ao_c->dec_src = track->dec->f->pins[0];
         mp_pin_connect(ao_c->filter->f->pins[0], ao_c->dec_src);
@@ -59,6 +59,31 @@
  *
  */
 
+// List properties supported by mpv_observe_property_delta(). Entries are
+// identified by the values of the given keys, or by position if keys is NULL.
+static const struct delta_property {
+    const char *name;
+    const char *const *keys;
+} delta_properties[] = {
+    {"playlist", (const char *const[]){"id", NULL}},
+    {"track-list", (const char *const[]){"type", "id", NULL}},
+    {"chapter-list"},
+};
+
+// Number of change batches kept for observers which lag behind.
+#define DELTA_JOURNAL_SIZE 64
+// Pending operations after which an observer is sent a reset instead.
+#define DELTA_MAX_PENDING 256
+
+// Change log of a delta property, shared by all of its observers.
+struct delta_journal {
+    uint64_t update_round;  // mp_client_api.delta_round of the last update
+    struct mpv_node value;  // property value as of the last update
+    uint64_t seq;           // number of batches ever added
+    // Arrays of operations; batch number seq is at batches[seq % SIZE].
+    struct mpv_node batches[DELTA_JOURNAL_SIZE];
+};
+
 struct mp_client_api {
     struct MPContext *mpctx;
 
@@ -77,12 +102,28 @@ struct mp_client_api {
     uint64_t clients_list_change_ts;
     int64_t id_alloc;
 
+    // Observed properties of all clients, indexed by property ID + 1 (so
+    // that unknown properties, which all have ID -1, are included). Entries
+    // are removed before the observe_property is unreferenced by its owner.
+    struct property_observers *observers;
+    int num_observers;
+
+    // -- only accessed by the core thread (mp_client_send_property_changes())
+
+    uint64_t delta_round;
+    struct delta_journal *delta_journals[MP_ARRAY_SIZE(delta_properties)];
+
     struct mp_custom_protocol *custom_protocols;
     int num_custom_protocols;
 
     struct mpv_render_context *render_context;
 };
 
+struct property_observers {
+    struct observe_property **props;
+    int num_props;
+};
+
 struct observe_property {
     // -- immutable
     struct mpv_handle *owner;
@@ -92,6 +133,7 @@ struct observe_property {
     int64_t reply_id;
     mpv_format format;
     const struct m_option *type;
+    int delta;              // index into delta_properties[], or -1
     // -- protected by owner->lock
     size_t refcount;
     uint64_t change_ts;     // logical timestamp incremented on each change
@@ -101,6 +143,8 @@ struct observe_property {
     uint64_t value_ret_ts;  // logical timestamp of value returned to user
     union m_option_value value_ret;
     bool waiting_for_hook;  // flag for draining old property changes on a hook
+    bool delta_synced;      // delta_seq is valid (initial reset was sent)
+    uint64_t delta_seq;     // last delta_journal batch added to value
 };
 
 struct mpv_handle {
@@ -176,6 +220,35 @@ static void prop_unref(struct observe_property *prop)
         talloc_free(prop);
 }
 
+// Must be called with clients->lock held.
+static void index_property(struct mp_client_api *clients,
+                           struct observe_property *prop)
+{
+    int slot = prop->id + 1;
+    if (slot >= clients->num_observers) {
+        MP_TARRAY_GROW(clients, clients->observers, slot);
+        for (int n = clients->num_observers; n <= slot; n++)
+            clients->observers[n] = (struct property_observers){0};
+        clients->num_observers = slot + 1;
+    }
+    struct property_observers *obs = &clients->observers[slot];
+    MP_TARRAY_APPEND(clients, obs->props, obs->num_props, prop);
+}
+
+// Must be called with clients->lock held.
+static void unindex_property(struct mp_client_api *clients,
+                             struct observe_property *prop)
+{
+    struct property_observers *obs = &clients->observers[prop->id + 1];
+    for (int n = 0; n < obs->num_props; n++) {
+        if (obs->props[n] == prop) {
+            MP_TARRAY_REMOVE_AT(obs->props, obs->num_props, n);
+            return;
+        }
+    }
+    MP_ASSERT_UNREACHABLE();
+}
+
 void mp_clients_init(struct MPContext *mpctx)
 {
     mpctx->clients = talloc_ptrtype(NULL, mpctx->clients);
@@ -434,12 +507,15 @@ static void mp_destroy_client(mpv_handle *ctx, bool terminate)
     if (terminate)
         mpv_command(ctx, (const char*[]){"quit", NULL});
 
+    mp_mutex_lock(&clients->lock);
     mp_mutex_lock(&ctx->lock);
 
     ctx->destroying = true;
 
-    for (int n = 0; n < ctx->num_properties; n++)
+    for (int n = 0; n < ctx->num_properties; n++) {
+        unindex_property(clients, ctx->properties[n]);
         prop_unref(ctx->properties[n]);
+    }
     ctx->num_properties = 0;
     ctx->properties_change_ts += 1;
 
@@ -447,6 +523,7 @@ static void mp_destroy_client(mpv_handle *ctx, bool terminate)
     ctx->cur_property = NULL;
 
     mp_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&clients->lock);
 
     abort_async(mpctx, ctx, 0, 0);
 
@@ -1248,6 +1325,13 @@ int mpv_command_node_async(mpv_handle *ctx, uint64_t ud, mpv_node *args)
     return run_async_cmd(ctx, ud, mp_input_parse_cmd_node(ctx->log, args));
 }
 
+int mp_client_command_string_async(mpv_handle *ctx, uint64_t ud,
+                                   const char *args)
+{
+    return run_async_cmd(ctx, ud,
+        mp_input_parse_cmd(ctx->mpctx->input, bstr0((char*)args), ctx->name));
+}
+
 void mpv_abort_async_command(mpv_handle *ctx, uint64_t reply_userdata)
 {
     abort_async(ctx->mpctx, ctx, MPV_EVENT_COMMAND_REPLY, reply_userdata);
@@ -1521,6 +1605,219 @@ int mpv_get_property_async(mpv_handle *ctx, uint64_t ud, const char *name,
     return run_async(ctx, getproperty_fn, req);
 }
 
+// Batched requests (mpv_get_property_list(), mpv_command_list()). All items
+// are started in order under a single core lock, and the result is an array
+// with one map per item.
+struct list_request {
+    struct MPContext *mpctx;
+    struct mpv_handle *reply_ctx;
+    uint64_t userdata;
+    bool async;                 // send MPV_EVENT_COMMAND_REPLY when done
+    char **names;
+    int num_names;
+    struct mp_cmd **cmds;       // NULL entries for commands which failed to parse
+    int num_cmds;
+    struct mpv_node result;
+    int pending;                // items not completed yet (core lock)
+    struct mp_waiter completion;
+};
+
+struct list_item {
+    struct list_request *req;
+    struct mpv_node *entry;
+};
+
+static struct list_request *new_list_request(mpv_handle *ctx,
+                                             const char **names,
+                                             mpv_node *cmds)
+{
+    struct list_request *req = talloc_ptrtype(NULL, req);
+    *req = (struct list_request){
+        .mpctx = ctx->mpctx,
+        .reply_ctx = ctx,
+        .completion = MP_WAITER_INITIALIZER,
+    };
+    node_init(&req->result, MPV_FORMAT_NODE_ARRAY, NULL);
+
+    for (int n = 0; names && names[n]; n++) {
+        MP_TARRAY_APPEND(req, req->names, req->num_names,
+                         talloc_strdup(req, names[n]));
+        node_array_add(&req->result, MPV_FORMAT_NODE_MAP);
+    }
+
+    for (int n = 0; cmds && n < cmds->u.list->num; n++) {
+        struct mp_cmd *cmd =
+            mp_input_parse_cmd_node(ctx->log, &cmds->u.list->values[n]);
+        if (cmd) {
+            cmd->sender = ctx->name;
+            talloc_steal(req, cmd);
+        }
+        MP_TARRAY_APPEND(req, req->cmds, req->num_cmds, cmd);
+        node_array_add(&req->result, MPV_FORMAT_NODE_MAP);
+    }
+
+    return req;
+}
+
+// Move data (if not NULL) into the entry.
+static void set_list_entry(struct mpv_node *entry, int err, struct mpv_node *data)
+{
+    node_map_add_string(entry, "error", mpv_error_string(err));
+    if (err >= 0 && data) {
+        struct mpv_node *dst = node_map_add(entry, "data", MPV_FORMAT_NONE);
+        *dst = *data;
+        talloc_steal(entry->u.list, node_get_alloc(dst));
+        *data = (struct mpv_node){0};
+    }
+}
+
+// Called with the core locked.
+static void list_item_done(struct list_request *req)
+{
+    if (--req->pending)
+        return;
+
+    if (req->async) {
+        struct mpv_event_command *data = talloc_zero(NULL, struct mpv_event_command);
+        data->result = req->result;
+        talloc_steal(data, node_get_alloc(&data->result));
+        req->result = (mpv_node){0};
+
+        struct mpv_event reply = {
+            .event_id = MPV_EVENT_COMMAND_REPLY,
+            .data = data,
+        };
+        send_reply(req->reply_ctx, req->userdata, &reply);
+        talloc_free(req);
+    } else {
+        mp_waiter_wakeup(&req->completion, 0);
+    }
+}
+
+static void list_cmd_complete(struct mp_cmd_ctx *cmd)
+{
+    struct list_item *item = cmd->on_completion_priv;
+    set_list_entry(item->entry, cmd->success ? 0 : MPV_ERROR_COMMAND,
+                   &cmd->result);
+    list_item_done(item->req);
+}
+
+static void run_list_fn(void *arg)
+{
+    struct list_request *req = arg;
+    struct mpv_node *entries = req->result.u.list->values;
+
+    req->pending = 1; // don't finish before all items were started
+
+    for (int n = 0; n < req->num_names; n++) {
+        struct mpv_node node = {0};
+        struct getproperty_request greq = {
+            .mpctx = req->mpctx,
+            .name = req->names[n],
+            .format = MPV_FORMAT_NODE,
+            .data = &node,
+        };
+        getproperty_fn(&greq);
+        set_list_entry(&entries[n], greq.status, &node);
+    }
+
+    for (int n = 0; n < req->num_cmds; n++) {
+        struct mpv_node *entry = &entries[req->num_names + n];
+        struct mp_cmd *cmd = req->cmds[n];
+        if (!cmd) {
+            set_list_entry(entry, MPV_ERROR_INVALID_PARAMETER, NULL);
+            continue;
+        }
+        ta_set_parent(cmd, NULL);
+        req->cmds[n] = NULL;
+
+        // Same as with mpv_command(): don't wait for "async" commands.
+        if (cmd->flags & MP_ASYNC_CMD) {
+            run_command(req->mpctx, cmd, NULL, NULL, NULL);
+            set_list_entry(entry, 0, NULL);
+            continue;
+        }
+
+        struct mp_abort_entry *abort = NULL;
+        if (cmd->def->can_abort) {
+            abort = talloc_zero(NULL, struct mp_abort_entry);
+            abort->client = req->reply_ctx;
+            if (req->async) {
+                abort->client_work_type = MPV_EVENT_COMMAND_REPLY;
+                abort->client_work_id = req->userdata;
+            }
+        }
+
+        struct list_item *item = talloc_ptrtype(req, item);
+        *item = (struct list_item){req, entry};
+        req->pending += 1;
+        run_command(req->mpctx, cmd, abort, list_cmd_complete, item);
+    }
+
+    list_item_done(req);
+}
+
+static int run_list_request(mpv_handle *ctx, struct list_request *req,
+                            mpv_node *result)
+{
+    run_locked(ctx, run_list_fn, req);
+    mp_waiter_wait(&req->completion);
+
+    if (result) {
+        *result = req->result;
+    } else {
+        talloc_free(node_get_alloc(&req->result));
+    }
+    talloc_free(req);
+    return 0;
+}
+
+static int run_list_request_async(mpv_handle *ctx, struct list_request *req,
+                                  uint64_t ud)
+{
+    req->async = true;
+    req->userdata = ud;
+    // Make sure the result is freed if the request never runs.
+    talloc_steal(req, node_get_alloc(&req->result));
+    return run_async(ctx, run_list_fn, req);
+}
+
+int mpv_get_property_list(mpv_handle *ctx, const char **names, mpv_node *result)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!names)
+        return MPV_ERROR_INVALID_PARAMETER;
+    return run_list_request(ctx, new_list_request(ctx, names, NULL), result);
+}
+
+int mpv_get_property_list_async(mpv_handle *ctx, uint64_t ud, const char **names)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!names)
+        return MPV_ERROR_INVALID_PARAMETER;
+    return run_list_request_async(ctx, new_list_request(ctx, names, NULL), ud);
+}
+
+int mpv_command_list(mpv_handle *ctx, mpv_node *cmds, mpv_node *result)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!cmds || cmds->format != MPV_FORMAT_NODE_ARRAY)
+        return MPV_ERROR_INVALID_PARAMETER;
+    return run_list_request(ctx, new_list_request(ctx, NULL, cmds), result);
+}
+
+int mpv_command_list_async(mpv_handle *ctx, uint64_t ud, mpv_node *cmds)
+{
+    if (!ctx->mpctx->initialized)
+        return MPV_ERROR_UNINITIALIZED;
+    if (!cmds || cmds->format != MPV_FORMAT_NODE_ARRAY)
+        return MPV_ERROR_INVALID_PARAMETER;
+    return run_list_request_async(ctx, new_list_request(ctx, NULL, cmds), ud);
+}
+
 static void property_free(void *p)
 {
     struct observe_property *prop = p;
@@ -1533,8 +1830,8 @@ static void property_free(void *p)
     }
 }
 
-int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
-                         const char *name, mpv_format format)
+static int observe_property(mpv_handle *ctx, uint64_t userdata,
+                            const char *name, mpv_format format, int delta)
 {
     const struct m_option *type = get_mp_type_get(format);
     if (format != MPV_FORMAT_NONE && !type)
@@ -1543,6 +1840,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
     if (format == MPV_FORMAT_OSD_STRING)
         return MPV_ERROR_PROPERTY_FORMAT;
 
+    mp_mutex_lock(&ctx->clients->lock);
     mp_mutex_lock(&ctx->lock);
     assert(!ctx->destroying);
     struct observe_property *prop = talloc_ptrtype(ctx, prop);
@@ -1555,6 +1853,7 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
         .reply_id = userdata,
         .format = format,
         .type = type,
+        .delta = delta,
         .change_ts = 1, // force initial event
         .refcount = 1,
         .value = m_option_value_default,
@@ -1562,17 +1861,36 @@ int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
     };
     ctx->properties_change_ts += 1;
     MP_TARRAY_APPEND(ctx, ctx->properties, ctx->num_properties, prop);
+    index_property(ctx->clients, prop);
     ctx->property_event_masks |= prop->event_mask;
     ctx->new_property_events = true;
     ctx->cur_property_index = 0;
     ctx->has_pending_properties = true;
     mp_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->clients->lock);
     mp_wakeup_core(ctx->mpctx);
     return 0;
 }
 
+int mpv_observe_property(mpv_handle *ctx, uint64_t userdata,
+                         const char *name, mpv_format format)
+{
+    return observe_property(ctx, userdata, name, format, -1);
+}
+
+int mpv_observe_property_delta(mpv_handle *ctx, uint64_t userdata,
+                               const char *name)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(delta_properties); n++) {
+        if (strcmp(delta_properties[n].name, name) == 0)
+            return observe_property(ctx, userdata, name, MPV_FORMAT_NODE, n);
+    }
+    return MPV_ERROR_NOT_IMPLEMENTED;
+}
+
 int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
 {
+    mp_mutex_lock(&ctx->clients->lock);
     mp_mutex_lock(&ctx->lock);
     int count = 0;
     for (int n = ctx->num_properties - 1; n >= 0; n--) {
@@ -1580,6 +1898,7 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
         // Perform actual removal of the property lazily to avoid creating
         // dangling pointers and such.
         if (prop->reply_id == userdata) {
+            unindex_property(ctx->clients, prop);
             prop_unref(prop);
             ctx->properties_change_ts += 1;
             MP_TARRAY_REMOVE_AT(ctx->properties, ctx->num_properties, n);
@@ -1588,6 +1907,7 @@ int mpv_unobserve_property(mpv_handle *ctx, uint64_t userdata)
         }
     }
     mp_mutex_unlock(&ctx->lock);
+    mp_mutex_unlock(&ctx->clients->lock);
     return count;
 }
 
@@ -1624,17 +1944,19 @@ void mp_client_property_change(struct MPContext *mpctx, const char *name)
 
     mp_mutex_lock(&clients->lock);
 
-    for (int n = 0; n < clients->num_clients; n++) {
-        struct mpv_handle *client = clients->clients[n];
+    // Only the observers with a matching ID need to be looked at. The index
+    // can't change while clients->lock is held, so prop stays valid.
+    struct property_observers *obs = id + 1 < clients->num_observers
+                                   ? &clients->observers[id + 1] : NULL;
+    for (int n = 0; obs && n < obs->num_props; n++) {
+        struct observe_property *prop = obs->props[n];
+        if (!property_shared_prefix(name, prop->name))
+            continue;
+        struct mpv_handle *client = prop->owner;
         mp_mutex_lock(&client->lock);
-        for (int i = 0; i < client->num_properties; i++) {
-            if (client->properties[i]->id == id &&
-                property_shared_prefix(name, client->properties[i]->name)) {
-                client->properties[i]->change_ts += 1;
-                client->has_pending_properties = true;
-                any_pending = true;
-            }
-        }
+        prop->change_ts += 1;
+        client->has_pending_properties = true;
+        any_pending = true;
         mp_mutex_unlock(&client->lock);
     }
 
@@ -1665,6 +1987,98 @@ static void notify_property_events(struct mpv_handle *ctx, int event)
         mp_dispatch_adjust_timeout(ctx->mpctx->dispatch, 0);
 }
 
+// Read the property and record the changes since the last update. This is
+// done at most once per mp_client_send_property_changes() call, no matter
+// how many clients observe the property.
+static struct delta_journal *update_delta_journal(struct MPContext *mpctx,
+                                                  int index)
+{
+    struct mp_client_api *clients = mpctx->clients;
+    struct delta_journal *j = clients->delta_journals[index];
+    if (j && j->update_round == clients->delta_round)
+        return j;
+
+    const struct delta_property *dp = &delta_properties[index];
+    struct mpv_node node = {0};
+    if (mp_property_do(dp->name, M_PROPERTY_GET_NODE, &node, mpctx) <= 0)
+        node = (struct mpv_node){0};
+
+    if (!j) {
+        j = talloc_zero(clients, struct delta_journal);
+        clients->delta_journals[index] = j;
+    } else {
+        struct mpv_node batch;
+        node_init(&batch, MPV_FORMAT_NODE_ARRAY, NULL);
+        node_array_diff(&batch, &j->value, &node, dp->keys);
+        if (batch.u.list->num) {
+            j->seq += 1;
+            struct mpv_node *slot = &j->batches[j->seq % DELTA_JOURNAL_SIZE];
+            talloc_free(node_get_alloc(slot));
+            *slot = batch;
+            talloc_steal(j, node_get_alloc(slot));
+        } else {
+            talloc_free(node_get_alloc(&batch));
+        }
+        talloc_free(node_get_alloc(&j->value));
+    }
+    j->value = node;
+    talloc_steal(j, node_get_alloc(&j->value));
+    j->update_round = clients->delta_round;
+    return j;
+}
+
+// Add the journal's changes not yet seen by prop to its pending value. If the
+// observer lags too far behind, or for the initial event, the pending value
+// becomes a reset with the full list. Return whether anything was added.
+// Call with prop->owner->lock held.
+static bool add_delta_ops(struct observe_property *prop, struct delta_journal *j)
+{
+    bool reset = !prop->delta_synced ||
+                 j->seq - prop->delta_seq >= DELTA_JOURNAL_SIZE;
+    if (!reset && j->seq == prop->delta_seq)
+        return false;
+
+    struct mpv_node *pending = (struct mpv_node *)&prop->value;
+    if (!prop->value_valid) {
+        node_init(pending, MPV_FORMAT_NODE_MAP, NULL);
+        node_map_add(pending, "ops", MPV_FORMAT_NODE_ARRAY);
+        node_map_add_int64(pending, "count", 0);
+        prop->value_valid = true;
+    }
+    struct mpv_node *ops = node_map_get(pending, "ops");
+
+    if (!reset) {
+        for (uint64_t seq = prop->delta_seq + 1; seq <= j->seq; seq++) {
+            struct mpv_node_list *batch =
+                j->batches[seq % DELTA_JOURNAL_SIZE].u.list;
+            for (int n = 0; n < batch->num; n++) {
+                node_copy(node_array_add(ops, MPV_FORMAT_NONE), ops,
+                          &batch->values[n]);
+            }
+        }
+        reset = ops->u.list->num > DELTA_MAX_PENDING;
+    }
+
+    bool have_list = j->value.format == MPV_FORMAT_NODE_ARRAY;
+    if (reset) {
+        talloc_free(ops->u.list);
+        node_init(ops, MPV_FORMAT_NODE_ARRAY, pending);
+        struct mpv_node *op = node_array_add(ops, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(op, "op", "reset");
+        struct mpv_node *entries = node_map_add(op, "entries", MPV_FORMAT_NONE);
+        if (have_list) {
+            node_copy(entries, op, &j->value);
+        } else {
+            node_init(entries, MPV_FORMAT_NODE_ARRAY, op);
+        }
+    }
+
+    node_map_get(pending, "count")->u.int64 = have_list ? j->value.u.list->num : 0;
+    prop->delta_seq = j->seq;
+    prop->delta_synced = true;
+    return true;
+}
+
 // Call with ctx->lock held (only). May temporarily drop the lock.
 static void send_client_property_changes(struct mpv_handle *ctx)
 {
@@ -1679,7 +2093,24 @@ static void send_client_property_changes(struct mpv_handle *ctx)
             continue;
 
         bool changed = false;
-        if (prop->format) {
+        if (prop->delta >= 0) {
+            // Same as below, but the property is read via the journal.
+            prop->refcount += 1;
+            ctx->async_counter += 1;
+            mp_mutex_unlock(&ctx->lock);
+            struct delta_journal *j = update_delta_journal(ctx->mpctx, prop->delta);
+            mp_mutex_lock(&ctx->lock);
+            ctx->async_counter -= 1;
+            prop_unref(prop);
+
+            if (cur_ts != ctx->properties_change_ts || ctx->destroying) {
+                mp_wakeup_core(ctx->mpctx);
+                ctx->has_pending_properties = true;
+                break;
+            }
+
+            changed = add_delta_ops(prop, j);
+        } else if (prop->format) {
             const struct m_option *type = prop->type;
             union m_option_value val = m_option_value_default;
             struct getproperty_request req = {
@@ -1754,6 +2185,8 @@ void mp_client_send_property_changes(struct MPContext *mpctx)
 {
     struct mp_client_api *clients = mpctx->clients;
 
+    clients->delta_round += 1;
+
     mp_mutex_lock(&clients->lock);
     uint64_t cur_ts = clients->clients_list_change_ts;
 
@@ -1815,6 +2248,11 @@ static bool gen_property_change_event(struct mpv_handle *ctx)
                 .format = prop->value_valid ? prop->format : 0,
                 .data = prop->value_valid ? &prop->value_ret : NULL,
             };
+            // Delta operations are returned only once.
+            if (prop->delta >= 0 && prop->value_valid) {
+                m_option_free(prop->type, &prop->value);
+                prop->value_valid = false;
+            }
             *ctx->cur_event = (struct mpv_event){
                 .event_id = MPV_EVENT_PROPERTY_CHANGE,
                 .reply_userdata = prop->reply_id,
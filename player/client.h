@@ -36,6 +36,9 @@ struct mpv_handle *mp_new_client(struct mp_client_api *clients, const char *name
 void mp_client_set_weak(struct mpv_handle *ctx);
 struct mp_log *mp_client_get_log(struct mpv_handle *ctx);
 struct mpv_global *mp_client_get_global(struct mpv_handle *ctx);
+// Like mpv_command_string(), but sends MPV_EVENT_COMMAND_REPLY when done.
+int mp_client_command_string_async(struct mpv_handle *ctx, uint64_t ud,
+                                   const char *args);
 
 void mp_client_broadcast_event_external(struct mp_client_api *api, int event,
                                         void *data);
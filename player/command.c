@@ -85,6 +85,8 @@
 struct command_ctx {
     // All properties, terminated with a {0} item.
     struct m_property *properties;
+    // Name lookup for properties; built once, after which the list is fixed.
+    struct m_property_index *prop_index;
 
     double last_seek_time;
     double last_seek_pts;
@@ -114,6 +116,7 @@ struct command_ctx {
 
     char **script_props;
     mpv_node udata;
+    struct node_map_index *udata_index; // key lookups in large udata maps
     mpv_node mdata;
 
     double cached_window_scale;
@@ -2860,6 +2863,22 @@ static int mp_property_perf_info(void *ctx, struct m_property *p, int action,
     return M_PROPERTY_NOT_IMPLEMENTED;
 }
 
+static int mp_property_startup_timeline(void *ctx, struct m_property *p,
+                                        int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+
+    switch (action) {
+    case M_PROPERTY_GET_TYPE:
+        *(struct m_option *)arg = (struct m_option){.type = CONF_TYPE_NODE};
+        return M_PROPERTY_OK;
+    case M_PROPERTY_GET:
+        mp_startup_timeline(mpctx, (struct mpv_node *)arg);
+        return M_PROPERTY_OK;
+    }
+    return M_PROPERTY_NOT_IMPLEMENTED;
+}
+
 static int mp_property_vo(void *ctx, struct m_property *p, int action, void *arg)
 {
     MPContext *mpctx = ctx;
@@ -3306,8 +3325,9 @@ static int mp_property_playlist(void *ctx, struct m_property *prop,
         struct playlist *pl = mpctx->playlist;
         char *res = talloc_strdup(NULL, "");
 
-        for (int n = 0; n < pl->num_entries; n++) {
-            struct playlist_entry *e = pl->entries[n];
+        for (struct playlist_entry *e = playlist_get_first(pl); e;
+             e = playlist_entry_get_rel(e, 1))
+        {
             res =  talloc_strdup_append(res, pl->current == e ? list_current
                                                               : list_normal);
             char *p = e->title;
@@ -3855,6 +3875,7 @@ struct udata_ctx {
 static int do_op_udata(struct udata_ctx* ctx, int action, void *arg)
 {
     MPContext *mpctx = ctx->mpctx;
+    struct node_map_index *index = mpctx->command_ctx->udata_index;
     mpv_node *node = ctx->node;
 
     switch (action) {
@@ -3875,6 +3896,10 @@ static int do_op_udata(struct udata_ctx* ctx, int action, void *arg)
     case M_PROPERTY_SET:
     case M_PROPERTY_SET_NODE:
         assert(node);
+        // This frees all maps below the node.
+        if (node->format == MPV_FORMAT_NODE_MAP ||
+            node->format == MPV_FORMAT_NODE_ARRAY)
+            node_map_index_reset(index);
         m_option_copy(&udata_type, node, arg);
         talloc_steal(ctx->ta_parent, node_get_alloc(node));
         mp_notify_property(mpctx, ctx->path);
@@ -3899,17 +3924,15 @@ static int do_op_udata(struct udata_ctx* ctx, int action, void *arg)
 
         if (!has_split && act->action == M_PROPERTY_DELETE) {
             // Find the object we're looking for
-            int i;
-            for (i = 0; i < node->u.list->num; i++) {
-                if (bstr_equals0(key, node->u.list->keys[i]))
-                    break;
-            }
+            mpv_node *cnode = node_map_index_get(index, node, key);
 
             // Return if it didn't exist
-            if (i == node->u.list->num)
+            if (!cnode)
                 return M_PROPERTY_UNKNOWN;
 
             // Delete the item
+            int i = cnode - node->u.list->values;
+            node_map_index_reset(index);
             m_option_free(&udata_type, &node->u.list->values[i]);
             talloc_free(node->u.list->keys[i]);
 
@@ -3926,7 +3949,7 @@ static int do_op_udata(struct udata_ctx* ctx, int action, void *arg)
         }
 
         // Look up the next level down
-        mpv_node *cnode = node_map_bget(node, key);
+        mpv_node *cnode = node_map_index_get(index, node, key);
 
         if (!cnode) {
             switch (act->action) {
@@ -4134,6 +4157,7 @@ static const struct m_property mp_properties_base[] = {
     {"vo-configured", mp_property_vo_configured},
     {"vo-passes", mp_property_vo_passes},
     {"perf-info", mp_property_perf_info},
+    {"startup-timeline", mp_property_startup_timeline},
     {"current-vo", mp_property_vo},
     {"current-gpu-context", mp_property_gpu_context},
     {"container-fps", mp_property_fps},
@@ -4333,11 +4357,14 @@ uint64_t mp_get_property_event_mask(const char *name)
 int mp_get_property_id(struct MPContext *mpctx, const char *name)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    for (int n = 0; ctx->properties[n].name; n++) {
-        if (match_property(ctx->properties[n].name, name))
-            return n;
-    }
-    return -1;
+    // Same as match_property() against each entry, since no property name
+    // contains a '/': only the top-level name is relevant.
+    bstr prefix;
+    char *rem;
+    if (strncmp(name, "options/", 8) == 0)
+        name += 8;
+    m_property_split_path(name, &prefix, &rem);
+    return m_property_index_get_pos(ctx->prop_index, prefix);
 }
 
 static bool is_property_set(int action, void *val)
@@ -4362,7 +4389,7 @@ int mp_property_do(const char *name, int action, void *val,
                    struct MPContext *ctx)
 {
     struct command_ctx *cmd = ctx->command_ctx;
-    int r = m_property_do(ctx->log, cmd->properties, name, action, val, ctx);
+    int r = m_property_do(ctx->log, cmd->prop_index, name, action, val, ctx);
 
     if (mp_msg_test(ctx->log, MSGL_V) && is_property_set(action, val)) {
         struct m_option ot = {0};
@@ -4387,7 +4414,7 @@ int mp_property_do(const char *name, int action, void *val,
 char *mp_property_expand_string(struct MPContext *mpctx, const char *str)
 {
     struct command_ctx *ctx = mpctx->command_ctx;
-    return m_properties_expand_string(ctx->properties, str, mpctx);
+    return m_properties_expand_string(ctx->prop_index, str, mpctx);
 }
 
 // Before expanding properties, parse C-style escapes like "\n"
@@ -6677,6 +6704,23 @@ static void cmd_dump_cache(void *p)
     run_dump_cmd(cmd, cmd->args[0].v.d, cmd->args[1].v.d, cmd->args[2].v.s);
 }
 
+static void cmd_write_stats_trace(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    char *file = cmd->args[0].v.s;
+
+    if (!file || !file[0])
+        file = mpctx->opts->stats_trace;
+    if (!file || !file[0]) {
+        MP_ERR(mpctx, "No stats trace filename given and --stats-trace not set.\n");
+        cmd->success = false;
+        return;
+    }
+
+    cmd->success = mp_write_stats_trace(mpctx, file);
+}
+
 static void cmd_dump_cache_ab(void *p)
 {
     struct mp_cmd_ctx *cmd = p;
@@ -6954,6 +6998,17 @@ const struct mp_cmd_def mp_cmds[] = {
                 OPTDEF_INT(2)},
         },
     },
+    { "screenshot-thumbnails", cmd_screenshot_thumbnails,
+        {
+            {"times", OPT_STRING(v.s)},
+            {"filename", OPT_STRING(v.s)},
+            {"width", OPT_INT(v.i), M_RANGE(16, 4096), OPTDEF_INT(160)},
+            {"columns", OPT_INT(v.i), M_RANGE(0, 1000), OPTDEF_INT(0)},
+        },
+        .spawn_thread = true,
+        .can_abort = true,
+        .abort_on_playback_end = true,
+    },
     { "loadfile", cmd_loadfile,
         {
             {"url", OPT_STRING(v.s)},
@@ -7169,6 +7224,9 @@ const struct mp_cmd_def mp_cmds[] = {
         .exec_async = true,
         .can_abort = true,
     },
+    { "write-stats-trace", cmd_write_stats_trace,
+        { {"filename", OPT_STRING(v.s), .flags = MP_CMD_OPT_ARG} },
+    },
 
     { "ab-loop-dump-cache", cmd_dump_cache_ab, { {"filename", OPT_STRING(v.s)} },
         .exec_async = true,
@@ -7269,11 +7327,14 @@ void command_init(struct MPContext *mpctx)
         ctx->properties[count++] = prop;
     }
 
+    ctx->prop_index = m_property_index_create(ctx, ctx->properties);
+
     node_init(&ctx->mdata, MPV_FORMAT_NODE_ARRAY, NULL);
     talloc_steal(ctx, ctx->mdata.u.list);
 
     node_init(&ctx->udata, MPV_FORMAT_NODE_MAP, NULL);
     talloc_steal(ctx, ctx->udata.u.list);
+    ctx->udata_index = node_map_index_create(ctx);
     talloc_free(prop_names);
 }
 
@@ -7589,6 +7650,9 @@ void mp_option_change_callback(void *ctx, struct m_config_option *co, int flags,
         && mpctx->vo_chain->is_sparse && !mpctx->ao_chain
         && mpctx->video_status == STATUS_DRAINING)
         mpctx->time_frame = opts->image_display_duration;
+
+    if (opt_ptr == &opts->stats_trace && opts->stats_trace && opts->stats_trace[0])
+        stats_global_enable_trace(mpctx->global);
 }
 
 void mp_notify_property(struct MPContext *mpctx, const char *property)
@@ -50,12 +50,35 @@
 #include "core.h"
 #include "command.h"
 
+// Return the path of the parsed config snapshot for the given config file.
+static char *get_config_snapshot_filename(void *talloc_ctx,
+                                          struct MPContext *mpctx,
+                                          const char *file)
+{
+    uint8_t md5[16];
+    av_md5_sum(md5, file, strlen(file));
+    char *name = talloc_strdup(NULL, "config-snapshots/");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", md5[i]);
+    char *res = mp_find_user_file(talloc_ctx, mpctx->global, "cache", name);
+    talloc_free(name);
+    return res;
+}
+
 static void load_all_cfgfiles(struct MPContext *mpctx, char *section,
                               char *filename)
 {
+    struct MPOpts *opts = mpctx->opts;
     char **cf = mp_find_all_config_files(NULL, mpctx->global, filename);
-    for (int i = 0; cf && cf[i]; i++)
-        m_config_parse_config_file(mpctx->mconfig, mpctx->global, cf[i], section, 0);
+    if (cf && cf[0] && opts->config_snapshot)
+        mp_mk_user_dir(mpctx->global, "cache", "config-snapshots");
+    for (int i = 0; cf && cf[i]; i++) {
+        char *snapshot = NULL;
+        if (opts->config_snapshot)
+            snapshot = get_config_snapshot_filename(cf, mpctx, cf[i]);
+        m_config_parse_config_file_snapshot(mpctx->mconfig, mpctx->global,
+                                            cf[i], snapshot, section, 0);
+    }
     talloc_free(cf);
 }
 
@@ -457,8 +480,9 @@ struct playlist_entry *mp_check_playlist_resume(struct MPContext *mpctx,
 {
     if (!mpctx->opts->position_resume)
         return NULL;
-    for (int n = 0; n < playlist->num_entries; n++) {
-        struct playlist_entry *e = playlist->entries[n];
+    for (struct playlist_entry *e = playlist_get_first(playlist); e;
+         e = playlist_entry_get_rel(e, 1))
+    {
         char *conf = mp_get_playback_resume_config_filename(mpctx, e->filename);
         bool exists = conf && mp_path_exists(conf);
         talloc_free(conf);
@@ -237,6 +237,11 @@ typedef struct MPContext {
     struct MPOpts *opts;
     struct mp_log *log;
     struct stats_ctx *stats;
+    // Startup timeline, see mp_startup_begin().
+    int64_t startup_ts;
+    struct startup_span *startup_spans;
+    int num_startup_spans;
+    bool startup_done;
     struct m_config *mconfig;
     struct input_ctx *input;
     struct mp_client_api *clients;
@@ -250,6 +255,9 @@ typedef struct MPContext {
     int64_t outstanding_async;
 
     struct mp_thread_pool *thread_pool; // for coarse I/O, often during loading
+    // Directory listings for autoload_external_files(); protected by the core
+    // lock.
+    struct external_files_cache *external_files_cache;
 
     struct mp_log *statusline;
     struct osd_state *osd;
@@ -279,6 +287,11 @@ typedef struct MPContext {
     char *stream_open_filename;
     char **playlist_paths; // used strictly for playlist validation
     int playlist_paths_len;
+    // Directory playlist that is still scanned in the background. New entries
+    // are inserted after dir_scan_last (which has a reference).
+    struct demux_dir_scan *dir_scan;
+    struct playlist_entry *dir_scan_last;
+    char *dir_scan_path;
     enum stop_play_reason stop_play;
     bool playback_initialized; // playloop can be run/is running
     int error_playing;
@@ -539,6 +552,7 @@ void print_track_list(struct MPContext *mpctx, const char *msg);
 void reselect_demux_stream(struct MPContext *mpctx, struct track *track,
                            bool refresh_only);
 void prepare_playlist(struct MPContext *mpctx, struct playlist *pl);
+void handle_dir_scan(struct MPContext *mpctx);
 void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel);
 struct track *select_default_track(struct MPContext *mpctx, int order,
                                    enum stream_type type);
@@ -552,6 +566,11 @@ void mp_destroy(struct MPContext *mpctx);
 void mp_print_version(struct mp_log *log, int always);
 void mp_update_logging(struct MPContext *mpctx, bool preinit);
 void issue_refresh_seek(struct MPContext *mpctx, enum seek_precision min_prec);
+bool mp_write_stats_trace(struct MPContext *mpctx, const char *file);
+void mp_startup_begin(struct MPContext *mpctx, const char *name);
+void mp_startup_end(struct MPContext *mpctx, const char *name);
+void mp_startup_finish(struct MPContext *mpctx);
+void mp_startup_timeline(struct MPContext *mpctx, struct mpv_node *dst);
 
 // misc.c
 double rel_time_to_abs(struct MPContext *mpctx, struct m_rel_time t);
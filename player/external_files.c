@@ -18,6 +18,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "osdep/io.h"
 
@@ -85,7 +87,110 @@ static int compare_sub_priority(const void *a, const void *b)
     return strcoll(s1->fname, s2->fname);
 }
 
+// A directory entry, with the parts of the name needed for matching.
+struct dir_file {
+    bstr name;      // converted from UTF-8-MAC
+    bstr ext;       // (all of these point into name)
+    bstr trim;      // name without extension and surrounding whitespace
+    bstr lang;      // mp_guess_lang_from_filename()
+    int lang_start;
+};
+
+struct dir_listing {
+    char *path;
+    time_t mtime;
+    dev_t dev;
+    ino_t ino;
+    // The directory was modified in the same second the listing was read, so
+    // a later change might not update mtime. Such listings are not reused.
+    bool racy;
+    struct dir_file *files;
+    int num_files;
+};
+
+#define MAX_CACHED_DIRS 16
+
+struct external_files_cache {
+    struct dir_listing **dirs; // least recently used first
+    int num_dirs;
+};
+
+struct external_files_cache *external_files_cache_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct external_files_cache);
+}
+
+static struct dir_listing *read_dir_listing(void *ta_parent, struct mp_log *log,
+                                            const char *path, struct stat *st)
+{
+    DIR *d = opendir(path);
+    if (!d)
+        return NULL;
+    struct dir_listing *dl = talloc_zero(ta_parent, struct dir_listing);
+    dl->path = talloc_strdup(dl, path);
+    dl->mtime = st->st_mtime;
+    dl->dev = st->st_dev;
+    dl->ino = st->st_ino;
+    dl->racy = st->st_mtime >= time(NULL);
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        bstr den = bstr0(de->d_name);
+        bstr dename = mp_iconv_to_utf8(log, den, "UTF-8-MAC",
+                                       MP_NO_LATIN1_FALLBACK);
+        struct dir_file f = {.name = bstrdup(dl, dename)};
+        if (den.start != dename.start)
+            talloc_free(dename.start);
+        f.ext = bstr_get_ext(f.name);
+        f.trim = bstr_strip(bstr_strip_ext(f.name));
+        f.lang = mp_guess_lang_from_filename(f.name, &f.lang_start);
+        MP_TARRAY_APPEND(dl, dl->files, dl->num_files, f);
+    }
+    closedir(d);
+    return dl;
+}
+
+// Return the listing of the directory, reading it only if it isn't cached or
+// has changed. The result is owned by cache if it's not NULL, and by ta_parent
+// otherwise.
+static struct dir_listing *get_dir_listing(struct external_files_cache *cache,
+                                           void *ta_parent, struct mp_log *log,
+                                           const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) || !S_ISDIR(st.st_mode))
+        return NULL;
+    if (!cache)
+        return read_dir_listing(ta_parent, log, path, &st);
+
+    for (int n = 0; n < cache->num_dirs; n++) {
+        struct dir_listing *dl = cache->dirs[n];
+        if (strcmp(dl->path, path) != 0)
+            continue;
+        MP_TARRAY_REMOVE_AT(cache->dirs, cache->num_dirs, n);
+        if (!dl->racy && dl->mtime == st.st_mtime && dl->dev == st.st_dev &&
+            dl->ino == st.st_ino)
+        {
+            mp_trace(log, "Using cached listing of %s\n", path);
+            MP_TARRAY_APPEND(cache, cache->dirs, cache->num_dirs, dl);
+            return dl;
+        }
+        talloc_free(dl);
+        break;
+    }
+
+    struct dir_listing *dl = read_dir_listing(cache, log, path, &st);
+    if (!dl)
+        return NULL;
+    if (cache->num_dirs >= MAX_CACHED_DIRS) {
+        talloc_free(cache->dirs[0]);
+        MP_TARRAY_REMOVE_AT(cache->dirs, cache->num_dirs, 0);
+    }
+    MP_TARRAY_APPEND(cache, cache->dirs, cache->num_dirs, dl);
+    return dl;
+}
+
 static void append_dir_subtitles(struct mpv_global *global, struct MPOpts *opts,
+                                 struct external_files_cache *cache,
                                  struct subfn **slist, int *nsub,
                                  struct bstr path, const char *fname,
                                  int limit_fuzziness, int limit_type)
@@ -107,26 +212,15 @@ static void append_dir_subtitles(struct mpv_global *global, struct MPOpts *opts,
     if (mp_is_url(bstr0(path0)))
         goto out;
 
-    DIR *d = opendir(path0);
-    if (!d)
+    struct dir_listing *dl = get_dir_listing(cache, tmpmem, log, path0);
+    if (!dl)
         goto out;
     mp_verbose(log, "Loading external files in %.*s\n", BSTR_P(path));
-    struct dirent *de;
-    while ((de = readdir(d))) {
-        void *tmpmem2 = talloc_new(tmpmem);
-        struct bstr den = bstr0(de->d_name);
-        struct bstr dename = mp_iconv_to_utf8(log, den,
-                                              "UTF-8-MAC", MP_NO_LATIN1_FALLBACK);
-        // retrieve various parts of the filename
-        struct bstr tmp_fname_noext = bstrdup(tmpmem2, bstr_strip_ext(dename));
-        struct bstr tmp_fname_ext = bstr_get_ext(dename);
-        struct bstr tmp_fname_trim = bstr_strip(tmp_fname_noext);
-
-        if (den.start != dename.start)
-            talloc_steal(tmpmem2, dename.start);
+    for (int i = 0; i < dl->num_files; i++) {
+        struct dir_file *f = &dl->files[i];
 
         // check what it is (most likely)
-        int type = test_ext(opts, tmp_fname_ext);
+        int type = test_ext(opts, f->ext);
         char **langs = NULL;
         int fuzz = -1;
         switch (type) {
@@ -144,20 +238,18 @@ static void append_dir_subtitles(struct mpv_global *global, struct MPOpts *opts,
         }
 
         if (fuzz < 0 || (limit_type >= 0 && limit_type != type))
-            goto next_sub;
+            continue;
 
         // we have a (likely) subtitle file
         // higher prio -> auto-selection may prefer it (0 = not loaded)
         int prio = 0;
 
-        if (bstrcasecmp(tmp_fname_trim, f_fname_trim) == 0)
+        if (bstrcasecmp(f->trim, f_fname_trim) == 0)
             prio |= 32; // exact movie name match
 
-        bstr lang = {0};
-        int start = 0;
-        lang = mp_guess_lang_from_filename(dename, &start);
-        if (bstr_case_startswith(tmp_fname_trim, f_fname_trim)) {
-            if (lang.len && start == f_fname_trim.len)
+        bstr lang = f->lang;
+        if (bstr_case_startswith(f->trim, f_fname_trim)) {
+            if (lang.len && f->lang_start == f_fname_trim.len)
                 prio |= 16; // exact movie name + followed by lang
 
             if (lang.len && fuzz >= 1)
@@ -172,22 +264,22 @@ static void append_dir_subtitles(struct mpv_global *global, struct MPOpts *opts,
             }
         }
 
-        if (bstr_find(tmp_fname_trim, f_fname_trim) >= 0 && fuzz >= 1)
+        if (bstr_find(f->trim, f_fname_trim) >= 0 && fuzz >= 1)
             prio |= 2; // contains the movie name
 
         if (type == STREAM_VIDEO && prio == 0)
-            prio = test_cover_filename(tmp_fname_trim, opts->coverart_whitelist);
+            prio = test_cover_filename(f->trim, opts->coverart_whitelist);
 
         // doesn't contain the movie name
         // don't try in the mplayer subtitle directory
         if (!limit_fuzziness && fuzz >= 2)
             prio |= 1;
 
-        mp_trace(log, "Potential external file: \"%s\"  Priority: %d\n",
-               de->d_name, prio);
+        mp_trace(log, "Potential external file: \"%.*s\"  Priority: %d\n",
+                 BSTR_P(f->name), prio);
 
         if (prio) {
-            char *subpath = mp_path_join_bstr(*slist, path, dename);
+            char *subpath = mp_path_join_bstr(*slist, path, f->name);
             if (mp_path_exists(subpath)) {
                 MP_TARRAY_GROW(NULL, *slist, *nsub);
                 struct subfn *sub = *slist + (*nsub)++;
@@ -203,11 +295,7 @@ static void append_dir_subtitles(struct mpv_global *global, struct MPOpts *opts,
             } else
                 talloc_free(subpath);
         }
-
-    next_sub:
-        talloc_free(tmpmem2);
     }
-    closedir(d);
 
  out:
     talloc_free(tmpmem);
@@ -241,6 +329,7 @@ static void filter_subidx(struct subfn **slist, int *nsub)
 }
 
 static void load_paths(struct mpv_global *global, struct MPOpts *opts,
+                       struct external_files_cache *cache,
                        struct subfn **slist, int *nsubs, const char *fname,
                        char **paths, char *cfg_path, int type)
 {
@@ -249,7 +338,7 @@ static void load_paths(struct mpv_global *global, struct MPOpts *opts,
         char *path = mp_path_join_bstr(
             *slist, mp_dirname(fname),
             bstr0(expanded_path ? expanded_path : paths[i]));
-        append_dir_subtitles(global, opts, slist, nsubs, bstr0(path),
+        append_dir_subtitles(global, opts, cache, slist, nsubs, bstr0(path),
                              fname, 0, type);
         talloc_free(expanded_path);
     }
@@ -257,32 +346,35 @@ static void load_paths(struct mpv_global *global, struct MPOpts *opts,
     // Load subtitles in ~/.mpv/sub (or similar) limiting sub fuzziness
     char *mp_subdir = mp_find_config_file(NULL, global, cfg_path);
     if (mp_subdir) {
-        append_dir_subtitles(global, opts, slist, nsubs, bstr0(mp_subdir),
-                             fname, 1, type);
+        append_dir_subtitles(global, opts, cache, slist, nsubs,
+                             bstr0(mp_subdir), fname, 1, type);
     }
     talloc_free(mp_subdir);
 }
 
 // Return a list of subtitles and audio files found, sorted by priority.
 // Last element is terminated with a fname==NULL entry.
+// cache can be NULL. Otherwise, it must not be used concurrently.
 struct subfn *find_external_files(struct mpv_global *global, const char *fname,
-                                  struct MPOpts *opts)
+                                  struct MPOpts *opts,
+                                  struct external_files_cache *cache)
 {
     struct subfn *slist = talloc_array_ptrtype(NULL, slist, 1);
     int n = 0;
 
     // Load subtitles from current media directory
-    append_dir_subtitles(global, opts, &slist, &n, mp_dirname(fname), fname, 0, -1);
+    append_dir_subtitles(global, opts, cache, &slist, &n, mp_dirname(fname),
+                         fname, 0, -1);
 
     // Load subtitles in dirs specified by sub-paths option
     if (opts->sub_auto >= 0) {
-        load_paths(global, opts, &slist, &n, fname, opts->sub_paths, "sub",
-                   STREAM_SUB);
+        load_paths(global, opts, cache, &slist, &n, fname, opts->sub_paths,
+                   "sub", STREAM_SUB);
     }
 
     if (opts->audiofile_auto >= 0) {
-        load_paths(global, opts, &slist, &n, fname, opts->audiofile_paths,
-                   "audio", STREAM_AUDIO);
+        load_paths(global, opts, cache, &slist, &n, fname,
+                   opts->audiofile_paths, "audio", STREAM_AUDIO);
     }
 
     // Sort by name for filter_subidx()
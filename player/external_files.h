@@ -29,8 +29,14 @@ struct subfn {
 
 struct mpv_global;
 struct MPOpts;
+struct external_files_cache;
+
+// Caches directory listings between find_external_files() calls.
+struct external_files_cache *external_files_cache_create(void *ta_parent);
+
 struct subfn *find_external_files(struct mpv_global *global, const char *fname,
-                                  struct MPOpts *opts);
+                                  struct MPOpts *opts,
+                                  struct external_files_cache *cache);
 
 bool mp_might_be_subtitle_file(const char *filename);
 void mp_update_subtitle_exts(struct MPOpts *opts);
@@ -862,44 +862,70 @@ bool mp_remove_track(struct MPContext *mpctx, struct track *track)
 
 // Add the given file as additional track. The filter argument controls how or
 // if tracks are auto-selected at any point.
-// To be run on a worker thread, locked (temporarily unlocks core).
-// cancel will generally be used to abort the loading process, but on success
-// the demuxer is changed to be slaved to mpctx->playback_abort instead.
-int mp_add_external_file(struct MPContext *mpctx, char *filename,
-                         enum stream_type filter, struct mp_cancel *cancel,
-                         bool cover_art)
+// State for opening an external file. The opening itself can run without
+// the core lock, and on any thread.
+struct external_open {
+    struct MPContext *mpctx;
+    char *filename;
+    enum stream_type filter;
+    struct mp_cancel *cancel;
+    struct demuxer_params params;
+    struct demuxer *demuxer;
+    struct external_open_batch *batch;
+};
+
+static void init_external_open(struct MPContext *mpctx, struct external_open *eo,
+                               char *filename, enum stream_type filter,
+                               struct mp_cancel *cancel)
 {
     struct MPOpts *opts = mpctx->opts;
-    if (!filename || mp_cancel_test(cancel))
-        return -1;
-
-    char *disp_filename = filename;
-    if (strncmp(disp_filename, "memory://", 9) == 0)
-        disp_filename = "memory://"; // avoid noise
 
-    struct demuxer_params params = {
-        .is_top_level = true,
-        .stream_flags = STREAM_ORIGIN_DIRECT,
-        .allow_playlist_create = false,
+    *eo = (struct external_open){
+        .mpctx = mpctx,
+        .filename = filename,
+        .filter = filter,
+        .cancel = cancel,
+        .params = {
+            .is_top_level = true,
+            .stream_flags = STREAM_ORIGIN_DIRECT,
+            .allow_playlist_create = false,
+        },
     };
 
     switch (filter) {
     case STREAM_SUB:
-        params.force_format = opts->sub_demuxer_name;
+        eo->params.force_format = opts->sub_demuxer_name;
         break;
     case STREAM_AUDIO:
-        params.force_format = opts->audio_demuxer_name;
+        eo->params.force_format = opts->audio_demuxer_name;
         break;
     }
+}
 
-    mp_core_unlock(mpctx);
+// Core unlocked.
+static void open_external(struct external_open *eo)
+{
+    struct MPContext *mpctx = eo->mpctx;
+    eo->demuxer = demux_open_url(eo->filename, &eo->params, eo->cancel,
+                                 mpctx->global);
+    if (eo->demuxer)
+        enable_demux_thread(mpctx, eo->demuxer);
+}
 
-    struct demuxer *demuxer =
-        demux_open_url(filename, &params, cancel, mpctx->global);
-    if (demuxer)
-        enable_demux_thread(mpctx, demuxer);
+// Add the tracks of the demuxer opened by open_external(), which is consumed.
+// Core locked.
+static int add_external_demuxer(struct MPContext *mpctx,
+                                struct external_open *eo, bool cover_art)
+{
+    struct MPOpts *opts = mpctx->opts;
+    struct demuxer *demuxer = eo->demuxer;
+    char *filename = eo->filename;
+    enum stream_type filter = eo->filter;
+    eo->demuxer = NULL;
 
-    mp_core_lock(mpctx);
+    char *disp_filename = filename;
+    if (strncmp(disp_filename, "memory://", 9) == 0)
+        disp_filename = "memory://"; // avoid noise
 
     // The command could have overlapped with playback exiting. (We don't care
     // if playback has started again meanwhile - weird, but not a problem.)
@@ -954,11 +980,77 @@ int mp_add_external_file(struct MPContext *mpctx, char *filename,
 
 err_out:
     demux_cancel_and_free(demuxer);
-    if (!mp_cancel_test(cancel))
+    if (!mp_cancel_test(eo->cancel))
         MP_ERR(mpctx, "Can not open external file %s.\n", disp_filename);
     return -1;
 }
 
+// To be run on a worker thread, locked (temporarily unlocks core).
+// cancel will generally be used to abort the loading process, but on success
+// the demuxer is changed to be slaved to mpctx->playback_abort instead.
+int mp_add_external_file(struct MPContext *mpctx, char *filename,
+                         enum stream_type filter, struct mp_cancel *cancel,
+                         bool cover_art)
+{
+    if (!filename || mp_cancel_test(cancel))
+        return -1;
+
+    struct external_open eo;
+    init_external_open(mpctx, &eo, filename, filter, cancel);
+
+    mp_core_unlock(mpctx);
+    open_external(&eo);
+    mp_core_lock(mpctx);
+
+    return add_external_demuxer(mpctx, &eo, cover_art);
+}
+
+struct external_open_batch {
+    mp_mutex lock;
+    mp_cond wakeup;
+    int pending;
+};
+
+static void open_external_worker(void *p)
+{
+    struct external_open *eo = p;
+    struct external_open_batch *batch = eo->batch;
+
+    open_external(eo);
+
+    mp_mutex_lock(&batch->lock);
+    batch->pending--;
+    mp_cond_broadcast(&batch->wakeup);
+    mp_mutex_unlock(&batch->lock);
+}
+
+// Open all files concurrently on the thread pool, and wait until all are done.
+// Files for which no thread could be reserved are opened on the caller's
+// thread, so this never waits on work queued behind the caller.
+// Core unlocked.
+static void open_external_batch(struct MPContext *mpctx,
+                                struct external_open *list, int num)
+{
+    struct external_open_batch batch = {.pending = num};
+    mp_mutex_init(&batch.lock);
+    mp_cond_init(&batch.wakeup);
+
+    for (int n = 0; n < num; n++) {
+        list[n].batch = &batch;
+        if (!mp_thread_pool_run(mpctx->thread_pool, open_external_worker,
+                                &list[n]))
+            open_external_worker(&list[n]);
+    }
+
+    mp_mutex_lock(&batch.lock);
+    while (batch.pending)
+        mp_cond_wait(&batch.wakeup, &batch.lock);
+    mp_mutex_unlock(&batch.lock);
+
+    mp_cond_destroy(&batch.wakeup);
+    mp_mutex_destroy(&batch.lock);
+}
+
 // to be run on a worker thread, locked (temporarily unlocks core)
 static void open_external_files(struct MPContext *mpctx, char **files,
                                 enum stream_type filter)
@@ -986,7 +1078,8 @@ void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel)
         return;
 
     void *tmp = talloc_new(NULL);
-    struct subfn *list = find_external_files(mpctx->global, mpctx->filename, opts);
+    struct subfn *list = find_external_files(mpctx->global, mpctx->filename, opts,
+                                             mpctx->external_files_cache);
     talloc_steal(tmp, list);
 
     int sc[STREAM_TYPE_COUNT] = {0};
@@ -995,6 +1088,10 @@ void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel)
             sc[mpctx->tracks[n]->type]++;
     }
 
+    struct external_open *opens = NULL;
+    struct subfn **entries = NULL;
+    int num_opens = 0, num_entries = 0;
+
     for (int i = 0; list && list[i].fname; i++) {
         struct subfn *e = &list[i];
 
@@ -1010,11 +1107,30 @@ void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel)
         if (e->type == STREAM_VIDEO && (sc[STREAM_VIDEO] || !sc[STREAM_AUDIO]))
             goto skip;
 
+        struct external_open eo;
+        init_external_open(mpctx, &eo, e->fname, e->type, cancel);
+        MP_TARRAY_APPEND(tmp, opens, num_opens, eo);
+        MP_TARRAY_APPEND(tmp, entries, num_entries, e);
+    skip:;
+    }
+
+    if (!num_opens || mp_cancel_test(cancel))
+        goto done;
+
+    mp_core_unlock(mpctx);
+    open_external_batch(mpctx, opens, num_opens);
+    mp_core_lock(mpctx);
+
+    // Add the tracks in the order of the list, regardless of which file
+    // finished opening first.
+    for (int i = 0; i < num_opens; i++) {
+        struct subfn *e = entries[i];
+
         // when given filter is set to video, we are loading up cover art
-        int first = mp_add_external_file(mpctx, e->fname, e->type, cancel,
+        int first = add_external_demuxer(mpctx, &opens[i],
                                          e->type == STREAM_VIDEO);
         if (first < 0)
-            goto skip;
+            continue;
 
         for (int n = first; n < mpctx->num_tracks; n++) {
             struct track *t = mpctx->tracks[n];
@@ -1022,9 +1138,9 @@ void autoload_external_files(struct MPContext *mpctx, struct mp_cancel *cancel)
             if (!t->lang)
                 t->lang = talloc_strdup(t, e->lang);
         }
-    skip:;
     }
 
+done:
     talloc_free(tmp);
 }
 
@@ -1078,8 +1194,98 @@ static void transfer_playlist(struct MPContext *mpctx, struct playlist *pl,
     }
 }
 
+static void stop_dir_scan(struct MPContext *mpctx)
+{
+    TA_FREEP(&mpctx->dir_scan);
+    if (mpctx->dir_scan_last)
+        playlist_entry_unref(mpctx->dir_scan_last);
+    mpctx->dir_scan_last = NULL;
+    TA_FREEP(&mpctx->dir_scan_path);
+}
+
+static void set_dir_scan_last(struct MPContext *mpctx, struct playlist_entry *e)
+{
+    e->reserved++;
+    if (mpctx->dir_scan_last)
+        playlist_entry_unref(mpctx->dir_scan_last);
+    mpctx->dir_scan_last = e;
+}
+
+// Insert the entries of the background directory scan that are ready after the
+// ones inserted before. If wait is set, block until there are new entries.
+static void read_dir_scan(struct MPContext *mpctx, bool wait)
+{
+    if (!mpctx->dir_scan)
+        return;
+
+    if (mpctx->dir_scan_last->pl != mpctx->playlist) {
+        MP_VERBOSE(mpctx, "Directory entries were removed, stopping scan.\n");
+        stop_dir_scan(mpctx);
+        return;
+    }
+
+    struct playlist *pl = talloc_zero(NULL, struct playlist);
+    // Don't let the transfer reset these.
+    pl->playlist_completed = mpctx->playlist->playlist_completed;
+    pl->playlist_started = mpctx->playlist->playlist_started;
+    bool more = demux_dir_scan_read(mpctx->dir_scan, pl, wait);
+    if (pl->num_entries) {
+        int index = playlist_entry_to_index(mpctx->playlist,
+                                            mpctx->dir_scan_last) + 1;
+        int num = pl->num_entries;
+        playlist_populate_playlist_path(pl, mpctx->dir_scan_path);
+        playlist_transfer_entries_to(mpctx->playlist, index, pl);
+        set_dir_scan_last(mpctx,
+                          playlist_entry_from_index(mpctx->playlist, index + num - 1));
+        mp_notify_property(mpctx, "playlist");
+    }
+    talloc_free(pl);
+
+    if (!more)
+        stop_dir_scan(mpctx);
+}
+
+void handle_dir_scan(struct MPContext *mpctx)
+{
+    read_dir_scan(mpctx, false);
+}
+
+// Take over the rest of the directory scan of the current demuxer. last is the
+// last entry of its playlist.
+static void start_dir_scan(struct MPContext *mpctx, struct playlist_entry *last)
+{
+    // Only 1 scan is done in the background. Keep what the previous one found
+    // so far, and cancel the rest instead of blocking until it's done.
+    read_dir_scan(mpctx, false);
+    if (mpctx->dir_scan)
+        MP_VERBOSE(mpctx, "Stopping unfinished directory scan.\n");
+    stop_dir_scan(mpctx);
+
+    mpctx->dir_scan = talloc_steal(mpctx, mpctx->demuxer->dir_scan);
+    mpctx->demuxer->dir_scan = NULL;
+    mpctx->dir_scan_path = talloc_strdup(NULL, mpctx->filename);
+    set_dir_scan_last(mpctx, last);
+    demux_dir_scan_set_wakeup_cb(mpctx->dir_scan, mp_wakeup_core_cb, mpctx);
+}
+
+// If playback reached the last entry of a directory that is still scanned,
+// wait until the next entry is known.
+static void wait_dir_scan(struct MPContext *mpctx)
+{
+    enum stop_play_reason stop_play = mpctx->stop_play;
+    if (stop_play != PT_NEXT_ENTRY && stop_play != PT_ERROR &&
+        stop_play != AT_END_OF_FILE)
+        return;
+
+    struct playlist *pl = mpctx->playlist;
+    while (mpctx->dir_scan && pl->current == mpctx->dir_scan_last &&
+           !pl->current_was_replaced && mpctx->stop_play == stop_play)
+        mp_idle(mpctx);
+}
+
 static void process_hooks(struct MPContext *mpctx, char *name)
 {
+    mp_startup_begin(mpctx, name);
     mp_hook_start(mpctx, name);
 
     while (!mp_hook_test_completion(mpctx, name)) {
@@ -1090,6 +1296,7 @@ static void process_hooks(struct MPContext *mpctx, char *name)
         if (mpctx->stop_play)
             mp_abort_playback_async(mpctx);
     }
+    mp_startup_end(mpctx, name);
 }
 
 // to be run on a worker thread, locked (temporarily unlocks core)
@@ -1245,6 +1452,8 @@ static void open_demux_reentrant(struct MPContext *mpctx)
 {
     char *url = mpctx->stream_open_filename;
 
+    mp_startup_begin(mpctx, "demux-open");
+
     if (mpctx->open_active) {
         bool done = atomic_load(&mpctx->open_done);
         bool failed = done && !mpctx->open_res_demuxer;
@@ -1292,6 +1501,7 @@ static void open_demux_reentrant(struct MPContext *mpctx)
 
 cancel:
     cancel_open(mpctx); // cleanup
+    mp_startup_end(mpctx, "demux-open");
 }
 
 void prefetch_next(struct MPContext *mpctx)
@@ -1315,7 +1525,7 @@ static void clear_playlist_paths(struct MPContext *mpctx)
 static bool infinite_playlist_loading_loop(struct MPContext *mpctx, struct playlist *pl)
 {
     if (pl->num_entries) {
-        struct playlist_entry *e = pl->entries[0];
+        struct playlist_entry *e = playlist_get_first(pl);
         for (int n = 0; n < mpctx->playlist_paths_len; n++) {
             if (strcmp(mpctx->playlist_paths[n], e->filename) == 0) {
                 clear_playlist_paths(mpctx);
@@ -1584,6 +1794,7 @@ static void play_current_file(struct MPContext *mpctx)
     };
 
     mp_notify(mpctx, MPV_EVENT_START_FILE, &start_event);
+    mp_startup_begin(mpctx, "load-file");
 
     mp_cancel_reset(mpctx->playback_abort);
 
@@ -1690,8 +1901,11 @@ static void play_current_file(struct MPContext *mpctx)
             MP_ERR(mpctx, "Infinite playlist loading loop detected.\n");
             goto terminate_playback;
         }
+        struct playlist_entry *last = playlist_get_last(pl);
         transfer_playlist(mpctx, pl, &end_event.playlist_insert_id,
                           &end_event.playlist_insert_num_entries);
+        if (mpctx->demuxer->dir_scan && last)
+            start_dir_scan(mpctx, last);
         mp_notify_property(mpctx, "playlist");
         mpctx->error_playing = 2;
         goto terminate_playback;
@@ -1703,7 +1917,9 @@ static void play_current_file(struct MPContext *mpctx)
 
     add_demuxer_tracks(mpctx, mpctx->demuxer);
 
+    mp_startup_begin(mpctx, "external-files");
     load_external_opts(mpctx);
+    mp_startup_end(mpctx, "external-files");
     if (mpctx->stop_play)
         goto terminate_playback;
 
@@ -1768,7 +1984,9 @@ static void play_current_file(struct MPContext *mpctx)
 
     reinit_video_chain(mpctx);
     reinit_audio_chain(mpctx);
+    mp_startup_begin(mpctx, "subtitle-init");
     reinit_sub_all(mpctx);
+    mp_startup_end(mpctx, "subtitle-init");
 
     if (mpctx->encode_lavc_ctx) {
         if (mpctx->vo_chain)
@@ -1800,6 +2018,7 @@ static void play_current_file(struct MPContext *mpctx)
     mpctx->playlist->playlist_completed = false;
     mpctx->playlist->playlist_started = true;
     mp_notify(mpctx, MPV_EVENT_FILE_LOADED, NULL);
+    mp_startup_end(mpctx, "load-file");
     update_screensaver_state(mpctx);
     clear_playlist_paths(mpctx);
 
@@ -1850,6 +2069,8 @@ static void play_current_file(struct MPContext *mpctx)
 
 terminate_playback:
 
+    mp_startup_end(mpctx, "load-file");
+
     if (!mpctx->stop_play)
         mpctx->stop_play = PT_ERROR;
 
@@ -1987,11 +2208,9 @@ struct playlist_entry *mp_next_file(struct MPContext *mpctx, int direction,
         if (!force && next && next->init_failed && !ignore_failures) {
             // Don't endless loop if no file in playlist is playable
             bool all_failed = true;
-            for (int n = 0; n < mpctx->playlist->num_entries; n++) {
-                all_failed &= mpctx->playlist->entries[n]->init_failed;
-                if (!all_failed)
-                    break;
-            }
+            for (struct playlist_entry *e = playlist_get_first(mpctx->playlist);
+                 e && all_failed; e = playlist_entry_get_rel(e, 1))
+                all_failed &= e->init_failed;
             if (all_failed)
                 next = NULL;
         }
@@ -2027,6 +2246,8 @@ void mp_play_files(struct MPContext *mpctx)
         if (mpctx->playlist->current)
             play_current_file(mpctx);
 
+        wait_dir_scan(mpctx);
+
         if (mpctx->stop_play == PT_QUIT)
             break;
 
@@ -2051,6 +2272,7 @@ void mp_play_files(struct MPContext *mpctx)
     }
 
     cancel_open(mpctx);
+    stop_dir_scan(mpctx);
 
     if (mpctx->encode_lavc_ctx) {
         // Make sure all streams get finished.
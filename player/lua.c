@@ -959,6 +959,8 @@ static int script_raw_observe_property(lua_State *L)
     struct script_ctx *ctx = get_ctx(L);
     uint64_t id = luaL_checknumber(L, 1);
     const char *name = luaL_checkstring(L, 2);
+    if (lua_isstring(L, 3) && strcmp(lua_tostring(L, 3), "delta") == 0)
+        return check_error(L, mpv_observe_property_delta(ctx->client, id, name));
     mpv_format format = check_property_format(L, 3);
     return check_error(L, mpv_observe_property(ctx->client, id, name, format));
 }
@@ -30,6 +30,8 @@
 #include "mpv_talloc.h"
 
 #include "misc/dispatch.h"
+#include "misc/json.h"
+#include "misc/node.h"
 #include "misc/random.h"
 #include "misc/thread_pool.h"
 #include "osdep/io.h"
@@ -67,6 +69,7 @@
 #include "client.h"
 #include "command.h"
 #include "screenshot.h"
+#include "external_files.h"
 
 static const char def_config[] =
 #include "etc/builtin.conf.inc"
@@ -167,6 +170,138 @@ void mp_print_version(struct mp_log *log, int always)
     }
 }
 
+static bool write_stats_file(struct MPContext *mpctx, const char *file,
+                             const char *data, const char *what)
+{
+    void *tmp = talloc_new(NULL);
+    char *path = mp_get_user_path(tmp, mpctx->global, file);
+    FILE *f = fopen(path, "wb");
+    bool ok = f && fwrite(data, strlen(data), 1, f) == 1;
+    if (f && fclose(f))
+        ok = false;
+    if (ok) {
+        MP_INFO(mpctx, "%s written to '%s'.\n", what, path);
+    } else {
+        MP_ERR(mpctx, "Failed to write %s to '%s'.\n", what, path);
+    }
+    talloc_free(tmp);
+    return ok;
+}
+
+static void write_benchmark_report(struct MPContext *mpctx)
+{
+    char *file = mpctx->opts->benchmark_report;
+    if (!file || !file[0])
+        return;
+
+    void *tmp = talloc_new(NULL);
+    struct mpv_node report;
+    stats_global_report(mpctx->global, &report);
+    talloc_steal(tmp, report.u.list);
+
+    char *s = talloc_strdup(tmp, "");
+    json_write_pretty(&s, &report);
+    s = talloc_strdup_append(s, "\n");
+
+    write_stats_file(mpctx, file, s, "Benchmark report");
+    talloc_free(tmp);
+}
+
+bool mp_write_stats_trace(struct MPContext *mpctx, const char *file)
+{
+    char *s = stats_global_trace(mpctx->global, NULL);
+    bool ok = write_stats_file(mpctx, file, s, "Stats trace");
+    talloc_free(s);
+    return ok;
+}
+
+// Maximum number of recorded startup spans. Beyond this, new spans are ignored.
+#define MAX_STARTUP_SPANS 256
+
+struct startup_span {
+    char *name;
+    int depth;
+    int64_t start, end;     // relative to mpctx->startup_ts; end < 0: open
+};
+
+// Start a named span of the startup timeline, which is closed by the next
+// mp_startup_end() with the same name. Spans can nest. Recording stops after
+// mp_startup_finish(), which is called when playback of the first file starts.
+void mp_startup_begin(struct MPContext *mpctx, const char *name)
+{
+    if (mpctx->startup_done || mpctx->num_startup_spans >= MAX_STARTUP_SPANS)
+        return;
+    int depth = 0;
+    for (int n = 0; n < mpctx->num_startup_spans; n++)
+        depth += mpctx->startup_spans[n].end < 0;
+    struct startup_span span = {
+        .name = talloc_strdup(mpctx, name),
+        .depth = depth,
+        .start = mp_time_ns() - mpctx->startup_ts,
+        .end = -1,
+    };
+    MP_TARRAY_APPEND(mpctx, mpctx->startup_spans, mpctx->num_startup_spans,
+                     span);
+}
+
+// Close the innermost open span with this name. Does nothing if there is none,
+// so it's fine to call this on all exit paths.
+void mp_startup_end(struct MPContext *mpctx, const char *name)
+{
+    for (int n = mpctx->num_startup_spans - 1; n >= 0; n--) {
+        struct startup_span *span = &mpctx->startup_spans[n];
+        if (span->end < 0 && strcmp(span->name, name) == 0) {
+            span->end = mp_time_ns() - mpctx->startup_ts;
+            return;
+        }
+    }
+}
+
+void mp_startup_timeline(struct MPContext *mpctx, struct mpv_node *dst)
+{
+    node_init(dst, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; n < mpctx->num_startup_spans; n++) {
+        struct startup_span *span = &mpctx->startup_spans[n];
+        struct mpv_node *e = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+        node_map_add_string(e, "name", span->name);
+        node_map_add_int64(e, "depth", span->depth);
+        node_map_add_double(e, "start", MP_TIME_NS_TO_S(span->start));
+        if (span->end >= 0)
+            node_map_add_double(e, "end", MP_TIME_NS_TO_S(span->end));
+    }
+}
+
+static void write_startup_timeline(struct MPContext *mpctx)
+{
+    char *file = mpctx->opts->startup_timeline;
+    if (!file || !file[0])
+        return;
+
+    void *tmp = talloc_new(NULL);
+    struct mpv_node timeline;
+    mp_startup_timeline(mpctx, &timeline);
+    talloc_steal(tmp, timeline.u.list);
+
+    char *s = talloc_strdup(tmp, "");
+    json_write_pretty(&s, &timeline);
+    s = talloc_strdup_append(s, "\n");
+
+    write_stats_file(mpctx, file, s, "Startup timeline");
+    talloc_free(tmp);
+}
+
+// Mark the end of startup (playback of the first file has started), and write
+// the timeline if requested.
+void mp_startup_finish(struct MPContext *mpctx)
+{
+    if (mpctx->startup_done)
+        return;
+    mp_startup_begin(mpctx, "playback-start");
+    mp_startup_end(mpctx, "playback-start");
+    mpctx->startup_done = true;
+    write_startup_timeline(mpctx);
+}
+
 void mp_destroy(struct MPContext *mpctx)
 {
     mp_shutdown_clients(mpctx);
@@ -187,11 +322,18 @@ void mp_destroy(struct MPContext *mpctx)
 
     osd_free(mpctx->osd);
 
+    write_benchmark_report(mpctx);
+    if (!mpctx->startup_done)
+        write_startup_timeline(mpctx);
+    if (mpctx->opts->stats_trace && mpctx->opts->stats_trace[0])
+        mp_write_stats_trace(mpctx, mpctx->opts->stats_trace);
+
 #if HAVE_COCOA
     cocoa_set_input_context(NULL);
 #endif
 
     if (cas_terminal_owner(mpctx, mpctx)) {
+        mp_msg_flush_term(mpctx->global);
         terminal_uninit();
         cas_terminal_owner(mpctx, NULL);
     }
@@ -268,6 +410,7 @@ struct MPContext *mp_create(void)
 
     struct MPContext *mpctx = talloc(NULL, MPContext);
     *mpctx = (struct MPContext){
+        .startup_ts = mp_time_ns(),
         .last_chapter = -2,
         .term_osd_contents = talloc_strdup(mpctx, ""),
         .osd_progbar = { .type = -1 },
@@ -275,12 +418,15 @@ struct MPContext *mp_create(void)
         .dispatch = mp_dispatch_create(mpctx),
         .playback_abort = mp_cancel_new(mpctx),
         .thread_pool = mp_thread_pool_create(mpctx, 0, 1, 30),
+        .external_files_cache = external_files_cache_create(mpctx),
         .stop_play = PT_NEXT_ENTRY,
         .play_dir = 1,
     };
 
     mp_mutex_init(&mpctx->abort_lock);
 
+    mp_startup_begin(mpctx, "create");
+
     mpctx->global = talloc_zero(mpctx, struct mpv_global);
 
     stats_global_init(mpctx->global);
@@ -320,6 +466,8 @@ struct MPContext *mp_create(void)
 
     mp_cancel_trigger(mpctx->playback_abort);
 
+    mp_startup_end(mpctx, "create");
+
     return mpctx;
 }
 
@@ -334,6 +482,8 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     assert(!mpctx->initialized);
 
+    mp_startup_begin(mpctx, "initialize");
+
     // Preparse the command line, so we can init the terminal early.
     if (options) {
         m_config_preparse_command_line(mpctx->mconfig, mpctx->global,
@@ -353,11 +503,15 @@ int mp_initialize(struct MPContext *mpctx, char **options)
 
     mp_print_version(mpctx->log, false);
 
+    mp_startup_begin(mpctx, "config-files");
     mp_parse_cfgfiles(mpctx);
+    mp_startup_end(mpctx, "config-files");
 
     if (options) {
+        mp_startup_begin(mpctx, "command-line");
         int r = m_config_parse_mp_command_line(mpctx->mconfig, mpctx->playlist,
                                                mpctx->global, options);
+        mp_startup_end(mpctx, "command-line");
         if (r < 0)
             return r == M_OPT_EXIT ? 1 : -1;
     }
@@ -373,7 +527,14 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     // the command line.
     m_config_backup_watch_later_opts(mpctx->mconfig);
 
+    mp_startup_begin(mpctx, "input-config");
     mp_input_load_config(mpctx->input);
+    mp_startup_end(mpctx, "input-config");
+
+    if (opts->benchmark_report && opts->benchmark_report[0])
+        stats_global_enable_report(mpctx->global);
+    if (opts->stats_trace && opts->stats_trace[0])
+        stats_global_enable_trace(mpctx->global);
 
     // From this point on, all mpctx members are initialized.
     mpctx->initialized = true;
@@ -381,7 +542,9 @@ int mp_initialize(struct MPContext *mpctx, char **options)
     mpctx->mconfig->option_change_callback_ctx = mpctx;
     m_config_set_update_dispatch_queue(mpctx->mconfig, mpctx->dispatch);
     // Run all update handlers.
+    mp_startup_begin(mpctx, "apply-options");
     mp_option_change_callback(mpctx, NULL, UPDATE_OPTS_MASK, false);
+    mp_startup_end(mpctx, "apply-options");
 
     if (handle_help_options(mpctx))
         return 1; // help
@@ -419,7 +582,9 @@ int mp_initialize(struct MPContext *mpctx, char **options)
         mp_input_enable_section(mpctx->input, "encode", MP_INPUT_EXCLUSIVE);
     }
 
+    mp_startup_begin(mpctx, "scripts");
     mp_load_scripts(mpctx);
+    mp_startup_end(mpctx, "scripts");
 
     if (opts->force_vo == 2 && handle_force_window(mpctx, false) < 0)
         return -1;
@@ -429,6 +594,7 @@ int mp_initialize(struct MPContext *mpctx, char **options)
         mpctx->stop_play = PT_STOP;
 
     MP_STATS(mpctx, "end init");
+    mp_startup_end(mpctx, "initialize");
 
     return 0;
 }
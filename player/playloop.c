@@ -1023,7 +1023,9 @@ int handle_force_window(struct MPContext *mpctx, bool force)
             .wakeup_cb = mp_wakeup_core_cb,
             .wakeup_ctx = mpctx,
         };
+        mp_startup_begin(mpctx, "vo-init");
         mpctx->video_out = init_best_video_out(mpctx->global, &ex);
+        mp_startup_end(mpctx, "vo-init");
         if (!mpctx->video_out)
             goto err;
         mpctx->mouse_cursor_visible = true;
@@ -1149,6 +1151,7 @@ static void handle_playback_restart(struct MPContext *mpctx)
         mpctx->current_seek = (struct seek_params){0};
         handle_playback_time(mpctx);
         mp_notify(mpctx, MPV_EVENT_PLAYBACK_RESTART, NULL);
+        mp_startup_finish(mpctx);
         update_core_idle_state(mpctx);
         if (!mpctx->playing_msg_shown) {
             if (opts->playing_msg && opts->playing_msg[0]) {
@@ -1226,6 +1229,7 @@ void run_playloop(struct MPContext *mpctx)
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
     handle_command_updates(mpctx);
+    handle_dir_scan(mpctx);
 
     if (mpctx->lavfi && mp_filter_has_failed(mpctx->lavfi))
         mpctx->stop_play = AT_END_OF_FILE;
@@ -1282,6 +1286,7 @@ void mp_idle(struct MPContext *mpctx)
     mp_wait_events(mpctx);
     mp_process_input(mpctx);
     handle_command_updates(mpctx);
+    handle_dir_scan(mpctx);
     handle_update_cache(mpctx);
     handle_cursor_autohide(mpctx);
     handle_vo_events(mpctx);
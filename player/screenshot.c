@@ -15,11 +15,13 @@
  * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include <libavcodec/avcodec.h>
+#include <libavutil/cpu.h>
 
 #include "osdep/io.h"
 
@@ -32,8 +34,16 @@
 #include "misc/dispatch.h"
 #include "misc/node.h"
 #include "misc/thread_tools.h"
+#include "misc/thread_pool.h"
 #include "common/msg.h"
+#include "demux/demux.h"
+#include "demux/stheader.h"
+#include "filters/f_decoder_wrapper.h"
+#include "filters/filter.h"
+#include "filters/frame.h"
+#include "options/m_option.h"
 #include "options/path.h"
+#include "stream/stream.h"
 #include "video/mp_image.h"
 #include "video/mp_image_pool.h"
 #include "video/out/vo.h"
@@ -609,3 +619,404 @@ void handle_each_frame_screenshot(struct MPContext *mpctx)
 
     mp_waiter_wait(&wait);
 }
+
+// Upper bound for the number of files decoded concurrently by the thumbnail
+// command. Each worker has its own demuxer and decoder (which may in turn use
+// multiple threads), so more than a few rarely help.
+#define MAX_THUMBNAIL_WORKERS 4
+
+struct thumb_ctx {
+    struct mpv_global *global;
+    struct mp_log *log;
+    struct mp_cancel *cancel;
+    char *url;
+    bool rebase_start_time;
+    int width;
+
+    double *times;
+    int num_times;
+
+    // If non-NULL, each worker writes its thumbnails directly to these files.
+    char **filenames;
+    struct image_writer_opts *writer_opts;
+
+    // Results, one entry per times[] entry. Written by the workers only for
+    // the indexes they own. With filenames, each thumbnail is freed as soon
+    // as it was written, and only written[] is set. Otherwise, images[] is
+    // set (NULL on failure).
+    struct mp_image **images;
+    bool *written;
+
+    mp_mutex lock;
+    mp_cond wakeup;
+    int pending_jobs;
+};
+
+struct thumb_job {
+    struct thumb_ctx *ctx;
+    int *indexes; // into thumb_ctx.times, sorted by ascending time
+    int num_indexes;
+};
+
+// Return the next decoded frame, or NULL on EOF, error, or cancellation.
+static struct mp_image *thumb_decode_frame(struct thumb_ctx *ctx,
+                                           struct mp_filter *root,
+                                           struct mp_decoder_wrapper *dec)
+{
+    // The demuxer thread is not started, so reading packets (and thus running
+    // the filter graph) always makes progress until EOF.
+    while (!mp_cancel_test(ctx->cancel)) {
+        mp_filter_graph_run(root);
+        struct mp_frame frame = mp_pin_out_read(dec->f->pins[0]);
+        if (frame.type == MP_FRAME_VIDEO)
+            return frame.data;
+        bool eof = frame.type == MP_FRAME_EOF;
+        mp_frame_unref(&frame);
+        if (eof || mp_filter_has_failed(dec->f))
+            break;
+    }
+    return NULL;
+}
+
+static struct mp_image *thumb_scale(struct mp_sws_context *sws,
+                                    struct mp_image *img, int width)
+{
+    int d_w, d_h;
+    mp_image_params_get_dsize(&img->params, &d_w, &d_h);
+    if (d_w <= 0 || d_h <= 0)
+        return NULL;
+
+    struct mp_image_params p = {
+        .imgfmt = IMGFMT_BGR0,
+        .w = width,
+        .h = MPMAX(2, (int)lrint(width * (double)d_h / d_w) & ~1),
+        .p_w = 1,
+        .p_h = 1,
+    };
+    mp_image_params_guess_csp(&p);
+
+    struct mp_image *dst = mp_image_alloc(p.imgfmt, p.w, p.h);
+    if (!dst)
+        return NULL;
+    mp_image_copy_attributes(dst, img);
+    dst->params = p;
+
+    if (mp_sws_scale(sws, dst, img) < 0) {
+        talloc_free(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+static void thumb_worker(void *p)
+{
+    struct thumb_job *job = p;
+    struct thumb_ctx *ctx = job->ctx;
+    struct mp_filter *root = NULL;
+    struct mp_decoder_wrapper *dec = NULL;
+
+    struct demuxer_params params = {
+        .is_top_level = true,
+        .stream_flags = STREAM_ORIGIN_DIRECT,
+    };
+    struct demuxer *demuxer =
+        demux_open_url(ctx->url, &params, ctx->cancel, ctx->global);
+    if (!demuxer) {
+        mp_err(ctx->log, "Could not open '%s'.\n", ctx->url);
+        goto done;
+    }
+
+    if (ctx->rebase_start_time)
+        demux_set_ts_offset(demuxer, -demuxer->start_time);
+
+    struct sh_stream *sh = NULL;
+    for (int n = 0; n < demux_get_num_stream(demuxer); n++) {
+        struct sh_stream *s = demux_get_stream(demuxer, n);
+        if (s->type == STREAM_VIDEO && !s->attached_picture) {
+            sh = s;
+            break;
+        }
+    }
+    if (!sh) {
+        mp_err(ctx->log, "No video stream in '%s'.\n", ctx->url);
+        goto done;
+    }
+    demuxer_select_track(demuxer, sh, MP_NOPTS_VALUE, true);
+
+    root = mp_filter_create_root(ctx->global);
+    dec = mp_decoder_wrapper_create(root, sh);
+    if (!dec || !mp_decoder_wrapper_reinit(dec)) {
+        mp_err(ctx->log, "Could not initialize video decoder.\n");
+        goto done;
+    }
+
+    struct mp_sws_context *sws = mp_sws_alloc(root);
+    sws->log = ctx->log;
+    mp_sws_enable_cmdline_opts(sws, ctx->global);
+
+    for (int n = 0; n < job->num_indexes; n++) {
+        int idx = job->indexes[n];
+        if (mp_cancel_test(ctx->cancel))
+            break;
+
+        // Keyframe precision only: the first frame out of the decoder after
+        // the seek is the keyframe at or before the target. Non-reference
+        // frames up to it are discarded as with --vd-lavc-framedrop.
+        demux_seek(demuxer, ctx->times[idx], 0);
+        mp_filter_reset(root);
+        mp_decoder_wrapper_set_frame_drops(dec, INT_MAX);
+
+        struct mp_image *img = thumb_decode_frame(ctx, root, dec);
+        if (img && (img->fmt.flags & MP_IMGFLAG_HWACCEL)) {
+            struct mp_image *nimg = mp_image_hw_download(img, NULL);
+            talloc_free(img);
+            img = nimg;
+        }
+        struct mp_image *thumb = img ? thumb_scale(sws, img, ctx->width) : NULL;
+        talloc_free(img);
+
+        if (!thumb) {
+            mp_warn(ctx->log, "Could not create thumbnail at %f.\n",
+                    ctx->times[idx]);
+            continue;
+        }
+
+        if (ctx->filenames) {
+            ctx->written[idx] = write_image(thumb, ctx->writer_opts,
+                                            ctx->filenames[idx], ctx->global,
+                                            ctx->log, true);
+            talloc_free(thumb);
+        } else {
+            ctx->images[idx] = thumb;
+        }
+    }
+
+done:
+    if (dec)
+        talloc_free(dec->f);
+    talloc_free(root);
+    demux_free(demuxer);
+
+    mp_mutex_lock(&ctx->lock);
+    ctx->pending_jobs -= 1;
+    mp_cond_broadcast(&ctx->wakeup);
+    mp_mutex_unlock(&ctx->lock);
+}
+
+struct thumb_time {
+    double time;
+    int index;
+};
+
+static int thumb_cmp_time(const void *a, const void *b)
+{
+    const struct thumb_time *ta = a, *tb = b;
+    return ta->time < tb->time ? -1 : (ta->time > tb->time);
+}
+
+static bool thumb_parse_times(struct thumb_ctx *ctx, struct mp_log *log,
+                              const char *list)
+{
+    bstr rest = bstr0(list);
+    while (rest.len) {
+        bstr item = bstr_strip(bstr_split(rest, ",", &rest));
+        bstr_eatstart0(&rest, ",");
+        if (!item.len)
+            continue;
+        double t;
+        const struct m_option opt = {.type = CONF_TYPE_TIME};
+        if (m_option_parse(log, &opt, bstr0("times"), item, &t) < 0 ||
+            t == MP_NOPTS_VALUE)
+            return false;
+        MP_TARRAY_APPEND(ctx, ctx->times, ctx->num_times, t);
+    }
+    return ctx->num_times > 0;
+}
+
+// Paste the thumbnails as tiles into a single image, row by row.
+static struct mp_image *thumb_compose_sheet(struct thumb_ctx *ctx, int columns,
+                                            int *out_tile_h)
+{
+    struct mp_image *first = NULL;
+    int tile_h = 0;
+    for (int n = 0; n < ctx->num_times; n++) {
+        struct mp_image *img = ctx->images[n];
+        if (img) {
+            first = first ? first : img;
+            tile_h = MPMAX(tile_h, img->h);
+        }
+    }
+    *out_tile_h = tile_h;
+    if (!first)
+        return NULL;
+
+    int rows = (ctx->num_times + columns - 1) / columns;
+    struct mp_image *sheet =
+        mp_image_alloc(IMGFMT_BGR0, ctx->width * columns, tile_h * rows);
+    if (!sheet)
+        return NULL;
+    mp_image_copy_attributes(sheet, first);
+    mp_image_clear(sheet, 0, 0, sheet->w, sheet->h);
+
+    for (int n = 0; n < ctx->num_times; n++) {
+        struct mp_image *img = ctx->images[n];
+        if (!img)
+            continue;
+        int x = (n % columns) * ctx->width;
+        int y = (n / columns) * tile_h;
+        struct mp_image tile = *sheet;
+        mp_image_crop(&tile, x, y, x + img->w, y + img->h);
+        mp_image_copy(&tile, img);
+    }
+    return sheet;
+}
+
+void cmd_screenshot_thumbnails(void *p)
+{
+    struct mp_cmd_ctx *cmd = p;
+    struct MPContext *mpctx = cmd->mpctx;
+    const char *filename = cmd->args[1].v.s;
+    int columns = cmd->args[3].v.i;
+    struct mpv_node *res = &cmd->result;
+
+    cmd->success = false;
+
+    if (!mpctx->filename) {
+        mp_cmd_msg(cmd, MSGL_ERR, "No file loaded.");
+        return;
+    }
+
+    struct thumb_ctx *ctx = talloc_zero(NULL, struct thumb_ctx);
+    *ctx = (struct thumb_ctx){
+        .global = mpctx->global,
+        .log = mpctx->screenshot_ctx->log,
+        .cancel = cmd->abort->cancel,
+        .url = talloc_strdup(ctx, mpctx->filename),
+        .rebase_start_time = mpctx->opts->rebase_start_time,
+        .width = cmd->args[2].v.i & ~1,
+    };
+    mp_mutex_init(&ctx->lock);
+    mp_cond_init(&ctx->wakeup);
+
+    if (!thumb_parse_times(ctx, ctx->log, cmd->args[0].v.s)) {
+        mp_cmd_msg(cmd, MSGL_ERR, "Invalid list of thumbnail times.");
+        goto done;
+    }
+
+    struct image_writer_opts *writer_opts =
+        talloc_dup(ctx, mpctx->opts->screenshot_image_opts);
+    bstr root;
+    char *ext = mp_splitext(filename, &root);
+    int format = image_writer_format_from_ext(ext);
+    if (format)
+        writer_opts->format = format;
+    ctx->writer_opts = writer_opts;
+
+    if (columns) {
+        ctx->images = talloc_zero_array(ctx, struct mp_image *, ctx->num_times);
+    } else {
+        ext = talloc_strdup(ctx, image_writer_file_ext(writer_opts));
+        ctx->written = talloc_zero_array(ctx, bool, ctx->num_times);
+        ctx->filenames = talloc_zero_array(ctx, char *, ctx->num_times);
+        for (int n = 0; n < ctx->num_times; n++) {
+            ctx->filenames[n] = talloc_asprintf(ctx, "%.*s-%04d.%s",
+                                                BSTR_P(root), n + 1, ext);
+        }
+    }
+
+    // Each worker gets a contiguous range of the sorted times, so that its
+    // demuxer only ever seeks forward.
+    struct thumb_time *sorted = talloc_array(ctx, struct thumb_time,
+                                             ctx->num_times);
+    for (int n = 0; n < ctx->num_times; n++)
+        sorted[n] = (struct thumb_time){ctx->times[n], n};
+    qsort(sorted, ctx->num_times, sizeof(sorted[0]), thumb_cmp_time);
+    int *order = talloc_array(ctx, int, ctx->num_times);
+    for (int n = 0; n < ctx->num_times; n++)
+        order[n] = sorted[n].index;
+
+    int num_jobs = MPMIN(ctx->num_times, MPMIN(av_cpu_count(),
+                                               MAX_THUMBNAIL_WORKERS));
+    struct thumb_job *jobs = talloc_zero_array(ctx, struct thumb_job, num_jobs);
+    int start = 0;
+    for (int n = 0; n < num_jobs; n++) {
+        int count = (ctx->num_times - start) / (num_jobs - n);
+        jobs[n] = (struct thumb_job){
+            .ctx = ctx,
+            .indexes = order + start,
+            .num_indexes = count,
+        };
+        start += count;
+    }
+
+    mp_cmd_msg(cmd, MSGL_V, "Creating %d thumbnails using %d workers.",
+               ctx->num_times, num_jobs);
+
+    mp_core_unlock(mpctx);
+
+    // This command itself runs on the thread pool, so waiting for queued jobs
+    // could deadlock if the pool is exhausted. Jobs for which no thread could
+    // be reserved are run on this thread instead.
+    ctx->pending_jobs = num_jobs;
+    for (int n = 0; n < num_jobs; n++) {
+        if (!mp_thread_pool_run(mpctx->thread_pool, thumb_worker, &jobs[n]))
+            thumb_worker(&jobs[n]);
+    }
+
+    mp_mutex_lock(&ctx->lock);
+    while (ctx->pending_jobs)
+        mp_cond_wait(&ctx->wakeup, &ctx->lock);
+    mp_mutex_unlock(&ctx->lock);
+
+    struct mp_image *sheet = NULL;
+    int tile_h = 0;
+    if (columns && !mp_cancel_test(ctx->cancel)) {
+        sheet = thumb_compose_sheet(ctx, columns, &tile_h);
+        if (sheet && !write_image(sheet, writer_opts, filename, mpctx->global,
+                                  ctx->log, true))
+            TA_FREEP(&sheet);
+    }
+
+    mp_core_lock(mpctx);
+
+    if (mp_cancel_test(ctx->cancel)) {
+        mp_cmd_msg(cmd, MSGL_WARN, "Thumbnail creation aborted.");
+        goto done;
+    }
+
+    node_init(res, MPV_FORMAT_NODE_MAP, NULL);
+    if (columns) {
+        if (!sheet) {
+            mp_cmd_msg(cmd, MSGL_ERR, "Error writing thumbnail sheet!");
+            goto done;
+        }
+        node_map_add_string(res, "filename", filename);
+        node_map_add_int64(res, "w", ctx->width);
+        node_map_add_int64(res, "h", tile_h);
+        node_map_add_int64(res, "columns", columns);
+        node_map_add_int64(res, "rows", (ctx->num_times + columns - 1) / columns);
+        mp_cmd_msg(cmd, MSGL_INFO, "Thumbnail sheet: '%s'", filename);
+        cmd->success = true;
+    } else {
+        struct mpv_node *list = node_map_add(res, "filenames", MPV_FORMAT_NODE_ARRAY);
+        int written = 0;
+        for (int n = 0; n < ctx->num_times; n++) {
+            if (ctx->written[n]) {
+                node_array_add(list, MPV_FORMAT_STRING)->u.string =
+                    talloc_strdup(list->u.list, ctx->filenames[n]);
+                written++;
+            }
+        }
+        mp_cmd_msg(cmd, MSGL_INFO, "Thumbnails: %d/%d written.", written,
+                   ctx->num_times);
+        cmd->success = written > 0;
+    }
+    talloc_free(sheet);
+
+done:
+    for (int n = 0; ctx->images && n < ctx->num_times; n++)
+        talloc_free(ctx->images[n]);
+    mp_cond_destroy(&ctx->wakeup);
+    mp_mutex_destroy(&ctx->lock);
+    talloc_free(ctx);
+}
@@ -42,5 +42,6 @@ struct mp_image *convert_image(struct mp_image *image, int destfmt,
 void cmd_screenshot(void *p);
 void cmd_screenshot_to_file(void *p);
 void cmd_screenshot_raw(void *p);
+void cmd_screenshot_thumbnails(void *p);
 
 #endif /* MPLAYER_SCREENSHOT_H */
@@ -333,6 +333,8 @@ static void init_sym_table(struct mp_script_args *args, void *lib) {
     INIT_SYM(mpv_command_string);
     INIT_SYM(mpv_command_async);
     INIT_SYM(mpv_command_node_async);
+    INIT_SYM(mpv_command_list);
+    INIT_SYM(mpv_command_list_async);
     INIT_SYM(mpv_abort_async_command);
     INIT_SYM(mpv_set_property);
     INIT_SYM(mpv_set_property_string);
@@ -342,7 +344,10 @@ static void init_sym_table(struct mp_script_args *args, void *lib) {
     INIT_SYM(mpv_get_property_string);
     INIT_SYM(mpv_get_property_osd_string);
     INIT_SYM(mpv_get_property_async);
+    INIT_SYM(mpv_get_property_list);
+    INIT_SYM(mpv_get_property_list_async);
     INIT_SYM(mpv_observe_property);
+    INIT_SYM(mpv_observe_property_delta);
     INIT_SYM(mpv_unobserve_property);
     INIT_SYM(mpv_event_name);
     INIT_SYM(mpv_event_to_node);
@@ -232,7 +232,9 @@ void reinit_video_chain_src(struct MPContext *mpctx, struct track *track)
             .wakeup_cb = mp_wakeup_core_cb,
             .wakeup_ctx = mpctx,
         };
+        mp_startup_begin(mpctx, "vo-init");
         mpctx->video_out = init_best_video_out(mpctx->global, &ex);
+        mp_startup_end(mpctx, "vo-init");
         if (!mpctx->video_out) {
             MP_FATAL(mpctx, "Error opening/initializing "
                     "the selected video_out (--vo) device.\n");
@@ -257,7 +259,10 @@ void reinit_video_chain_src(struct MPContext *mpctx, struct track *track)
     if (track) {
         vo_c->track = track;
         track->vo_c = vo_c;
-        if (!init_video_decoder(mpctx, track))
+        mp_startup_begin(mpctx, "video-decoder-init");
+        int r = init_video_decoder(mpctx, track);
+        mp_startup_end(mpctx, "video-decoder-init");
+        if (!r)
             goto err_out;
 
         vo_c->dec_src = track->dec->f->pins[0];
@@ -21,6 +21,7 @@
 #include <math.h>
 #include <assert.h>
 #include <limits.h>
+#include <stdatomic.h>
 
 #include "demux/demux.h"
 #include "sd.h"
@@ -75,6 +76,17 @@ struct dec_sub {
     struct demux_packet **cached_pkts;
     int cached_pkt_pos;
     int num_cached_pkts;
+
+    // Background preloading (sub_preload()). While preload_running is set,
+    // only the preload thread reads packets from sh.
+    bool preload_thread_valid;
+    mp_thread preload_thread;
+    struct mp_dispatch_queue *preload_waiter;
+    mp_cond preload_wakeup;
+    bool preload_running;
+    bool preload_complete;      // reached EOF without being aborted
+    double preload_pts;         // pts of the last preloaded packet
+    atomic_bool preload_abort;
 };
 
 static void update_subtitle_speed(struct dec_sub *sub)
@@ -144,6 +156,7 @@ void sub_destroy(struct dec_sub *sub)
         sub->sd->driver->uninit(sub->sd);
     }
     talloc_free(sub->sd);
+    mp_cond_destroy(&sub->preload_wakeup);
     mp_mutex_destroy(&sub->lock);
     talloc_free(sub);
 }
@@ -201,10 +214,12 @@ struct dec_sub *sub_create(struct mpv_global *global, struct track *track,
         .last_vo_pts = MP_NOPTS_VALUE,
         .start = MP_NOPTS_VALUE,
         .end = MP_NOPTS_VALUE,
+        .preload_pts = MP_NOPTS_VALUE,
     };
     sub->opts = sub->opts_cache->opts;
     sub->shared_opts = sub->shared_opts_cache->opts;
     mp_mutex_init(&sub->lock);
+    mp_cond_init(&sub->preload_wakeup);
 
     sub->sd = init_decoder(sub);
     if (sub->sd) {
@@ -249,35 +264,127 @@ bool sub_can_preload(struct dec_sub *sub)
 {
     bool r;
     mp_mutex_lock(&sub->lock);
-    r = sub->sd->driver->accept_packets_in_advance && !sub->preload_attempted;
+    r = sub->sd->driver->accept_packets_in_advance && !sub->preload_attempted &&
+        !sub->preload_running;
     mp_mutex_unlock(&sub->lock);
     return r;
 }
 
+// Number of packets read before they are decoded in one go. The lock is held
+// only while decoding a batch, so rendering can interleave with preloading.
+#define PRELOAD_BATCH 64
+
+static void run_preload(struct dec_sub *sub)
+{
+    struct demux_packet *pkts[PRELOAD_BATCH];
+    bool eof = false;
+
+    while (!eof && !atomic_load(&sub->preload_abort)) {
+        int num = 0;
+        while (num < PRELOAD_BATCH) {
+            struct demux_packet *pkt = NULL;
+            int r = demux_read_packet_async(sub->sh, &pkt);
+            if (r == 0) {
+                if (num)
+                    break; // decode what we have before waiting
+                mp_dispatch_queue_process(sub->preload_waiter, INFINITY);
+                if (atomic_load(&sub->preload_abort))
+                    break;
+                continue;
+            }
+            if (!pkt) {
+                eof = true;
+                break;
+            }
+            pkts[num++] = pkt;
+        }
+
+        mp_mutex_lock(&sub->lock);
+        bool abort = atomic_load(&sub->preload_abort);
+        for (int n = 0; n < num; n++) {
+            struct demux_packet *pkt = pkts[n];
+            if (abort) {
+                talloc_free(pkt);
+                continue;
+            }
+            sub->sd->driver->decode(sub->sd, pkt);
+            MP_TARRAY_APPEND(sub, sub->cached_pkts, sub->num_cached_pkts, pkt);
+            if (sub->preload_pts == MP_NOPTS_VALUE || pkt->pts > sub->preload_pts)
+                sub->preload_pts = pkt->pts;
+        }
+        if (eof && !abort)
+            sub->preload_complete = true;
+        mp_cond_broadcast(&sub->preload_wakeup);
+        mp_mutex_unlock(&sub->lock);
+    }
+
+    demux_set_stream_wakeup_cb(sub->sh, NULL, NULL);
+
+    mp_mutex_lock(&sub->lock);
+    sub->preload_running = false;
+    mp_cond_broadcast(&sub->preload_wakeup);
+    mp_mutex_unlock(&sub->lock);
+}
+
+static MP_THREAD_VOID preload_thread(void *p)
+{
+    struct dec_sub *sub = p;
+    mp_thread_set_name("subpreload");
+    run_preload(sub);
+    MP_THREAD_RETURN();
+}
+
+// Stop and join the preload thread. If the preload did not finish, the player
+// starts it again (sub_can_preload()), and until then, packets read are decoded
+// normally. Called locked (temporarily unlocks).
+static void stop_preload(struct dec_sub *sub)
+{
+    if (!sub->preload_thread_valid)
+        return;
+    sub->preload_thread_valid = false;
+
+    atomic_store(&sub->preload_abort, true);
+    mp_dispatch_interrupt(sub->preload_waiter);
+    mp_mutex_unlock(&sub->lock);
+    mp_thread_join(sub->preload_thread);
+    mp_mutex_lock(&sub->lock);
+
+    TA_FREEP(&sub->preload_waiter);
+    if (!sub->preload_complete) {
+        MP_VERBOSE(sub, "Subtitle preload aborted.\n");
+        sub->preload_attempted = false;
+    }
+}
+
+// Read and decode all packets on a background thread. Until it's done,
+// sub_read_packets() waits only until the packets up to the requested pts
+// were decoded, and rendering uses whatever was decoded so far.
 void sub_preload(struct dec_sub *sub)
 {
     mp_mutex_lock(&sub->lock);
 
-    struct mp_dispatch_queue *demux_waiter = mp_dispatch_create(NULL);
-    demux_set_stream_wakeup_cb(sub->sh, wakeup_demux, demux_waiter);
+    stop_preload(sub);
 
     sub->preload_attempted = true;
+    sub->preload_running = true;
+    sub->preload_complete = false;
+    sub->preload_pts = MP_NOPTS_VALUE;
+    atomic_store(&sub->preload_abort, false);
 
-    for (;;) {
-        struct demux_packet *pkt = NULL;
-        int r = demux_read_packet_async(sub->sh, &pkt);
-        if (r == 0) {
-            mp_dispatch_queue_process(demux_waiter, INFINITY);
-            continue;
-        }
-        if (!pkt)
-            break;
-        sub->sd->driver->decode(sub->sd, pkt);
-        MP_TARRAY_APPEND(sub, sub->cached_pkts, sub->num_cached_pkts, pkt);
+    sub->preload_waiter = mp_dispatch_create(NULL);
+    demux_set_stream_wakeup_cb(sub->sh, wakeup_demux, sub->preload_waiter);
+
+    if (!mp_thread_create(&sub->preload_thread, preload_thread, sub)) {
+        sub->preload_thread_valid = true;
+        mp_mutex_unlock(&sub->lock);
+        return;
     }
 
-    demux_set_stream_wakeup_cb(sub->sh, NULL, NULL);
-    talloc_free(demux_waiter);
+    // Fall back to loading synchronously.
+    mp_mutex_unlock(&sub->lock);
+    run_preload(sub);
+    mp_mutex_lock(&sub->lock);
+    TA_FREEP(&sub->preload_waiter);
 
     mp_mutex_unlock(&sub->lock);
 }
@@ -335,7 +442,14 @@ void sub_read_packets(struct dec_sub *sub, double video_pts, bool force,
     *packets_read = true;
     mp_mutex_lock(&sub->lock);
     video_pts = pts_to_subtitle(sub, video_pts);
-    while (1) {
+
+    // Packets are preloaded in file order, which is pts order for the formats
+    // that support preloading.
+    while (sub->preload_running &&
+           (sub->preload_pts == MP_NOPTS_VALUE || sub->preload_pts <= video_pts))
+        mp_cond_wait(&sub->preload_wakeup, &sub->lock);
+
+    while (!sub->preload_running) {
         bool read_more = true;
         if (sub->sd->driver->accepts_packet)
             read_more = sub->sd->driver->accepts_packet(sub->sd, video_pts);
@@ -477,6 +591,7 @@ struct sd_times sub_get_times(struct dec_sub *sub, double pts)
 void sub_reset(struct dec_sub *sub)
 {
     mp_mutex_lock(&sub->lock);
+    stop_preload(sub);
     if (sub->sd->driver->reset)
         sub->sd->driver->reset(sub->sd);
     sub->last_pkt_pts = MP_NOPTS_VALUE;
@@ -31,6 +31,7 @@
 #include "options/options.h"
 #include "common/common.h"
 #include "common/msg.h"
+#include "common/stats.h"
 #include "demux/demux.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
@@ -38,6 +39,35 @@
 #include "ass_mp.h"
 #include "sd.h"
 
+struct event_index_entry {
+    long long start, end;
+    int event;              // index into ASS_Track.events
+};
+
+// ASS_Track events sorted by start time, as an implicit balanced binary tree:
+// the node of the range [lo, hi) is at mid = (lo + hi) / 2, and max_end[mid]
+// is the maximum end time within the range.
+struct event_index {
+    ASS_Track *track;       // track the index was built for
+    struct event_index_entry *entries;
+    long long *max_end;
+    int num_entries;        // also the number of track events indexed
+    bool tree_valid;        // max_end is up to date
+    bool stale;             // event times were changed; reread them
+};
+
+// Rendered output for a set of events that are not animated.
+struct render_cache_entry {
+    struct mp_osd_res res;
+    int format;
+    int *events;            // active events, in track order
+    int num_events;
+    struct sub_bitmaps *imgs; // with mangle_colors() applied; NULL if unused
+    uint64_t last_use;
+};
+
+#define RENDER_CACHE_SIZE 4
+
 struct sd_ass_priv {
     struct ass_library *ass_library;
     struct ass_renderer *ass_renderer;
@@ -55,10 +85,19 @@ struct sd_ass_priv {
     struct mp_image_params video_params;
     struct mp_image_params last_params;
     struct mp_osd_res osd;
-    struct seen_packet *seen_packets;
+    struct seen_packet *seen_packets; // in the order they were first seen
     int num_seen_packets;
-    int *packets_animated;
-    int num_packets_animated;
+    int *seen_hash;         // open addressing, indexes into seen_packets
+    int seen_hash_size;     // power of 2, or 0
+    struct event_index event_index;
+    int *event_buf;         // for find_events()
+    struct render_cache_entry render_cache[RENDER_CACHE_SIZE];
+    struct render_cache_entry *render_cache_last; // last returned, or NULL
+    uint64_t render_cache_uses;
+    uint64_t render_cache_lookups;
+    uint64_t render_cache_hits;
+    struct stats_ctx *stats;
+    struct stat_entry *stat_cache_hit, *stat_cache_miss, *stat_cache_rate;
     bool check_animated;
     bool duration_unknown;
 };
@@ -66,10 +105,12 @@ struct sd_ass_priv {
 struct seen_packet {
     int64_t pos;
     double pts;
+    int animated;
 };
 
 static void mangle_colors(struct sd *sd, struct sub_bitmaps *parts);
 static void fill_plaintext(struct sd *sd, double pts);
+static void render_cache_flush(struct sd_ass_priv *ctx);
 
 static const struct sd_filter_functions *const filters[] = {
     // Note: list order defines filter order.
@@ -257,6 +298,8 @@ static void assobjects_destroy(struct sd *sd)
 
     ass_free_track(ctx->ass_track);
     ass_free_track(ctx->shadow_track);
+    ctx->event_index.track = NULL;
+    render_cache_flush(ctx);
     enable_output(sd, false);
     ass_library_done(ctx->ass_library);
 }
@@ -280,6 +323,11 @@ static int init(struct sd *sd)
             ctx->duration_unknown = 1;
     }
 
+    ctx->stats = stats_ctx_create(ctx, sd->global, "sd_ass");
+    ctx->stat_cache_hit = stats_get_entry(ctx->stats, "render-cache-hit");
+    ctx->stat_cache_miss = stats_get_entry(ctx->stats, "render-cache-miss");
+    ctx->stat_cache_rate = stats_get_entry(ctx->stats, "render-cache-hit-rate");
+
     assobjects_init(sd);
     filters_init(sd);
 
@@ -355,7 +403,9 @@ static void filter_and_add(struct sd *sd, struct demux_packet *pkt)
     // This bookkeeping only has any practical use for ASS subs
     // over a VO with no video.
     if (!ctx->is_converted) {
-        if (!pkt->seen) {
+        // (Filters can return a new packet; the seen state is in orig_pkt.)
+        struct seen_packet *seen = &ctx->seen_packets[orig_pkt->seen_pos];
+        if (!orig_pkt->seen) {
             for (int n = track->n_events - 1; n >= 0; n--) {
                 if (n + 1 == old_n_events || pkt->animated == 1)
                     break;
@@ -365,18 +415,18 @@ static void filter_and_add(struct sd *sd, struct demux_packet *pkt)
                 if (ctx->check_animated && pkt->animated != 1)
                     pkt->animated = is_animated(event->Text);
             }
-            MP_TARRAY_APPEND(ctx, ctx->packets_animated, ctx->num_packets_animated, pkt->animated);
+            seen->animated = pkt->animated;
         } else {
-            if (ctx->check_animated && ctx->packets_animated[pkt->seen_pos] == -1) {
+            if (ctx->check_animated && seen->animated == -1) {
                 for (int n = track->n_events - 1; n >= 0; n--) {
                     if (n + 1 == old_n_events || pkt->animated == 1)
                         break;
                     ASS_Event *event = &track->events[n];
-                    ctx->packets_animated[pkt->seen_pos] = is_animated(event->Text);
-                    pkt->animated = ctx->packets_animated[pkt->seen_pos];
+                    seen->animated = is_animated(event->Text);
+                    pkt->animated = seen->animated;
                 }
             } else {
-                pkt->animated = ctx->packets_animated[pkt->seen_pos];
+                pkt->animated = seen->animated;
             }
         }
     }
@@ -385,34 +435,72 @@ static void filter_and_add(struct sd *sd, struct demux_packet *pkt)
         talloc_free(pkt);
 }
 
+static uint32_t seen_packet_hash(int64_t pos, double pts)
+{
+    uint64_t bits;
+    pts = pts == 0 ? 0 : pts; // -0.0 == 0.0
+    memcpy(&bits, &pts, sizeof(bits));
+    uint64_t h = ((uint64_t)pos * 0x9E3779B97F4A7C15ULL) ^ bits;
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ULL;
+    return h ^ (h >> 32);
+}
+
+static void seen_hash_insert(struct sd_ass_priv *priv, int index)
+{
+    struct seen_packet *p = &priv->seen_packets[index];
+    uint32_t mask = priv->seen_hash_size - 1;
+    uint32_t i = seen_packet_hash(p->pos, p->pts) & mask;
+    while (priv->seen_hash[i] >= 0)
+        i = (i + 1) & mask;
+    priv->seen_hash[i] = index;
+}
+
 // Test if the packet with the given file position and pts was already consumed.
-// Return false if the packet is new (and add it to the internal list), and
-// return true if it was already seen.
+// Return false if the packet is new (and add it to the internal set), and
+// return true if it was already seen. packet->seen_pos is set to the index of
+// the packet in seen_packets.
 static bool check_packet_seen(struct sd *sd, struct demux_packet *packet)
 {
     struct sd_ass_priv *priv = sd->priv;
-    int a = 0;
-    int b = priv->num_seen_packets;
-    while (a < b) {
-        int mid = a + (b - a) / 2;
-        struct seen_packet *seen_packet = &priv->seen_packets[mid];
-        if (packet->pos == seen_packet->pos && packet->pts == seen_packet->pts) {
-            packet->seen_pos = mid;
-            return true;
-        }
-        if (packet->pos > seen_packet->pos ||
-            (packet->pos == seen_packet->pos && packet->pts > seen_packet->pts)) {
-            a = mid + 1;
-        } else {
-            b = mid;
+
+    if (priv->seen_hash_size) {
+        uint32_t mask = priv->seen_hash_size - 1;
+        uint32_t i = seen_packet_hash(packet->pos, packet->pts) & mask;
+        for (; priv->seen_hash[i] >= 0; i = (i + 1) & mask) {
+            struct seen_packet *p = &priv->seen_packets[priv->seen_hash[i]];
+            if (packet->pos == p->pos && packet->pts == p->pts) {
+                packet->seen_pos = priv->seen_hash[i];
+                return true;
+            }
         }
     }
-    packet->seen_pos = a;
-    MP_TARRAY_INSERT_AT(priv, priv->seen_packets, priv->num_seen_packets, a,
-                        (struct seen_packet){packet->pos, packet->pts});
+
+    packet->seen_pos = priv->num_seen_packets;
+    MP_TARRAY_APPEND(priv, priv->seen_packets, priv->num_seen_packets,
+                     (struct seen_packet){packet->pos, packet->pts, packet->animated});
+
+    // Keep the load factor at most 1/2.
+    if (priv->num_seen_packets * 2 > priv->seen_hash_size) {
+        priv->seen_hash_size = MPMAX(priv->seen_hash_size * 2, 256);
+        priv->seen_hash = talloc_realloc(priv, priv->seen_hash, int,
+                                         priv->seen_hash_size);
+        memset(priv->seen_hash, -1, priv->seen_hash_size * sizeof(int));
+        for (int n = 0; n < priv->num_seen_packets; n++)
+            seen_hash_insert(priv, n);
+    } else {
+        seen_hash_insert(priv, packet->seen_pos);
+    }
     return false;
 }
 
+static void clear_seen_packets(struct sd_ass_priv *priv)
+{
+    priv->num_seen_packets = 0;
+    if (priv->seen_hash_size)
+        memset(priv->seen_hash, -1, priv->seen_hash_size * sizeof(int));
+}
+
 #define UNKNOWN_DURATION (INT_MAX / 1000)
 
 static void decode(struct sd *sd, struct demux_packet *packet)
@@ -460,6 +548,7 @@ static void decode(struct sd *sd, struct demux_packet *packet)
                     }
                 }
             }
+            ctx->event_index.stale = true;
         }
     } else {
         // Note that for this packet format, libass has an internal mechanism
@@ -615,6 +704,149 @@ static bool has_overrides(char *s)
 
 #define END(ev) ((ev)->Start + (ev)->Duration)
 
+static int cmp_event_index_entry(const void *a, const void *b)
+{
+    const struct event_index_entry *e1 = a, *e2 = b;
+    if (e1->start != e2->start)
+        return e1->start < e2->start ? -1 : 1;
+    return e1->event - e2->event;
+}
+
+static long long build_event_tree(struct event_index *ei, int lo, int hi)
+{
+    if (lo >= hi)
+        return LLONG_MIN;
+    int mid = lo + (hi - lo) / 2;
+    long long max = ei->entries[mid].end;
+    max = MPMAX(max, build_event_tree(ei, lo, mid));
+    max = MPMAX(max, build_event_tree(ei, mid + 1, hi));
+    ei->max_end[mid] = max;
+    return max;
+}
+
+// Bring the index up to date with the track. libass only appends events
+// (usually in start time order), or removes all of them.
+static void update_event_index(struct sd_ass_priv *ctx, ASS_Track *track)
+{
+    struct event_index *ei = &ctx->event_index;
+
+    if (ei->track != track || track->n_events < ei->num_entries) {
+        ei->track = track;
+        ei->num_entries = 0;
+        ei->tree_valid = false;
+    }
+
+    if (ei->stale) {
+        for (int n = 0; n < ei->num_entries; n++) {
+            struct event_index_entry *e = &ei->entries[n];
+            e->end = END(&track->events[e->event]);
+        }
+        ei->stale = false;
+        ei->tree_valid = false;
+    }
+
+    int num_new = track->n_events - ei->num_entries;
+    if (num_new > 0) {
+        MP_TARRAY_GROW(ctx, ei->entries, track->n_events - 1);
+        ei->max_end = talloc_realloc(ctx, ei->max_end, long long,
+                                     MP_TALLOC_AVAIL(ei->entries));
+        bool sorted = true;
+        for (int n = ei->num_entries; n < track->n_events; n++) {
+            ASS_Event *ev = &track->events[n];
+            struct event_index_entry e = {ev->Start, END(ev), n};
+            if (n && cmp_event_index_entry(&ei->entries[n - 1], &e) > 0)
+                sorted = false;
+            ei->entries[n] = e;
+        }
+        if (!sorted) {
+            qsort(ei->entries, track->n_events, sizeof(ei->entries[0]),
+                  cmp_event_index_entry);
+        }
+        ei->num_entries = track->n_events;
+        ei->tree_valid = false;
+    }
+
+    if (!ei->tree_valid) {
+        build_event_tree(ei, 0, ei->num_entries);
+        ei->tree_valid = true;
+    }
+}
+
+// Call cb for every event with start <= b and end >= a, in no particular
+// order. Stops and returns false if cb returns false.
+static bool query_event_tree(struct event_index *ei, int lo, int hi,
+                             long long a, long long b,
+                             bool (*cb)(void *ctx, int event), void *ctx)
+{
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ei->max_end[mid] < a)
+            return true; // nothing in this subtree ends late enough
+        if (!query_event_tree(ei, lo, mid, a, b, cb, ctx))
+            return false;
+        struct event_index_entry *e = &ei->entries[mid];
+        if (e->start > b)
+            return true; // this and all later events start too late
+        if (e->end >= a && !cb(ctx, e->event))
+            return false;
+        lo = mid + 1;
+    }
+    return true;
+}
+
+static bool query_events(struct sd_ass_priv *ctx, ASS_Track *track,
+                         long long a, long long b,
+                         bool (*cb)(void *ctx, int event), void *cb_ctx)
+{
+    update_event_index(ctx, track);
+    struct event_index *ei = &ctx->event_index;
+    return query_event_tree(ei, 0, ei->num_entries, a, b, cb, cb_ctx);
+}
+
+struct event_list {
+    ASS_Track *track;
+    ASS_Event *ev[2];
+    int num;
+    int *events;
+    int num_events;
+    void *ta_ctx;
+};
+
+static bool add_overlap(void *p, int event)
+{
+    struct event_list *l = p;
+    if (l->num >= MP_ARRAY_SIZE(l->ev))
+        return false;
+    l->ev[l->num++] = &l->track->events[event];
+    return true;
+}
+
+static bool add_event(void *p, int event)
+{
+    struct event_list *l = p;
+    MP_TARRAY_APPEND(l->ta_ctx, l->events, l->num_events, event);
+    return true;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+// Return the indexes of all events active at ts, in track order, in *events.
+static int find_events(struct sd *sd, ASS_Track *track, long long ts,
+                       int **events)
+{
+    struct sd_ass_priv *ctx = sd->priv;
+    struct event_list l = {.track = track, .ta_ctx = ctx,
+                           .events = *events};
+    // ts >= Start && ts < END
+    query_events(ctx, track, ts + 1, ts, add_event, &l);
+    qsort(l.events, l.num_events, sizeof(l.events[0]), cmp_int);
+    *events = l.events;
+    return l.num_events;
+}
+
 static long long find_timestamp(struct sd *sd, double pts)
 {
     struct sd_ass_priv *priv = sd->priv;
@@ -633,19 +865,14 @@ static long long find_timestamp(struct sd *sd, double pts)
     int keep = SUB_GAP_KEEP * 1000;
 
     // Find the "current" event.
-    ASS_Event *ev[2] = {0};
-    int n_ev = 0;
-    for (int n = 0; n < track->n_events; n++) {
-        ASS_Event *event = &track->events[n];
-        if (ts >= event->Start - threshold && ts <= END(event) + threshold) {
-            if (n_ev >= MP_ARRAY_SIZE(ev))
-                return ts; // multiple overlaps - give up (probably complex subs)
-            ev[n_ev++] = event;
-        }
-    }
+    struct event_list l = {.track = track};
+    if (!query_events(priv, track, ts - threshold, ts + threshold, add_overlap,
+                      &l))
+        return ts; // multiple overlaps - give up (probably complex subs)
 
-    if (n_ev != 2)
+    if (l.num != 2)
         return ts;
+    ASS_Event **ev = l.ev;
 
     // Simple/minor heuristic against destroying typesetting.
     if (ev[0]->Style != ev[1]->Style || has_overrides(ev[0]->Text) ||
@@ -681,6 +908,75 @@ static long long find_timestamp(struct sd *sd, double pts)
 
 #undef END
 
+static void render_cache_flush(struct sd_ass_priv *ctx)
+{
+    for (int n = 0; n < RENDER_CACHE_SIZE; n++)
+        TA_FREEP(&ctx->render_cache[n].imgs);
+    ctx->render_cache_last = NULL;
+}
+
+// Return whether the rendering of the given events depends only on the events
+// themselves (and the render parameters), and not on the time.
+static bool events_are_static(ASS_Track *track, int *events, int num_events)
+{
+    for (int n = 0; n < num_events; n++) {
+        ASS_Event *ev = &track->events[events[n]];
+        if ((ev->Effect && ev->Effect[0]) || (ev->Text && is_animated(ev->Text)))
+            return false;
+    }
+    return true;
+}
+
+static struct render_cache_entry *render_cache_find(struct sd_ass_priv *ctx,
+                                                    struct mp_osd_res *res,
+                                                    int format, int *events,
+                                                    int num_events)
+{
+    for (int n = 0; n < RENDER_CACHE_SIZE; n++) {
+        struct render_cache_entry *e = &ctx->render_cache[n];
+        if (e->imgs && e->format == format && e->num_events == num_events &&
+            osd_res_equals(e->res, *res) &&
+            memcmp(e->events, events, num_events * sizeof(events[0])) == 0)
+        {
+            e->last_use = ++ctx->render_cache_uses;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static struct render_cache_entry *render_cache_add(struct sd_ass_priv *ctx,
+                                                   struct mp_osd_res *res,
+                                                   int format, int *events,
+                                                   int num_events,
+                                                   struct sub_bitmaps *imgs)
+{
+    struct render_cache_entry *e = &ctx->render_cache[0];
+    for (int n = 1; n < RENDER_CACHE_SIZE; n++) {
+        struct render_cache_entry *c = &ctx->render_cache[n];
+        if (!c->imgs || (e->imgs && c->last_use < e->last_use))
+            e = c;
+    }
+    talloc_free(e->imgs);
+    e->res = *res;
+    e->format = format;
+    MP_TARRAY_GROW(ctx, e->events, num_events);
+    memcpy(e->events, events, num_events * sizeof(events[0]));
+    e->num_events = num_events;
+    e->imgs = talloc_steal(ctx, sub_bitmaps_copy(NULL, imgs));
+    e->last_use = ++ctx->render_cache_uses;
+    return e;
+}
+
+static void render_cache_stats(struct sd_ass_priv *ctx, bool hit)
+{
+    stats_entry_event(hit ? ctx->stat_cache_hit : ctx->stat_cache_miss);
+    ctx->render_cache_lookups += 1;
+    ctx->render_cache_hits += hit;
+    stats_entry_value(ctx->stat_cache_rate,
+                      ctx->render_cache_hits / (double)ctx->render_cache_lookups);
+}
+
 static struct sub_bitmaps *get_bitmaps(struct sd *sd, struct mp_osd_res dim,
                                        int format, double pts)
 {
@@ -693,6 +989,9 @@ static struct sub_bitmaps *get_bitmaps(struct sd *sd, struct mp_osd_res dim,
     ASS_Track *track = no_ass ? ctx->shadow_track : ctx->ass_track;
     ASS_Renderer *renderer = ctx->ass_renderer;
     struct sub_bitmaps *res = &(struct sub_bitmaps){0};
+    struct render_cache_entry *last = ctx->render_cache_last;
+    int num_events = 0;
+    bool cacheable = false;
 
     // Always update the osd_res
     struct mp_osd_res old_osd = ctx->osd;
@@ -718,6 +1017,8 @@ static struct sub_bitmaps *get_bitmaps(struct sd *sd, struct mp_osd_res dim,
         if (isnormal(par))
             scale *= par;
     }
+    if (!ctx->ass_configured)
+        render_cache_flush(ctx);
     if (!ctx->ass_configured || !osd_res_equals(old_osd, ctx->osd)) {
         configure_ass(sd, &dim, converted, track);
         ctx->ass_configured = true;
@@ -732,6 +1033,23 @@ static struct sub_bitmaps *get_bitmaps(struct sd *sd, struct mp_osd_res dim,
     }
     long long ts = find_timestamp(sd, pts);
 
+    // If the active events are static, reuse their previous rendering. (With
+    // no_ass, the plaintext track is derived from the same events.)
+    num_events = find_events(sd, ctx->ass_track, ts, &ctx->event_buf);
+    cacheable = num_events &&
+        events_are_static(ctx->ass_track, ctx->event_buf, num_events);
+    if (cacheable) {
+        struct render_cache_entry *e =
+            render_cache_find(ctx, &dim, format, ctx->event_buf, num_events);
+        render_cache_stats(ctx, !!e);
+        if (e) {
+            res = sub_bitmaps_copy(NULL, e->imgs);
+            res->change_id = e != last;
+            ctx->render_cache_last = e;
+            return res;
+        }
+    }
+
     if (no_ass)
         fill_plaintext(sd, pts);
 
@@ -746,6 +1064,16 @@ done:
     if (!converted && res)
         mangle_colors(sd, res);
 
+    ctx->render_cache_last = NULL;
+    if (res && cacheable) {
+        ctx->render_cache_last = render_cache_add(ctx, &dim, format,
+                                                  ctx->event_buf, num_events,
+                                                  res);
+    }
+    // libass and the packer only know about changes since the last render.
+    if (res && last)
+        res->change_id = 1;
+
     return res;
 }
 
@@ -828,43 +1156,42 @@ static bstr get_text_buf(struct sd *sd, double pts, enum sd_text_type type)
 
     b->len = 0;
 
-    for (int i = 0; i < track->n_events; ++i) {
-        ASS_Event *event = track->events + i;
-        if (ipts >= event->Start && ipts < event->Start + event->Duration) {
-            if (event->Text) {
-                int start = b->len;
-                if (type == SD_TEXT_TYPE_PLAIN) {
-                    ass_to_plaintext(b, event->Text);
-                } else if (type == SD_TEXT_TYPE_ASS_FULL) {
-                    long long s = event->Start;
-                    long long e = s + event->Duration;
-
-                    ASS_Style *style = (event->Style < 0 || event->Style >= track->n_styles) ? NULL : &track->styles[event->Style];
-
-                    int sh = (s / 60 / 60 / 1000);
-                    int sm = (s / 60 / 1000) % 60;
-                    int ss = (s / 1000) % 60;
-                    int sc = (s / 10) % 100;
-                    int eh = (e / 60 / 60 / 1000);
-                    int em = (e / 60 / 1000) % 60;
-                    int es = (e / 1000) % 60;
-                    int ec = (e / 10) % 100;
-
-                    bstr_xappend_asprintf(NULL, b, "Dialogue: %d,%d:%02d:%02d.%02d,%d:%02d:%02d.%02d,%s,%s,%04d,%04d,%04d,%s,%s",
-                        event->Layer,
-                        sh, sm, ss, sc,
-                        eh, em, es, ec,
-                        (style && style->Name) ? style->Name : "", event->Name,
-                        event->MarginL, event->MarginR, event->MarginV,
-                        event->Effect, event->Text);
-                } else {
-                    bstr_xappend(NULL, b, bstr0(event->Text));
-                }
-                if (is_whitespace_only(bstr_cut(*b, start))) {
-                    b->len = start;
-                } else {
-                    append(b, '\n');
-                }
+    int num_events = find_events(sd, track, ipts, &ctx->event_buf);
+    for (int i = 0; i < num_events; ++i) {
+        ASS_Event *event = track->events + ctx->event_buf[i];
+        if (event->Text) {
+            int start = b->len;
+            if (type == SD_TEXT_TYPE_PLAIN) {
+                ass_to_plaintext(b, event->Text);
+            } else if (type == SD_TEXT_TYPE_ASS_FULL) {
+                long long s = event->Start;
+                long long e = s + event->Duration;
+
+                ASS_Style *style = (event->Style < 0 || event->Style >= track->n_styles) ? NULL : &track->styles[event->Style];
+
+                int sh = (s / 60 / 60 / 1000);
+                int sm = (s / 60 / 1000) % 60;
+                int ss = (s / 1000) % 60;
+                int sc = (s / 10) % 100;
+                int eh = (e / 60 / 60 / 1000);
+                int em = (e / 60 / 1000) % 60;
+                int es = (e / 1000) % 60;
+                int ec = (e / 10) % 100;
+
+                bstr_xappend_asprintf(NULL, b, "Dialogue: %d,%d:%02d:%02d.%02d,%d:%02d:%02d.%02d,%s,%s,%04d,%04d,%04d,%s,%s",
+                    event->Layer,
+                    sh, sm, ss, sc,
+                    eh, em, es, ec,
+                    (style && style->Name) ? style->Name : "", event->Name,
+                    event->MarginL, event->MarginR, event->MarginV,
+                    event->Effect, event->Text);
+            } else {
+                bstr_xappend(NULL, b, bstr0(event->Text));
+            }
+            if (is_whitespace_only(bstr_cut(*b, start))) {
+                b->len = start;
+            } else {
+                append(b, '\n');
             }
         }
     }
@@ -890,19 +1217,18 @@ static struct sd_times get_times(struct sd *sd, double pts)
 
     long long ipts = find_timestamp(sd, pts);
 
-    for (int i = 0; i < track->n_events; ++i) {
-        ASS_Event *event = track->events + i;
-        if (ipts >= event->Start && ipts < event->Start + event->Duration) {
-            double start = event->Start / 1000.0;
-            double end = event->Duration == UNKNOWN_DURATION ?
-                MP_NOPTS_VALUE : (event->Start + event->Duration) / 1000.0;
+    int num_events = find_events(sd, track, ipts, &ctx->event_buf);
+    for (int i = 0; i < num_events; ++i) {
+        ASS_Event *event = track->events + ctx->event_buf[i];
+        double start = event->Start / 1000.0;
+        double end = event->Duration == UNKNOWN_DURATION ?
+            MP_NOPTS_VALUE : (event->Start + event->Duration) / 1000.0;
 
-            if (res.start == MP_NOPTS_VALUE || res.start > start)
-                res.start = start;
+        if (res.start == MP_NOPTS_VALUE || res.start > start)
+            res.start = start;
 
-            if (res.end == MP_NOPTS_VALUE || res.end < end)
-                res.end = end;
-        }
+        if (res.end == MP_NOPTS_VALUE || res.end < end)
+            res.end = end;
     }
 
     return res;
@@ -955,7 +1281,9 @@ static void reset(struct sd *sd)
     struct sd_ass_priv *ctx = sd->priv;
     if (sd->opts->sub_clear_on_seek || ctx->clear_once) {
         ass_flush_events(ctx->ass_track);
-        ctx->num_seen_packets = 0;
+        ctx->event_index.num_entries = 0;
+        render_cache_flush(ctx);
+        clear_seen_packets(ctx);
         sd->preload_ok = false;
         ctx->clear_once = false;
     }
@@ -991,9 +1319,13 @@ static int control(struct sd *sd, enum sd_ctrl cmd, void *arg)
     case SD_CTRL_SET_ANIMATED_CHECK:
         ctx->check_animated = *(bool *)arg;
         return CONTROL_OK;
-    case SD_CTRL_SET_VIDEO_PARAMS:
-        ctx->video_params = *(struct mp_image_params *)arg;
+    case SD_CTRL_SET_VIDEO_PARAMS: {
+        struct mp_image_params *params = arg;
+        if (!mp_image_params_equal(&ctx->video_params, params))
+            render_cache_flush(ctx);
+        ctx->video_params = *params;
         return CONTROL_OK;
+    }
     case SD_CTRL_UPDATE_OPTS: {
         int flags = (uintptr_t)arg;
         if (flags & UPDATE_SUB_FILT) {
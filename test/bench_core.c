@@ -0,0 +1,366 @@
+#include "common/common.h"
+#include "common/playlist.h"
+#include "demux/packet.h"
+#include "misc/bstr.h"
+#include "misc/dispatch.h"
+#include "misc/json.h"
+#include "misc/msgpack.h"
+#include "misc/node.h"
+#include "options/m_config_frontend.h"
+#include "options/m_option.h"
+#include "osdep/threads.h"
+#include "test_utils.h"
+
+// A track-list-like JSON document with many small maps and strings.
+static char *make_json_doc(void *ta_parent, int entries)
+{
+    char *s = talloc_strdup(ta_parent, "[");
+    for (int n = 0; n < entries; n++) {
+        s = talloc_asprintf_append(s, "%s{\"id\":%d,\"type\":\"video\","
+            "\"title\":\"Track \\\"%d\\\"\\n\",\"lang\":\"eng\","
+            "\"default\":true,\"demux-fps\":23.976,\"ff-index\":%d}",
+            n ? "," : "", n, n, n);
+    }
+    return talloc_strdup_append(s, "]");
+}
+
+// A metadata-like JSON document with long string values and few escapes.
+static char *make_json_str_doc(void *ta_parent, int entries)
+{
+    char *s = talloc_strdup(ta_parent, "{");
+    for (int n = 0; n < entries; n++) {
+        s = talloc_asprintf_append(s, "%s\"tag%d\":\"", n ? "," : "", n);
+        for (int i = 0; i < 20; i++)
+            s = talloc_strdup_append(s, "Lorem ipsum dolor sit amet, ");
+        s = talloc_strdup_append(s, "\\\"consectetur\\\"\\n\"");
+    }
+    return talloc_strdup_append(s, "}");
+}
+
+struct json_ctx {
+    char *doc;
+    struct mpv_node node;
+    bstr msgpack;
+};
+
+static void bench_json_parse(void *p)
+{
+    struct json_ctx *ctx = p;
+    void *tmp = talloc_new(NULL);
+    char *s = talloc_strdup(tmp, ctx->doc);
+    struct mpv_node res;
+    int r = json_parse(tmp, &res, &s, MAX_JSON_DEPTH);
+    assert_true(r >= 0);
+    talloc_free(tmp);
+}
+
+static void bench_json_write(void *p)
+{
+    struct json_ctx *ctx = p;
+    char *s = talloc_strdup(NULL, "");
+    int r = json_write(&s, &ctx->node);
+    assert_true(r >= 0);
+    talloc_free(s);
+}
+
+// The MessagePack equivalents of the JSON benchmarks, on the same document.
+static void bench_msgpack_parse(void *p)
+{
+    struct json_ctx *ctx = p;
+    void *tmp = talloc_new(NULL);
+    bstr src = bstrdup(tmp, ctx->msgpack);
+    struct mpv_node res;
+    int r = msgpack_parse(tmp, &res, &src, MAX_MSGPACK_DEPTH);
+    assert_true(r >= 0);
+    talloc_free(tmp);
+}
+
+static void bench_msgpack_write(void *p)
+{
+    struct json_ctx *ctx = p;
+    bstr dst = {0};
+    int r = msgpack_write(NULL, &dst, &ctx->node);
+    assert_true(r >= 0);
+    talloc_free(dst.start);
+}
+
+struct map_ctx {
+    struct mpv_node map;
+    struct node_map_index *index;
+    char keys[1000][16];
+};
+
+static void bench_map_get(void *p)
+{
+    struct map_ctx *ctx = p;
+    for (int n = 0; n < MP_ARRAY_SIZE(ctx->keys); n++)
+        assert_true(node_map_get(&ctx->map, ctx->keys[n]));
+}
+
+static void bench_map_index_get(void *p)
+{
+    struct map_ctx *ctx = p;
+    for (int n = 0; n < MP_ARRAY_SIZE(ctx->keys); n++)
+        assert_true(node_map_index_get(ctx->index, &ctx->map,
+                                       bstr0(ctx->keys[n])));
+}
+
+static void bench_bstr_split(void *p)
+{
+    // Roughly what input.conf/config file parsing does per line.
+    bstr rest = bstr0(p);
+    int count = 0;
+    while (rest.len) {
+        bstr line = bstr_strip(bstr_getline(rest, &rest));
+        if (bstr_startswith0(line, "#"))
+            continue;
+        bstr key, val;
+        if (bstr_split_tok(line, "=", &key, &val))
+            count += bstr_strip(key).len > 0;
+    }
+    assert_true(count > 0);
+}
+
+struct opt_entry {
+    const m_option_t opt;
+    const char *value;
+};
+
+static const struct opt_entry opt_entries[] = {
+    {{.type = CONF_TYPE_DOUBLE}, "1.5"},
+    {{.type = CONF_TYPE_TIME}, "01:02:03.5"},
+    {{.type = CONF_TYPE_STRING_LIST}, "a,b,c,d,e,f,g"},
+    {{.type = &m_option_type_keyvalue_list},
+        "threads=auto,tune=fastdecode,profile=main,flags=+low_delay"},
+};
+
+static void bench_m_option_parse(void *p)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(opt_entries); n++) {
+        const struct opt_entry *e = &opt_entries[n];
+        union m_option_value val = m_option_value_default;
+        int r = m_option_parse(NULL, &e->opt, bstr0("bench"), bstr0(e->value),
+                               &val);
+        assert_true(r >= 0);
+        m_option_free(&e->opt, &val);
+    }
+}
+
+#define CONFIG_OPTS 1000
+
+struct config_ctx {
+    struct m_config *config;
+    struct m_config_cache *cache;
+    char names[CONFIG_OPTS][16];
+};
+
+static void bench_m_config_get_co(void *p)
+{
+    struct config_ctx *ctx = p;
+    for (int n = 0; n < CONFIG_OPTS; n++)
+        assert_true(m_config_get_co_raw(ctx->config, bstr0(ctx->names[n])));
+}
+
+static void bench_m_config_notify(void *p)
+{
+    struct config_ctx *ctx = p;
+    int *opts = ctx->config->optstruct;
+    for (int n = 0; n < CONFIG_OPTS; n++) {
+        opts[n]++;
+        m_config_notify_change_opt_ptr(ctx->config, &opts[n]);
+    }
+}
+
+// A single option changes, and another cache of the same group picks it up.
+static void bench_m_config_cache_update(void *p)
+{
+    struct config_ctx *ctx = p;
+    int *opts = ctx->config->optstruct;
+    opts[7]++;
+    m_config_notify_change_opt_ptr(ctx->config, &opts[7]);
+    assert_true(m_config_cache_update(ctx->cache));
+}
+
+static void bench_demux_packet(void *p)
+{
+    struct demux_packet *pkts[16];
+    for (int n = 0; n < MP_ARRAY_SIZE(pkts); n++) {
+        pkts[n] = new_demux_packet(4096);
+        assert_true(pkts[n]);
+    }
+    for (int n = 0; n < MP_ARRAY_SIZE(pkts); n++)
+        talloc_free(pkts[n]);
+}
+
+// playlist.c is linked without the demux and stream layers.
+char *mp_file_url_to_filename(void *talloc_ctx, bstr url)
+{
+    return NULL;
+}
+
+struct demuxer_params;
+struct demuxer *demux_open_url(const char *url, struct demuxer_params *params,
+                               struct mp_cancel *cancel,
+                               struct mpv_global *global)
+{
+    return NULL;
+}
+
+void demux_free(struct demuxer *demuxer)
+{
+}
+
+#define PLAYLIST_ENTRIES 1000000
+
+static struct playlist *make_playlist(void *ta_parent, int entries)
+{
+    struct playlist *pl = talloc_zero(ta_parent, struct playlist);
+    for (int n = 0; n < entries; n++)
+        playlist_append_file(pl, "file.mkv");
+    return pl;
+}
+
+static void bench_playlist_append(void *p)
+{
+    struct playlist *pl = make_playlist(NULL, PLAYLIST_ENTRIES);
+    playlist_clear(pl);
+    talloc_free(pl);
+}
+
+static void bench_playlist_insert_remove(void *p)
+{
+    struct playlist *pl = p;
+    struct playlist_entry *at = playlist_entry_from_index(pl, pl->num_entries / 2);
+    struct playlist_entry *e = playlist_entry_new("new.mkv");
+    playlist_insert_at(pl, e, at);
+    assert_int_equal(playlist_entry_to_index(pl, e), pl->num_entries / 2);
+    playlist_remove(pl, e);
+}
+
+static void bench_playlist_move(void *p)
+{
+    // Like "playlist-move 0 -1" in a loop.
+    struct playlist *pl = p;
+    struct playlist_entry *e = playlist_get_first(pl);
+    playlist_move(pl, e, NULL);
+    assert_int_equal(playlist_entry_to_index(pl, e), pl->num_entries - 1);
+}
+
+struct dispatch_ctx {
+    struct mp_dispatch_queue *queue;
+    mp_thread thread;
+    bool terminate;
+    int counter;
+};
+
+static MP_THREAD_VOID dispatch_thread(void *p)
+{
+    struct dispatch_ctx *ctx = p;
+    while (!ctx->terminate)
+        mp_dispatch_queue_process(ctx->queue, INFINITY);
+    MP_THREAD_RETURN();
+}
+
+static void dispatch_inc(void *p)
+{
+    struct dispatch_ctx *ctx = p;
+    ctx->counter++;
+}
+
+static void dispatch_terminate(void *p)
+{
+    struct dispatch_ctx *ctx = p;
+    ctx->terminate = true;
+}
+
+static void bench_dispatch_run(void *p)
+{
+    struct dispatch_ctx *ctx = p;
+    mp_dispatch_run(ctx->queue, dispatch_inc, ctx);
+}
+
+int main(void)
+{
+    void *ta = talloc_new(NULL);
+
+    struct json_ctx json = {.doc = make_json_doc(ta, 1000)};
+    char *s = talloc_strdup(ta, json.doc);
+    assert_true(json_parse(ta, &json.node, &s, MAX_JSON_DEPTH) >= 0);
+    bench_run("json/parse-1000", 100, bench_json_parse, &json);
+    bench_run("json/write-1000", 100, bench_json_write, &json);
+    assert_true(msgpack_write(ta, &json.msgpack, &json.node) >= 0);
+    printf("# json %zu bytes, msgpack %zu bytes\n", strlen(json.doc),
+           json.msgpack.len);
+    bench_run("msgpack/parse-1000", 100, bench_msgpack_parse, &json);
+    bench_run("msgpack/write-1000", 100, bench_msgpack_write, &json);
+
+    // Throughput is the document size divided by the time per iteration.
+    struct json_ctx json_str = {.doc = make_json_str_doc(ta, 100)};
+    s = talloc_strdup(ta, json_str.doc);
+    assert_true(json_parse(ta, &json_str.node, &s, MAX_JSON_DEPTH) >= 0);
+    printf("# json strings %zu bytes\n", strlen(json_str.doc));
+    bench_run("json/parse-strings-100", 100, bench_json_parse, &json_str);
+    bench_run("json/write-strings-100", 100, bench_json_write, &json_str);
+
+    struct map_ctx *map = talloc_zero(ta, struct map_ctx);
+    node_init(&map->map, MPV_FORMAT_NODE_MAP, NULL);
+    talloc_steal(ta, map->map.u.list);
+    map->index = node_map_index_create(ta);
+    for (int n = 0; n < MP_ARRAY_SIZE(map->keys); n++) {
+        snprintf(map->keys[n], sizeof(map->keys[n]), "key-%d", n);
+        node_map_add_int64(&map->map, map->keys[n], n);
+    }
+    bench_run("node/map-get-1000", 10, bench_map_get, map);
+    bench_run("node/map-index-get-1000", 10, bench_map_index_get, map);
+
+    char *conf = talloc_strdup(ta, "");
+    for (int n = 0; n < 1000; n++) {
+        conf = talloc_asprintf_append(conf, "# comment %d\n"
+                                      "option-%d = value %d\n", n, n, n);
+    }
+    bench_run("bstr/split-lines-1000", 1000, bench_bstr_split, conf);
+    bench_run("m_option/parse", 10000, bench_m_option_parse, NULL);
+    bench_run("demux_packet/alloc-free-16", 10000, bench_demux_packet, NULL);
+
+    struct config_ctx *cfg = talloc_zero(ta, struct config_ctx);
+    struct m_option *cfg_opts = talloc_zero_array(ta, struct m_option,
+                                                  CONFIG_OPTS + 1);
+    for (int n = 0; n < CONFIG_OPTS; n++) {
+        snprintf(cfg->names[n], sizeof(cfg->names[n]), "opt-%d", n);
+        cfg_opts[n] = (struct m_option){
+            .name = cfg->names[n],
+            .type = &m_option_type_int,
+            .offset = n * sizeof(int),
+        };
+    }
+    struct m_sub_options *cfg_root = talloc_ptrtype(ta, cfg_root);
+    *cfg_root = (struct m_sub_options){
+        .opts = cfg_opts,
+        .size = CONFIG_OPTS * sizeof(int),
+    };
+    cfg->config = m_config_new(ta, NULL, cfg_root);
+    bench_run("m_config/get-co-1000", 100, bench_m_config_get_co, cfg);
+    bench_run("m_config/notify-1000", 100, bench_m_config_notify, cfg);
+    cfg->cache = m_config_cache_from_shadow(ta, cfg->config->cache->shadow,
+                                            cfg_root);
+    bench_run("m_config/cache-update-1-of-1000", 10000,
+              bench_m_config_cache_update, cfg);
+
+    struct playlist *pl = make_playlist(ta, PLAYLIST_ENTRIES);
+    bench_run("playlist/append-1M", 1, bench_playlist_append, NULL);
+    bench_run("playlist/insert-remove-middle-1M", 1000,
+              bench_playlist_insert_remove, pl);
+    bench_run("playlist/move-first-to-end-1M", 1000, bench_playlist_move, pl);
+    playlist_clear(pl);
+
+    struct dispatch_ctx dispatch = {.queue = mp_dispatch_create(ta)};
+    assert_false(mp_thread_create(&dispatch.thread, dispatch_thread, &dispatch));
+    bench_run("dispatch/run-roundtrip", 10000, bench_dispatch_run, &dispatch);
+    mp_dispatch_run(dispatch.queue, dispatch_terminate, &dispatch);
+    mp_dispatch_interrupt(dispatch.queue);
+    mp_thread_join(dispatch.thread);
+    assert_true(dispatch.counter > 0);
+
+    talloc_free(ta);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// JSON IPC benchmark with many concurrent socket clients. This only uses the
+// public API, so it can't use test_utils; the output has the same format as
+// bench_run(): <name> <iterations> <nanoseconds per iteration>
+
+#include <libmpv/client.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_REPEAT 5
+
+struct client {
+    int fd;
+    char buf[4096];
+    size_t len;
+};
+
+static mpv_handle *ctx;
+
+static void check(bool ok, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "bench-ipc: %s failed\n", what);
+        exit(1);
+    }
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void send_line(struct client *c, const char *line)
+{
+    size_t len = strlen(line);
+    check(write(c->fd, line, len) == len, "write");
+}
+
+// Read lines until one contains the given substring.
+static void wait_line(struct client *c, const char *substr)
+{
+    while (1) {
+        char *end;
+        while ((end = memchr(c->buf, '\n', c->len))) {
+            *end = '\0';
+            bool found = strstr(c->buf, substr);
+            c->len -= end + 1 - c->buf;
+            memmove(c->buf, end + 1, c->len);
+            if (found)
+                return;
+        }
+        check(c->len < sizeof(c->buf), "line length");
+        ssize_t r = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+        check(r > 0, "read");
+        c->len += r;
+    }
+}
+
+static struct client *connect_clients(const char *path, int num)
+{
+    struct client *clients = calloc(num, sizeof(clients[0]));
+    check(clients, "calloc");
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    for (int n = 0; n < num; n++) {
+        clients[n].fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        check(clients[n].fd >= 0, "socket");
+        // The listening socket is created asynchronously.
+        int tries = 0;
+        while (connect(clients[n].fd, (struct sockaddr *)&addr, sizeof(addr))) {
+            check(tries++ < 1000, "connect");
+            usleep(1000);
+        }
+        send_line(&clients[n],
+                  "{\"command\":[\"observe_property\",1,\"user-data/bench\"]}\n");
+        wait_line(&clients[n], "\"event\":\"property-change\"");
+    }
+    return clients;
+}
+
+// Time until every client has seen a property change.
+static int64_t run_observe(struct client *clients, int num, int iterations)
+{
+    static int value;
+    int64_t start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        char str[32], expect[48];
+        snprintf(str, sizeof(str), "%d", ++value);
+        snprintf(expect, sizeof(expect), "\"data\":\"%s\"", str);
+        check(mpv_set_property_string(ctx, "user-data/bench", str) >= 0,
+              "set_property");
+        for (int n = 0; n < num; n++)
+            wait_line(&clients[n], expect);
+    }
+    return now_ns() - start;
+}
+
+// Every client sends a request, then all replies are collected.
+static int64_t run_request(struct client *clients, int num, int iterations)
+{
+    int64_t start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        for (int n = 0; n < num; n++)
+            send_line(&clients[n], "{\"command\":[\"get_property\",\"volume\"],"
+                                   "\"request_id\":7}\n");
+        for (int n = 0; n < num; n++)
+            wait_line(&clients[n], "\"request_id\":7");
+    }
+    return now_ns() - start;
+}
+
+static void bench(const char *name, int64_t (*fn)(struct client *, int, int),
+                  struct client *clients, int num, int iterations)
+{
+    fn(clients, num, 1); // warmup
+    int64_t best = INT64_MAX;
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        int64_t t = fn(clients, num, iterations);
+        best = t < best ? t : best;
+    }
+    printf("%-36s %10d %14.1f\n", name, iterations, best / (double)iterations);
+    fflush(stdout);
+}
+
+int main(void)
+{
+    char dir[] = "/tmp/mpv-bench-ipc-XXXXXX";
+    check(mkdtemp(dir), "mkdtemp");
+    char path[64];
+    snprintf(path, sizeof(path), "%s/socket", dir);
+
+    ctx = mpv_create();
+    check(ctx, "mpv_create");
+    check(mpv_set_option_string(ctx, "idle", "yes") >= 0, "idle");
+    check(mpv_set_option_string(ctx, "input-ipc-server", path) >= 0, "ipc");
+    check(mpv_initialize(ctx) >= 0, "mpv_initialize");
+
+    static const int counts[] = {1, 16, 256};
+    for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        int num = counts[i];
+        struct client *clients = connect_clients(path, num);
+        char name[64];
+        snprintf(name, sizeof(name), "ipc/observe-%d-clients", num);
+        bench(name, run_observe, clients, num, 100);
+        snprintf(name, sizeof(name), "ipc/request-%d-clients", num);
+        bench(name, run_request, clients, num, 100);
+        for (int n = 0; n < num; n++)
+            close(clients[n].fd);
+        free(clients);
+    }
+
+    mpv_terminate_destroy(ctx);
+    unlink(path);
+    rmdir(dir);
+    return 0;
+}
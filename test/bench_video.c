@@ -0,0 +1,182 @@
+#include "common/common.h"
+#include "img_utils.h"
+#include "sub/draw_bmp.h"
+#include "sub/osd.h"
+#include "test_utils.h"
+#include "video/mp_image.h"
+#include "video/img_format.h"
+#include "video/repack.h"
+#include "video/sws_utils.h"
+
+#define W 1920
+#define H 1080
+
+// Fill with something that is not constant, so that no conversion path can
+// take shortcuts.
+static void fill_image(struct mp_image *img)
+{
+    for (int p = 0; p < img->num_planes; p++) {
+        int h = mp_image_plane_h(img, p);
+        int bytes = mp_image_plane_w(img, p) * img->fmt.bpp[p] / 8;
+        for (int y = 0; y < h; y++) {
+            uint8_t *line = img->planes[p] + img->stride[p] * (ptrdiff_t)y;
+            for (int x = 0; x < bytes; x++)
+                line[x] = (x * 7 + y * 13 + p * 31) & 0xFF;
+        }
+    }
+}
+
+struct repack_ctx {
+    struct mp_repack *rp;
+    int align_y;
+};
+
+static void bench_repack(void *p)
+{
+    struct repack_ctx *ctx = p;
+    for (int y = 0; y < H; y += ctx->align_y)
+        repack_line(ctx->rp, 0, y, 0, y, W);
+}
+
+static void run_repack(int imgfmt, bool pack)
+{
+    struct mp_repack *rp = mp_repack_create_planar(imgfmt, pack, 0);
+    assert_true(rp);
+
+    int src_fmt = mp_repack_get_format_src(rp);
+    int dst_fmt = mp_repack_get_format_dst(rp);
+    struct mp_image *src = mp_image_alloc(src_fmt, W, H);
+    struct mp_image *dst = mp_image_alloc(dst_fmt, W, H);
+    assert_true(src && dst);
+    fill_image(src);
+
+    bool pass = false;
+    assert_true(repack_config_buffers(rp, 0, dst, 0, src, &pass));
+
+    struct repack_ctx ctx = {rp, mp_repack_get_align_y(rp)};
+    char *name = mp_tprintf(80, "repack/%s-%s", pack ? "pack" : "unpack",
+                            mp_imgfmt_to_name(imgfmt));
+    bench_run(name, 20, bench_repack, &ctx);
+
+    talloc_free(rp);
+    talloc_free(src);
+    talloc_free(dst);
+}
+
+struct scale_ctx {
+    struct mp_sws_context *sws;
+    struct mp_image *src, *dst;
+};
+
+static void bench_scale(void *p)
+{
+    struct scale_ctx *ctx = p;
+    assert_true(mp_sws_scale(ctx->sws, ctx->dst, ctx->src) >= 0);
+}
+
+static void run_scale(enum mp_sws_scaler scaler, int src_fmt, int dst_fmt,
+                      int dst_w, int dst_h)
+{
+    struct scale_ctx ctx = {
+        .sws = mp_sws_alloc(NULL),
+        .src = mp_image_alloc(src_fmt, W, H),
+        .dst = mp_image_alloc(dst_fmt, dst_w, dst_h),
+    };
+    assert_true(ctx.src && ctx.dst);
+    fill_image(ctx.src);
+    ctx.sws->force_scaler = scaler;
+    if (!mp_sws_supports_formats(ctx.sws, dst_fmt, src_fmt))
+        goto done;
+
+    char *name = mp_tprintf(80, "scale/%s/%s-%dx%d-%s",
+                            scaler == MP_SWS_ZIMG ? "zimg" : "sws",
+                            mp_imgfmt_to_name(src_fmt), dst_w, dst_h,
+                            mp_imgfmt_to_name(dst_fmt));
+    bench_run(name, 10, bench_scale, &ctx);
+
+done:
+    talloc_free(ctx.sws);
+    talloc_free(ctx.src);
+    talloc_free(ctx.dst);
+}
+
+struct draw_ctx {
+    struct mp_draw_sub_cache *cache;
+    struct mp_image *dst;
+    struct sub_bitmaps sbs;
+    struct sub_bitmap_list list;
+};
+
+static void bench_draw_bmp(void *p)
+{
+    struct draw_ctx *ctx = p;
+    // Pretend the subtitles changed, so that the overlay is re-rendered too.
+    ctx->sbs.change_id++;
+    ctx->list.change_id++;
+    assert_true(mp_draw_sub_bitmaps(ctx->cache, ctx->dst, &ctx->list));
+}
+
+static void run_draw_bmp(int imgfmt)
+{
+    void *ta = talloc_new(NULL);
+
+    // A few subtitle lines worth of libass glyph coverage at the bottom.
+    struct sub_bitmap *parts = talloc_zero_array(ta, struct sub_bitmap, 4);
+    for (int n = 0; n < 4; n++) {
+        int w = 1200, h = 60;
+        uint8_t *bitmap = talloc_size(ta, w * h);
+        for (int i = 0; i < w * h; i++)
+            bitmap[i] = (i % 5) ? 0 : (i * 37) & 0xFF;
+        parts[n] = (struct sub_bitmap){
+            .bitmap = bitmap,
+            .stride = w,
+            .x = (W - w) / 2,
+            .y = H - 300 + n * 70,
+            .w = w, .dw = w,
+            .h = h, .dh = h,
+            .libass = { .color = 0xFFFFFF00 },
+        };
+    }
+
+    struct draw_ctx *ctx = talloc_zero(ta, struct draw_ctx);
+    ctx->dst = talloc_steal(ta, mp_image_alloc(imgfmt, W, H));
+    assert_true(ctx->dst);
+    fill_image(ctx->dst);
+    ctx->sbs = (struct sub_bitmaps){
+        .format = SUBBITMAP_LIBASS,
+        .parts = parts,
+        .num_parts = 4,
+    };
+    ctx->list = (struct sub_bitmap_list){
+        .w = W,
+        .h = H,
+        .items = (struct sub_bitmaps *[]){&ctx->sbs},
+        .num_items = 1,
+    };
+    ctx->cache = talloc_steal(ta, mp_draw_sub_alloc_test(ctx->dst));
+
+    char *name = mp_tprintf(80, "draw_bmp/libass-%s", mp_imgfmt_to_name(imgfmt));
+    bench_run(name, 20, bench_draw_bmp, ctx);
+
+    talloc_free(ta);
+}
+
+int main(void)
+{
+    init_imgfmts_list();
+
+    run_repack(IMGFMT_RGB0, false);
+    run_repack(IMGFMT_RGB0, true);
+    run_repack(IMGFMT_NV12, false);
+    run_repack(IMGFMT_NV12, true);
+
+    run_scale(MP_SWS_SWS, IMGFMT_420P, IMGFMT_420P, 1280, 720);
+    run_scale(MP_SWS_ZIMG, IMGFMT_420P, IMGFMT_420P, 1280, 720);
+    run_scale(MP_SWS_SWS, IMGFMT_420P, IMGFMT_RGB0, W, H);
+    run_scale(MP_SWS_ZIMG, IMGFMT_420P, IMGFMT_RGB0, W, H);
+
+    run_draw_bmp(IMGFMT_420P);
+    run_draw_bmp(IMGFMT_RGB0);
+
+    return 0;
+}
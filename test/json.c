@@ -63,6 +63,60 @@ static const struct entry entries[] = {
         NODE_MAP(L("_a12"), L(NODE_STR("b")))},
 };
 
+// Plain reference implementation of the string escaping in json_write().
+static void escape_ref(bstr *dst, const char *str)
+{
+    bstr_xappend(NULL, dst, bstr0("\""));
+    for (const unsigned char *cur = str; *cur; cur++) {
+        if (*cur == '"' || *cur == '\\') {
+            bstr_xappend_asprintf(NULL, dst, "\\%c", *cur);
+        } else if (*cur == '\n') {
+            bstr_xappend(NULL, dst, bstr0("\\n"));
+        } else if (*cur < 32) {
+            bstr_xappend_asprintf(NULL, dst, "\\u%04x", *cur);
+        } else {
+            bstr_xappend(NULL, dst, (bstr){(unsigned char *)cur, 1});
+        }
+    }
+    bstr_xappend(NULL, dst, bstr0("\""));
+}
+
+// Check escaping and unescaping of special characters at every position
+// relative to the word-at-a-time scanning.
+static void test_strings(void)
+{
+    static const char specials[] = {'"', '\\', '\n', '\x01', '\x1f', ' ', '\x7f'};
+    for (int len = 1; len <= 40; len++) {
+        for (int pos = 0; pos < len; pos++) {
+            for (int n = 0; n < MP_ARRAY_SIZE(specials); n++) {
+                void *tmp = talloc_new(NULL);
+                char *str = talloc_zero_size(tmp, len + 1);
+                for (int i = 0; i < len; i++)
+                    str[i] = 'a' + i % 26;
+                str[pos] = specials[n];
+                if (pos + 2 < len)
+                    str[pos + 2] = '\xc3'; // high bytes are never escaped
+
+                struct mpv_node node = {.format = MPV_FORMAT_STRING,
+                                        .u.string = str};
+                char *d = talloc_strdup(tmp, "");
+                assert_true(json_write(&d, &node) >= 0);
+                bstr ref = {0};
+                escape_ref(&ref, str);
+                assert_string_equal(ref.start, d);
+                talloc_free(ref.start);
+
+                struct mpv_node res;
+                char *s = d;
+                assert_true(json_parse(tmp, &res, &s, MAX_JSON_DEPTH) >= 0);
+                assert_int_equal(s[0], '\0');
+                assert_true(equal_mpv_node(&node, &res));
+                talloc_free(tmp);
+            }
+        }
+    }
+}
+
 int main(void)
 {
     for (int n = 0; n < MP_ARRAY_SIZE(entries); n++) {
@@ -83,5 +137,6 @@ int main(void)
         assert_true(equal_mpv_node(&e->out_data, &res));
         talloc_free(tmp);
     }
+    test_strings();
     return 0;
 }
@@ -223,6 +223,313 @@ static void test_lavfi_complex(char *file)
         fail("Lavfi complex failed!\n");
 }
 
+static int64_t node_map_int(mpv_node *node, const char *key)
+{
+    for (int n = 0; node->format == MPV_FORMAT_NODE_MAP && n < node->u.list->num; n++) {
+        mpv_node *val = &node->u.list->values[n];
+        if (strcmp(node->u.list->keys[n], key) == 0 && val->format == MPV_FORMAT_INT64)
+            return val->u.int64;
+    }
+    fail("Map: no integer field '%s'!\n", key);
+}
+
+static mpv_node *node_map_get(mpv_node *node, const char *key)
+{
+    for (int n = 0; node->format == MPV_FORMAT_NODE_MAP && n < node->u.list->num; n++) {
+        if (strcmp(node->u.list->keys[n], key) == 0)
+            return &node->u.list->values[n];
+    }
+    fail("Map: no field '%s'!\n", key);
+}
+
+static void check_file_exists(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        fail("File '%s' was not written!\n", path);
+    fclose(f);
+    remove(path);
+}
+
+static void test_screenshot_thumbnails(char *file)
+{
+    check_api_error(mpv_set_property_string(ctx, "pause", "yes"));
+    check_api_error(mpv_set_property_string(ctx, "keep-open", "yes"));
+    const char *cmd[] = {"loadfile", file, NULL};
+    check_api_error(mpv_command(ctx, cmd));
+    while (wrap_wait_event()->event_id != MPV_EVENT_FILE_LOADED) {}
+
+    // One file per timestamp.
+    mpv_node res;
+    const char *files_cmd[] = {"screenshot-thumbnails", "0,0", "libmpv-test-thumb.png",
+                               "16", NULL};
+    check_api_error(mpv_command_ret(ctx, files_cmd, &res));
+    mpv_node *list = node_map_get(&res, "filenames");
+    if (list->format != MPV_FORMAT_NODE_ARRAY || list->u.list->num != 2)
+        fail("Thumbnails: expected 2 files!\n");
+    const char *names[] = {"libmpv-test-thumb-0001.png", "libmpv-test-thumb-0002.png"};
+    for (int n = 0; n < 2; n++) {
+        mpv_node *name = &list->u.list->values[n];
+        if (name->format != MPV_FORMAT_STRING || strcmp(name->u.string, names[n]) != 0)
+            fail("Thumbnails: expected '%s'!\n", names[n]);
+        check_file_exists(names[n]);
+    }
+    mpv_free_node_contents(&res);
+
+    // Sprite sheet with 3 tiles in 2 columns.
+    const char *sheet_cmd[] = {"screenshot-thumbnails", "0,0,0", "libmpv-test-sheet.png",
+                               "16", "2", NULL};
+    check_api_error(mpv_command_ret(ctx, sheet_cmd, &res));
+    if (node_map_int(&res, "w") != 16 || node_map_int(&res, "h") != 16 ||
+        node_map_int(&res, "columns") != 2 || node_map_int(&res, "rows") != 2)
+        fail("Thumbnails: unexpected sheet layout!\n");
+    check_file_exists("libmpv-test-sheet.png");
+    mpv_free_node_contents(&res);
+
+    const char *stop_cmd[] = {"stop", NULL};
+    check_api_error(mpv_command(ctx, stop_cmd));
+    while (wrap_wait_event()->event_id != MPV_EVENT_END_FILE) {}
+    check_api_error(mpv_set_property_string(ctx, "keep-open", "no"));
+    check_api_error(mpv_set_property_string(ctx, "pause", "no"));
+}
+
+#define DELTA_USERDATA 34
+#define MAX_MIRROR 1024
+
+// Playlist entry IDs as reconstructed from the delta events.
+static int64_t mirror[MAX_MIRROR];
+static int mirror_num;
+
+static void mirror_insert(int index, mpv_node *entries)
+{
+    int num = entries->u.list->num;
+    if (index < 0 || index > mirror_num || mirror_num + num > MAX_MIRROR)
+        fail("Delta: invalid insert at %d!\n", index);
+    memmove(&mirror[index + num], &mirror[index],
+            (mirror_num - index) * sizeof(mirror[0]));
+    for (int n = 0; n < num; n++)
+        mirror[index + n] = node_map_int(&entries->u.list->values[n], "id");
+    mirror_num += num;
+}
+
+static void mirror_remove(int index, int count)
+{
+    if (index < 0 || count < 0 || index + count > mirror_num)
+        fail("Delta: invalid remove at %d!\n", index);
+    memmove(&mirror[index], &mirror[index + count],
+            (mirror_num - index - count) * sizeof(mirror[0]));
+    mirror_num -= count;
+}
+
+// Apply the ops of a delta event; return whether it contained a reset.
+static int apply_delta(mpv_node *data)
+{
+    int reset = 0;
+    mpv_node *ops = node_map_get(data, "ops");
+    for (int n = 0; n < ops->u.list->num; n++) {
+        mpv_node *op = &ops->u.list->values[n];
+        const char *type = node_map_get(op, "op")->u.string;
+        if (strcmp(type, "reset") == 0) {
+            mirror_num = 0;
+            mirror_insert(0, node_map_get(op, "entries"));
+            reset = 1;
+        } else if (strcmp(type, "insert") == 0) {
+            mirror_insert(node_map_int(op, "index"), node_map_get(op, "entries"));
+        } else if (strcmp(type, "remove") == 0) {
+            mirror_remove(node_map_int(op, "index"), node_map_int(op, "count"));
+        } else if (strcmp(type, "move") == 0) {
+            int from = node_map_int(op, "from"), to = node_map_int(op, "to");
+            if (from < 0 || from >= mirror_num || to < 0 || to >= mirror_num)
+                fail("Delta: invalid move from %d to %d!\n", from, to);
+            int64_t id = mirror[from];
+            mirror_remove(from, 1);
+            memmove(&mirror[to + 1], &mirror[to], (mirror_num - to) * sizeof(mirror[0]));
+            mirror[to] = id;
+            mirror_num += 1;
+        } else if (strcmp(type, "update") == 0) {
+            int index = node_map_int(op, "index");
+            if (index < 0 || index >= mirror_num)
+                fail("Delta: invalid update at %d!\n", index);
+            mirror[index] = node_map_int(node_map_get(op, "entry"), "id");
+        } else {
+            fail("Delta: unknown op '%s'!\n", type);
+        }
+    }
+    if (node_map_int(data, "count") != mirror_num)
+        fail("Delta: count %d does not match!\n", mirror_num);
+    return reset;
+}
+
+static int mirror_matches_playlist(void)
+{
+    mpv_node list;
+    check_api_error(mpv_get_property(ctx, "playlist", MPV_FORMAT_NODE, &list));
+    int equal = list.u.list->num == mirror_num;
+    for (int n = 0; equal && n < mirror_num; n++)
+        equal = node_map_int(&list.u.list->values[n], "id") == mirror[n];
+    mpv_free_node_contents(&list);
+    return equal;
+}
+
+// Apply delta events until the mirror matches the playlist. Return whether a
+// reset was received.
+static int sync_delta(void)
+{
+    int reset = 0;
+    while (!mirror_matches_playlist()) {
+        mpv_event *event = mpv_wait_event(ctx, 10);
+        if (event->event_id == MPV_EVENT_NONE)
+            fail("Delta: timeout waiting for playlist changes!\n");
+        if (event->event_id == MPV_EVENT_PROPERTY_CHANGE &&
+            event->reply_userdata == DELTA_USERDATA)
+        {
+            mpv_event_property *prop = event->data;
+            if (prop->format != MPV_FORMAT_NODE)
+                fail("Delta: expected MPV_FORMAT_NODE!\n");
+            reset |= apply_delta(prop->data);
+        }
+    }
+    return reset;
+}
+
+static void test_observe_property_delta(char *file)
+{
+    if (mpv_observe_property_delta(ctx, DELTA_USERDATA, "volume") !=
+        MPV_ERROR_NOT_IMPLEMENTED)
+        fail("Delta: observing a non-list property should fail!\n");
+    check_api_error(mpv_observe_property_delta(ctx, DELTA_USERDATA, "playlist"));
+
+    // The initial event is a reset.
+    mirror_num = -1;
+    while (mirror_num < 0) {
+        mpv_event *event = wrap_wait_event();
+        if (event->event_id == MPV_EVENT_PROPERTY_CHANGE &&
+            event->reply_userdata == DELTA_USERDATA)
+        {
+            mirror_num = 0;
+            if (!apply_delta(((mpv_event_property *)event->data)->data))
+                fail("Delta: initial event is not a reset!\n");
+        }
+    }
+
+    const char *append[] = {"loadfile", file, "append", NULL};
+    for (int n = 0; n < 3; n++)
+        check_api_error(mpv_command(ctx, append));
+    sync_delta();
+
+    const char *move[] = {"playlist-move", "0", "3", NULL};
+    check_api_error(mpv_command(ctx, move));
+    sync_delta();
+
+    const char *remove[] = {"playlist-remove", "1", NULL};
+    check_api_error(mpv_command(ctx, remove));
+    if (sync_delta())
+        fail("Delta: unexpected reset for a small change!\n");
+
+    // Each command is a separate change, so not reading events for a while
+    // creates more ops than are kept for a client, and it gets a reset.
+    for (int n = 0; n < 300; n++)
+        check_api_error(mpv_command(ctx, append));
+    if (!sync_delta())
+        fail("Delta: expected a reset after too many changes!\n");
+
+    check_api_error(mpv_unobserve_property(ctx, DELTA_USERDATA));
+    const char *clear[] = {"playlist-clear", NULL};
+    check_api_error(mpv_command(ctx, clear));
+}
+
+// Check an entry of a mpv_get_property_list()/mpv_command_list() result.
+static void check_list_entry(mpv_node *result, int index, int error,
+                             mpv_format data_format)
+{
+    if (result->format != MPV_FORMAT_NODE_ARRAY || index >= result->u.list->num)
+        fail("List: missing entry %d!\n", index);
+    mpv_node *entry = &result->u.list->values[index];
+    const char *err = node_map_get(entry, "error")->u.string;
+    if (strcmp(err, mpv_error_string(error)) != 0)
+        fail("List: entry %d: expected error '%s' but got '%s'!\n", index,
+             mpv_error_string(error), err);
+    if (data_format && node_map_get(entry, "data")->format != data_format)
+        fail("List: entry %d: unexpected data format!\n", index);
+}
+
+#define STR_NODE(s) {.format = MPV_FORMAT_STRING, .u.string = (char *)(s)}
+#define LIST_NODE(l) {.format = MPV_FORMAT_NODE_ARRAY, .u.list = &(l)}
+
+static void test_list_requests(void)
+{
+    // Failing entries may log errors, which wrap_wait_event() would reject.
+    check_api_error(mpv_request_log_messages(ctx, "no"));
+
+    const char *names[] = {"volume", "nonexistent-property", "idle-active", NULL};
+    mpv_node res;
+    check_api_error(mpv_get_property_list(ctx, names, &res));
+    if (res.u.list->num != 3)
+        fail("List: expected 3 property entries!\n");
+    check_list_entry(&res, 0, 0, MPV_FORMAT_DOUBLE);
+    check_list_entry(&res, 1, MPV_ERROR_PROPERTY_NOT_FOUND, 0);
+    check_list_entry(&res, 2, 0, MPV_FORMAT_FLAG);
+    mpv_free_node_contents(&res);
+
+    mpv_node expand_args[] = {STR_NODE("expand-text"), STR_NODE("${idle-active}")};
+    mpv_node unknown_args[] = {STR_NODE("nonexistent-command")};
+    mpv_node fail_args[] = {STR_NODE("set"), STR_NODE("nonexistent-property"),
+                            STR_NODE("1")};
+    mpv_node set_args[] = {STR_NODE("set"), STR_NODE("volume"), STR_NODE("50")};
+    mpv_node_list expand = {2, expand_args}, unknown = {1, unknown_args},
+                  failing = {3, fail_args}, set = {3, set_args};
+    mpv_node cmd_nodes[] = {LIST_NODE(expand), LIST_NODE(unknown),
+                            LIST_NODE(failing), LIST_NODE(set)};
+    mpv_node_list cmd_list = {4, cmd_nodes};
+    mpv_node cmds = LIST_NODE(cmd_list);
+
+    check_api_error(mpv_command_list(ctx, &cmds, &res));
+    if (res.u.list->num != 4)
+        fail("List: expected 4 command entries!\n");
+    check_list_entry(&res, 0, 0, MPV_FORMAT_STRING);
+    if (strcmp(node_map_get(&res.u.list->values[0], "data")->u.string, "yes") != 0)
+        fail("List: unexpected expand-text result!\n");
+    check_list_entry(&res, 1, MPV_ERROR_INVALID_PARAMETER, 0);
+    check_list_entry(&res, 2, MPV_ERROR_COMMAND, 0);
+    check_list_entry(&res, 3, 0, 0);
+    mpv_free_node_contents(&res);
+    check_double("volume", 50);
+
+    // Async variants: both replies carry their own userdata.
+    check_api_error(mpv_set_property_string(ctx, "volume", "100"));
+    check_api_error(mpv_get_property_list_async(ctx, 35, names));
+    check_api_error(mpv_command_list_async(ctx, 36, &cmds));
+    int replies = 0;
+    while (replies != 3) {
+        mpv_event *event = mpv_wait_event(ctx, 10);
+        if (event->event_id == MPV_EVENT_NONE)
+            fail("List: timeout waiting for async replies!\n");
+        if (event->event_id != MPV_EVENT_COMMAND_REPLY)
+            continue;
+        check_api_error(event->error);
+        mpv_node *result = &((mpv_event_command *)event->data)->result;
+        if (event->reply_userdata == 35 && !(replies & 1)) {
+            check_list_entry(result, 0, 0, MPV_FORMAT_DOUBLE);
+            check_list_entry(result, 1, MPV_ERROR_PROPERTY_NOT_FOUND, 0);
+            check_list_entry(result, 2, 0, MPV_FORMAT_FLAG);
+            replies |= 1;
+        } else if (event->reply_userdata == 36 && !(replies & 2)) {
+            check_list_entry(result, 0, 0, MPV_FORMAT_STRING);
+            check_list_entry(result, 1, MPV_ERROR_INVALID_PARAMETER, 0);
+            check_list_entry(result, 2, MPV_ERROR_COMMAND, 0);
+            check_list_entry(result, 3, 0, 0);
+            replies |= 2;
+        } else {
+            fail("List: unexpected reply userdata %" PRIu64 "!\n",
+                 event->reply_userdata);
+        }
+    }
+    check_double("volume", 50);
+    check_api_error(mpv_set_property_string(ctx, "volume", "100"));
+
+    check_api_error(mpv_request_log_messages(ctx, "debug"));
+}
+
 // Ensure that setting options/properties work correctly and
 // have the expected values.
 static void test_options_and_properties(void)
@@ -294,6 +601,12 @@ int main(int argc, char *argv[])
     test_file_loading(argv[1]);
     printf(fmt, "test_lavfi_complex");
     test_lavfi_complex(argv[1]);
+    printf(fmt, "test_screenshot_thumbnails");
+    test_screenshot_thumbnails(argv[1]);
+    printf(fmt, "test_observe_property_delta");
+    test_observe_property_delta(argv[1]);
+    printf(fmt, "test_list_requests");
+    test_list_requests();
 
     printf("================ SHUTDOWN ================\n");
     mpv_command_string(ctx, "quit");
@@ -0,0 +1,138 @@
+#include "misc/msgpack.h"
+#include "misc/node.h"
+#include "test_utils.h"
+
+struct entry {
+    const char *src;    // MessagePack data
+    int src_len;
+    struct mpv_node out_data;
+    bool expect_fail;
+    bool not_canonical; // writing out_data doesn't produce src
+};
+
+#define B(s) s, sizeof(s) - 1
+
+#define VAL_LIST(...) (struct mpv_node[]){__VA_ARGS__}
+
+#define L(...) __VA_ARGS__
+
+#define NODE_INT64(v) {.format = MPV_FORMAT_INT64,  .u = { .int64 = (v) }}
+#define NODE_STR(v)   {.format = MPV_FORMAT_STRING, .u = { .string = (v) }}
+#define NODE_BOOL(v)  {.format = MPV_FORMAT_FLAG,   .u = { .flag = (bool)(v) }}
+#define NODE_FLOAT(v) {.format = MPV_FORMAT_DOUBLE, .u = { .double_ = (v) }}
+#define NODE_NONE()   {.format = MPV_FORMAT_NONE }
+#define NODE_BYTES(v) {.format = MPV_FORMAT_BYTE_ARRAY, .u = { .ba =        \
+    &(struct mpv_byte_array) {.data = (v), .size = sizeof(v) - 1}}}
+#define NODE_ARRAY(...) {.format = MPV_FORMAT_NODE_ARRAY, .u = { .list =    \
+    &(struct mpv_node_list) {                                               \
+        .num = sizeof(VAL_LIST(__VA_ARGS__)) / sizeof(struct mpv_node),     \
+        .values = VAL_LIST(__VA_ARGS__)}}}
+#define NODE_MAP(k, v) {.format = MPV_FORMAT_NODE_MAP, .u = { .list =       \
+    &(struct mpv_node_list) {                                               \
+        .num = sizeof(VAL_LIST(v)) / sizeof(struct mpv_node),               \
+        .values = VAL_LIST(v),                                              \
+        .keys = (char**)(const char *[]){k}}}}
+
+static const struct entry entries[] = {
+    { B("\xc0"), NODE_NONE()},
+    { B("\xc3"), NODE_BOOL(true)},
+    { B("\xc2"), NODE_BOOL(false)},
+    { B(""), .expect_fail = true},
+    { B("\x7f"), NODE_INT64(127)},
+    { B("\xe0"), NODE_INT64(-32)},
+    { B("\xcc\x80"), NODE_INT64(128)},
+    { B("\xcd\x01\x00"), NODE_INT64(256)},
+    { B("\xce\x00\x01\x00\x00"), NODE_INT64(65536)},
+    { B("\xcf\x00\x00\x00\x01\x00\x00\x00\x00"), NODE_INT64(INT64_C(1) << 32)},
+    { B("\xcf\x80\x00\x00\x00\x00\x00\x00\x00"), .expect_fail = true},
+    { B("\xd0\xdf"), NODE_INT64(-33)},
+    { B("\xd1\xff\x7f"), NODE_INT64(-129)},
+    { B("\xd2\xff\xff\x7f\xff"), NODE_INT64(-32769)},
+    { B("\xd3\x80\x00\x00\x00\x00\x00\x00\x00"), NODE_INT64(INT64_MIN)},
+    { B("\xcc\x05"), NODE_INT64(5), .not_canonical = true},
+    { B("\xcd\x01"), .expect_fail = true},
+    { B("\xcb\x40\x5e\xd0\x00\x00\x00\x00\x00"), NODE_FLOAT(123.25)},
+    { B("\xca\x42\xf6\xa0\x00"), NODE_FLOAT(123.3125), .not_canonical = true},
+    { B("\xa3" "abc"), NODE_STR("abc")},
+    { B("\xd9\x03" "abc"), NODE_STR("abc"), .not_canonical = true},
+    { B("\xa3" "ab"), .expect_fail = true},
+    { B("\xa3" "a\0c"), .expect_fail = true},
+    { B("\xc4\x02" "a\0"), NODE_BYTES("a\0")},
+    { B("\x93\x01\x02\x03"),
+        NODE_ARRAY(NODE_INT64(1), NODE_INT64(2), NODE_INT64(3))},
+    { B("\x90"), NODE_ARRAY()},
+    { B("\xdc\x00\x01\xc0"), NODE_ARRAY(NODE_NONE()), .not_canonical = true},
+    { B("\x93\x01\x02"), .expect_fail = true},
+    { B("\x82\xa1" "a\x01\xa1" "b\x02"),
+        NODE_MAP(L("a", "b"), L(NODE_INT64(1), NODE_INT64(2)))},
+    { B("\x80"), NODE_MAP(L(), L())},
+    { B("\x81\x01\x02"), .expect_fail = true},
+    { B("\xdd\xff\xff\xff\xff"), .expect_fail = true},
+    { B("\xd4\x01\x00"), .expect_fail = true},
+    { B("\xc1"), .expect_fail = true},
+};
+
+// Check round trips for all sizes of the variable-length encodings.
+static void test_lengths(void)
+{
+    void *tmp = talloc_new(NULL);
+    static const int lengths[] = {0, 15, 16, 31, 32, 255, 256, 65535, 65536};
+    for (int n = 0; n < MP_ARRAY_SIZE(lengths); n++) {
+        int len = lengths[n];
+        char *str = talloc_zero_size(tmp, len + 1);
+        memset(str, 'x', len);
+        struct mpv_node node;
+        node_init(&node, MPV_FORMAT_NODE_MAP, NULL);
+        talloc_steal(tmp, node.u.list);
+        node_map_add_string(&node, "str", str);
+        struct mpv_node *arr = node_map_add(&node, "arr", MPV_FORMAT_NODE_ARRAY);
+        for (int i = 0; i < len; i++)
+            node_array_add(arr, MPV_FORMAT_NONE);
+
+        bstr data = {0};
+        assert_true(msgpack_write(tmp, &data, &node) >= 0);
+        struct mpv_node res;
+        assert_true(msgpack_parse(tmp, &res, &data, MAX_MSGPACK_DEPTH) >= 0);
+        assert_int_equal(data.len, 0);
+        assert_true(equal_mpv_node(&node, &res));
+    }
+    int64_t ints[] = {INT64_MIN, INT32_MIN - INT64_C(1), INT32_MIN, -32769,
+                      -32768, -129, -128, -33, 255, 256, 65535, 65536,
+                      UINT32_MAX, UINT32_MAX + INT64_C(1), INT64_MAX};
+    for (int n = 0; n < MP_ARRAY_SIZE(ints); n++) {
+        struct mpv_node node = NODE_INT64(ints[n]), res;
+        bstr data = {0};
+        assert_true(msgpack_write(tmp, &data, &node) >= 0);
+        assert_true(msgpack_parse(tmp, &res, &data, MAX_MSGPACK_DEPTH) >= 0);
+        assert_int_equal(data.len, 0);
+        assert_true(equal_mpv_node(&node, &res));
+    }
+    talloc_free(tmp);
+}
+
+int main(void)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(entries); n++) {
+        const struct entry *e = &entries[n];
+        void *tmp = talloc_new(NULL);
+        bstr src = {talloc_memdup(tmp, (void *)e->src, e->src_len), e->src_len};
+        struct mpv_node res;
+        bool ok = msgpack_parse(tmp, &res, &src, MAX_MSGPACK_DEPTH) >= 0;
+        assert_true(ok != e->expect_fail);
+        if (!ok) {
+            talloc_free(tmp);
+            continue;
+        }
+        assert_int_equal(src.len, 0);
+        assert_true(equal_mpv_node(&e->out_data, &res));
+        bstr d = {0};
+        assert_true(msgpack_write(tmp, &d, &res) >= 0);
+        if (!e->not_canonical) {
+            assert_int_equal(d.len, e->src_len);
+            assert_memcmp(d.start, e->src, d.len);
+        }
+        talloc_free(tmp);
+    }
+    test_lengths();
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "misc/natural_sort.h"
+#include "test_utils.h"
+
+static const char *const names[] = {
+    "", "a", "A", "b", "ab", "a0", "a00", "a1", "a01", "a001b", "a1b", "a2",
+    "a10", "a010", "a9", "a99", "a100", "0", "00", "1", "10", "9", "100a",
+    "file 2.mkv", "file 10.mkv", "File 1.mkv", "file_1.mkv", "file-1.mkv",
+    "file1.mkv", "file.mkv", "-", "_", "~", "Z", "z", "[1]", "x/1", "x1",
+    "\xc3\xa4", "\xc3\x84", "0a", "00a", "1.5", "1.10", "99999999999999999999",
+    "100000000000000000000",
+};
+
+static int sign(int v)
+{
+    return v < 0 ? -1 : v > 0 ? 1 : 0;
+}
+
+int main(void)
+{
+    void *tmp = talloc_new(NULL);
+    for (int a = 0; a < MP_ARRAY_SIZE(names); a++) {
+        bstr key_a = mp_natural_sort_key(tmp, names[a]);
+        for (int b = 0; b < MP_ARRAY_SIZE(names); b++) {
+            bstr key_b = mp_natural_sort_key(tmp, names[b]);
+            assert_int_equal(sign(bstrcmp(key_a, key_b)),
+                             sign(mp_natural_sort_cmp(names[a], names[b])));
+        }
+    }
+    talloc_free(tmp);
+    return 0;
+}
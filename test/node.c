@@ -0,0 +1,176 @@
+#include "misc/node.h"
+#include "test_utils.h"
+
+static const char *const id_key[] = {"id", NULL};
+
+// Entries are maps {"id": id, "v": val}; ids[n] < 0 terminates the list.
+static void make_list(struct mpv_node *dst, const int *ids, const int *vals)
+{
+    node_init(dst, MPV_FORMAT_NODE_ARRAY, NULL);
+    for (int n = 0; ids[n] >= 0; n++) {
+        struct mpv_node *e = node_array_add(dst, MPV_FORMAT_NODE_MAP);
+        node_map_add_int64(e, "id", ids[n]);
+        node_map_add_int64(e, "v", vals ? vals[n] : 0);
+    }
+}
+
+static int64_t get_int(struct mpv_node *map, const char *key)
+{
+    struct mpv_node *v = node_map_get(map, key);
+    assert_true(v && v->format == MPV_FORMAT_INT64);
+    return v->u.int64;
+}
+
+// Apply the ops to a plain array of entry pointers.
+static int apply_ops(struct mpv_node **list, int num, struct mpv_node *ops)
+{
+    for (int i = 0; i < ops->u.list->num; i++) {
+        struct mpv_node *op = &ops->u.list->values[i];
+        struct mpv_node *name = node_map_get(op, "op");
+        assert_true(name && name->format == MPV_FORMAT_STRING);
+        if (!strcmp(name->u.string, "insert")) {
+            int index = get_int(op, "index");
+            struct mpv_node_list *entries = node_map_get(op, "entries")->u.list;
+            assert_true(index >= 0 && index <= num);
+            memmove(list + index + entries->num, list + index,
+                    (num - index) * sizeof(list[0]));
+            for (int n = 0; n < entries->num; n++)
+                list[index + n] = &entries->values[n];
+            num += entries->num;
+        } else if (!strcmp(name->u.string, "remove")) {
+            int index = get_int(op, "index");
+            int count = get_int(op, "count");
+            assert_true(index >= 0 && count > 0 && index + count <= num);
+            memmove(list + index, list + index + count,
+                    (num - index - count) * sizeof(list[0]));
+            num -= count;
+        } else if (!strcmp(name->u.string, "move")) {
+            int from = get_int(op, "from");
+            int to = get_int(op, "to");
+            assert_true(from >= 0 && from < num && to >= 0 && to < num);
+            struct mpv_node *e = list[from];
+            if (from < to) {
+                memmove(list + from, list + from + 1, (to - from) * sizeof(list[0]));
+            } else {
+                memmove(list + to + 1, list + to, (from - to) * sizeof(list[0]));
+            }
+            list[to] = e;
+        } else if (!strcmp(name->u.string, "update")) {
+            int index = get_int(op, "index");
+            assert_true(index >= 0 && index < num);
+            list[index] = node_map_get(op, "entry");
+        } else {
+            assert_true(false);
+        }
+    }
+    return num;
+}
+
+static void check_diff(const int *ids_a, const int *vals_a, const int *ids_b,
+                       const int *vals_b, const char *const *keys, int max_ops)
+{
+    struct mpv_node a, b, ops;
+    make_list(&a, ids_a, vals_a);
+    make_list(&b, ids_b, vals_b);
+    node_init(&ops, MPV_FORMAT_NODE_ARRAY, NULL);
+    node_array_diff(&ops, &a, &b, keys);
+    assert_true(ops.u.list->num <= max_ops);
+
+    int size = a.u.list->num + b.u.list->num + 1;
+    struct mpv_node **list = talloc_array(NULL, struct mpv_node *, size);
+    for (int n = 0; n < a.u.list->num; n++)
+        list[n] = &a.u.list->values[n];
+    int num = apply_ops(list, a.u.list->num, &ops);
+    assert_int_equal(num, b.u.list->num);
+    for (int n = 0; n < num; n++)
+        assert_true(equal_mpv_node(list[n], &b.u.list->values[n]));
+
+    talloc_free(list);
+    talloc_free(a.u.list);
+    talloc_free(b.u.list);
+    talloc_free(ops.u.list);
+}
+
+// Compare node_map_index_get() against node_map_bget() for all keys.
+static void check_index(struct node_map_index *index, struct mpv_node *map,
+                        int max_key)
+{
+    for (int n = 0; n <= max_key; n++) {
+        char key[20];
+        snprintf(key, sizeof(key), "key%d", n);
+        struct mpv_node *a = node_map_index_get(index, map, bstr0(key));
+        assert_true(a == node_map_bget(map, bstr0(key)));
+    }
+}
+
+static void test_map_index(void)
+{
+    struct node_map_index *index = node_map_index_create(NULL);
+    struct mpv_node small, map;
+    node_init(&small, MPV_FORMAT_NODE_MAP, NULL);
+    node_init(&map, MPV_FORMAT_NODE_MAP, NULL);
+    node_map_add_int64(&small, "key1", 1);
+    check_index(index, &small, 2);
+    for (int n = 0; n < 1000; n++) {
+        char key[20];
+        snprintf(key, sizeof(key), "key%d", n);
+        node_map_add_int64(&map, key, n);
+        // Appended entries are picked up, including while the table grows.
+        if (n % 97 == 0)
+            check_index(index, &map, n + 1);
+    }
+    check_index(index, &map, 1001);
+    assert_true(!node_map_index_get(index, &map, bstr0("key")));
+
+    // Duplicate keys return the first entry, like node_map_bget().
+    node_map_add_int64(&map, "key500", -1);
+    struct mpv_node *entry = node_map_index_get(index, &map, bstr0("key500"));
+    assert_true(entry == &map.u.list->values[500]);
+
+    // Removing entries requires a reset.
+    struct mpv_node_list *list = map.u.list;
+    list->num = 500;
+    node_map_index_reset(index);
+    check_index(index, &map, 1001);
+
+    entry = node_map_index_get(index, &map, bstr0("key20"));
+    assert_true(entry == &list->values[20]);
+    assert_true(!node_map_index_get(index, &small, bstr0("key20")));
+
+    talloc_free(small.u.list);
+    talloc_free(map.u.list);
+    talloc_free(index);
+}
+
+#define L(...) (const int[]){__VA_ARGS__, -1}
+#define EMPTY (const int[]){-1}
+
+int main(void)
+{
+    // No change.
+    check_diff(L(1, 2, 3), NULL, L(1, 2, 3), NULL, id_key, 0);
+    // Append, prepend, insert in the middle.
+    check_diff(L(1, 2, 3), NULL, L(1, 2, 3, 4), NULL, id_key, 1);
+    check_diff(L(1, 2, 3), NULL, L(0, 1, 2, 3), NULL, id_key, 1);
+    check_diff(L(1, 2, 3), NULL, L(1, 5, 6, 2, 3), NULL, id_key, 1);
+    // Removal.
+    check_diff(L(1, 2, 3, 4), NULL, L(1, 4), NULL, id_key, 1);
+    check_diff(L(1, 2, 3), NULL, EMPTY, NULL, id_key, 1);
+    check_diff(EMPTY, NULL, L(1, 2, 3), NULL, id_key, 1);
+    // Single entry moved in either direction, with a changed value.
+    check_diff(L(1, 2, 3, 4, 5), NULL, L(1, 3, 4, 5, 2), L(0, 0, 0, 0, 7), id_key, 2);
+    check_diff(L(1, 2, 3, 4, 5), NULL, L(1, 5, 2, 3, 4), L(0, 0, 9, 0, 0), id_key, 2);
+    // Swapping two adjacent entries is a move too.
+    check_diff(L(1, 2, 3, 4), NULL, L(1, 3, 2, 4), NULL, id_key, 1);
+    // Changed values only.
+    check_diff(L(1, 2, 3), L(1, 2, 3), L(1, 2, 3), L(1, 5, 3), id_key, 1);
+    // Arbitrary reordering still produces the correct result.
+    check_diff(L(1, 2, 3, 4, 5, 6), NULL, L(6, 4, 2, 5, 3, 1), NULL, id_key, 2);
+    check_diff(L(1, 2, 3), NULL, L(4, 5), NULL, id_key, 2);
+    // Positional comparison (e.g. chapters).
+    check_diff(L(1, 2, 3), NULL, L(1, 7, 3, 4), NULL, NULL, 2);
+    check_diff(L(1, 2, 3), NULL, L(1), NULL, NULL, 1);
+
+    test_map_index();
+    return 0;
+}
@@ -0,0 +1,261 @@
+#include "common/common.h"
+#include "common/playlist.h"
+#include "misc/random.h"
+#include "test_utils.h"
+
+// playlist.c is linked without the demux and stream layers.
+char *mp_file_url_to_filename(void *talloc_ctx, bstr url)
+{
+    return NULL;
+}
+
+struct demuxer_params;
+struct demuxer *demux_open_url(const char *url, struct demuxer_params *params,
+                               struct mp_cancel *cancel,
+                               struct mpv_global *global)
+{
+    return NULL;
+}
+
+void demux_free(struct demuxer *demuxer)
+{
+}
+
+// Reference implementation: a flat array of the entries, with the semantics
+// of the playlist functions before entries were stored in blocks.
+struct model {
+    struct playlist_entry **entries;
+    int num;
+    struct playlist_entry *current;
+    bool current_was_replaced;
+};
+
+static int rnd(int n)
+{
+    return n > 0 ? mp_rand_next() % n : 0;
+}
+
+static int model_index(struct model *m, struct playlist_entry *e)
+{
+    for (int n = 0; n < m->num; n++) {
+        if (m->entries[n] == e)
+            return n;
+    }
+    return -1;
+}
+
+static void check(struct playlist *pl, struct model *m)
+{
+    assert_int_equal(playlist_entry_count(pl), m->num);
+    assert_true(pl->current == m->current);
+    assert_int_equal(pl->current_was_replaced, m->current_was_replaced);
+    assert_true(playlist_get_first(pl) == (m->num ? m->entries[0] : NULL));
+    assert_true(playlist_get_last(pl) ==
+                (m->num ? m->entries[m->num - 1] : NULL));
+
+    // Random accesses first, so that the lazily updated indexes are not only
+    // exercised front to back.
+    for (int n = 0; n < 8 && m->num; n++) {
+        int i = rnd(m->num);
+        if (n & 1) {
+            assert_int_equal(playlist_entry_to_index(pl, m->entries[i]), i);
+        } else {
+            assert_true(playlist_entry_from_index(pl, i) == m->entries[i]);
+        }
+    }
+
+    for (int n = 0; n < m->num; n++) {
+        struct playlist_entry *e = m->entries[n];
+        assert_true(e->pl == pl);
+        assert_true(playlist_entry_from_index(pl, n) == e);
+        assert_int_equal(playlist_entry_to_index(pl, e), n);
+        assert_true(playlist_entry_get_rel(e, 1) ==
+                    (n + 1 < m->num ? m->entries[n + 1] : NULL));
+        assert_true(playlist_entry_get_rel(e, -1) ==
+                    (n ? m->entries[n - 1] : NULL));
+    }
+    assert_true(!playlist_entry_from_index(pl, -1));
+    assert_true(!playlist_entry_from_index(pl, m->num));
+}
+
+static void model_insert(struct model *m, int index, struct playlist_entry *e)
+{
+    MP_TARRAY_INSERT_AT(NULL, m->entries, m->num, index, e);
+}
+
+static void model_remove(struct model *m, int index)
+{
+    if (m->current == m->entries[index]) {
+        m->current = index + 1 < m->num ? m->entries[index + 1] : NULL;
+        m->current_was_replaced = true;
+    }
+    MP_TARRAY_REMOVE_AT(m->entries, m->num, index);
+}
+
+static void op_insert(struct playlist *pl, struct model *m)
+{
+    int index = rnd(m->num + 1);
+    struct playlist_entry *e = playlist_entry_new("file");
+    playlist_insert_at(pl, e, index < m->num ? m->entries[index] : NULL);
+    model_insert(m, index, e);
+}
+
+static void op_remove(struct playlist *pl, struct model *m)
+{
+    if (!m->num)
+        return;
+    // Sometimes remove a range, to make blocks shrink and merge.
+    int index = rnd(m->num);
+    int count = rnd(4) ? 1 : 1 + rnd(MPMIN(m->num - index, 1500));
+    for (int n = 0; n < count; n++) {
+        playlist_remove(pl, m->entries[index]);
+        model_remove(m, index);
+    }
+}
+
+static void op_move(struct playlist *pl, struct model *m)
+{
+    if (!m->num)
+        return;
+    struct playlist_entry *e = m->entries[rnd(m->num)];
+    int at_index = rnd(m->num + 1);
+    struct playlist_entry *at = at_index < m->num ? m->entries[at_index] : NULL;
+    playlist_move(pl, e, at);
+    if (e == at)
+        return;
+    MP_TARRAY_REMOVE_AT(m->entries, m->num, model_index(m, e));
+    model_insert(m, at ? model_index(m, at) : m->num, e);
+}
+
+static void op_transfer(struct playlist *pl, struct model *m)
+{
+    // Where playlist_transfer_entries() adds the entries.
+    int index = m->num;
+    if (m->current) {
+        index = model_index(m, m->current) + 1;
+        if (m->current_was_replaced)
+            index += 1;
+    }
+    // (Not usable if the last entry replaced the removed current entry.)
+    bool to_current = rnd(2) && index <= m->num;
+    if (!to_current)
+        index = rnd(m->num + 1);
+
+    struct playlist *src = talloc_zero(NULL, struct playlist);
+    // Sometimes more than a block, to cover rebuilding the playlist.
+    int count = rnd(4) ? rnd(20) : 500 + rnd(800);
+    for (int n = 0; n < count; n++)
+        playlist_append_file(src, "new");
+    for (int n = 0; n < count; n++)
+        model_insert(m, index + n, playlist_entry_from_index(src, n));
+
+    int64_t id = to_current ? playlist_transfer_entries(pl, src)
+                            : playlist_transfer_entries_to(pl, index, src);
+    assert_int_equal(playlist_entry_count(src), 0);
+    for (int n = 0; n < count; n++)
+        assert_int_equal(m->entries[index + n]->id, id + n);
+    talloc_free(src);
+}
+
+static struct playlist_entry **sorted_unshuffle;
+
+static int cmp_unshuffle(const void *a, const void *b)
+{
+    int ia = *(int *)a, ib = *(int *)b;
+    struct playlist_entry *ea = sorted_unshuffle[ia];
+    struct playlist_entry *eb = sorted_unshuffle[ib];
+    if (ea->original_index >= 0 && ea->original_index != eb->original_index)
+        return ea->original_index > eb->original_index ? 1 : -1;
+    return ia == ib ? 0 : (ia > ib ? 1 : -1);
+}
+
+static void op_shuffle(struct playlist *pl, struct model *m)
+{
+    size_t size = m->num * sizeof(m->entries[0]);
+    struct playlist_entry **before = talloc_memdup(NULL, m->entries, size);
+    playlist_shuffle(pl);
+
+    // Must be a permutation; take over the new order.
+    for (int n = 0; n < m->num; n++) {
+        struct playlist_entry *e = playlist_entry_from_index(pl, n);
+        assert_true(before[e->original_index] == e);
+        m->entries[n] = e;
+    }
+    check(pl, m);
+
+    // Unshuffling right away restores the original order.
+    if (rnd(2)) {
+        playlist_unshuffle(pl);
+        memcpy(m->entries, before, size);
+    }
+    talloc_free(before);
+}
+
+static void op_unshuffle(struct playlist *pl, struct model *m)
+{
+    // Same sort as the original implementation: by original_index, ties (and
+    // entries added after shuffling) by the current index.
+    int *order = talloc_array(NULL, int, m->num);
+    for (int n = 0; n < m->num; n++)
+        order[n] = n;
+    sorted_unshuffle = m->entries;
+    if (m->num)
+        qsort(order, m->num, sizeof(order[0]), cmp_unshuffle);
+    struct playlist_entry **entries =
+        talloc_array(NULL, struct playlist_entry *, m->num);
+    for (int n = 0; n < m->num; n++)
+        entries[n] = m->entries[order[n]];
+    memcpy(m->entries, entries, m->num * sizeof(m->entries[0]));
+    talloc_free(entries);
+    talloc_free(order);
+
+    playlist_unshuffle(pl);
+}
+
+static void op_set_current(struct playlist *pl, struct model *m)
+{
+    int index = rnd(m->num + 1);
+    m->current = index < m->num ? m->entries[index] : NULL;
+    m->current_was_replaced = false;
+    pl->current = m->current;
+    pl->current_was_replaced = false;
+}
+
+int main(void)
+{
+    mp_rand_seed(43);
+
+    struct playlist *pl = talloc_zero(NULL, struct playlist);
+    struct model m = {0};
+    for (int n = 0; n < 1500; n++) {
+        struct playlist_entry *e = playlist_entry_new("file");
+        playlist_insert_at(pl, e, NULL);
+        model_insert(&m, m.num, e);
+    }
+    check(pl, &m);
+
+    static void (*const ops[])(struct playlist *pl, struct model *m) = {
+        op_insert, op_insert, op_remove, op_remove, op_move, op_move,
+        op_transfer, op_shuffle, op_unshuffle, op_set_current,
+    };
+
+    for (int step = 0; step < 3000; step++) {
+        // Keep the size in a range where blocks are split and merged.
+        if (m.num > 5000) {
+            op_remove(pl, &m);
+        } else {
+            ops[rnd(MP_ARRAY_SIZE(ops))](pl, &m);
+        }
+        check(pl, &m);
+    }
+
+    playlist_clear(pl);
+    m.num = 0;
+    m.current = NULL;
+    m.current_was_replaced = false;
+    check(pl, &m);
+
+    talloc_free(m.entries);
+    talloc_free(pl);
+    return 0;
+}
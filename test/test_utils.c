@@ -5,6 +5,7 @@
 #include "options/path.h"
 #include "osdep/subprocess.h"
 #include "osdep/terminal.h"
+#include "osdep/timer.h"
 #include "test_utils.h"
 
 #ifdef NDEBUG
@@ -55,6 +56,28 @@ FILE *test_open_out(const char *outdir, const char *name)
     return f;
 }
 
+#define BENCH_REPEAT 5
+
+void bench_run(const char *name, int iterations, void (*fn)(void *ctx),
+               void *ctx)
+{
+    mp_time_init();
+
+    fn(ctx); // warmup
+
+    int64_t best = INT64_MAX;
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        int64_t start = mp_time_ns();
+        for (int n = 0; n < iterations; n++)
+            fn(ctx);
+        best = MPMIN(best, mp_time_ns() - start);
+    }
+
+    printf("%-36s %10d %14.1f\n", name, iterations,
+           best / (double)MPMAX(iterations, 1));
+    fflush(stdout);
+}
+
 void assert_text_files_equal_impl(const char *file, int line,
                                   const char *refdir, const char *outdir,
                                   const char *ref, const char *new,
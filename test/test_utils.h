@@ -41,6 +41,13 @@ void assert_memcmp_impl(const char *file, int line,
 // Open a new file in the build dir path. Always succeeds.
 FILE *test_open_out(const char *outdir, const char *name);
 
+// Benchmark helper for "meson test --benchmark". Call fn(ctx) the given number
+// of times, repeat that a few times, and print the fastest repetition as one
+// line in a fixed format, so that the output can be compared across runs:
+//   <name> <iterations> <nanoseconds per iteration>
+void bench_run(const char *name, int iterations, void (*fn)(void *ctx),
+               void *ctx);
+
 /* Stubs */
 
 // Files commonly import common/msg.h which requires these to be
@@ -172,6 +172,7 @@ struct vo_internal {
     double reported_display_fps;
 
     struct stats_ctx *stats;
+    struct stat_entry *stat_draw, *stat_flip, *stat_iterations;
 };
 
 extern const struct m_sub_options gl_video_conf;
@@ -294,6 +295,9 @@ static struct vo *vo_create(bool probing, struct mpv_global *global,
         .estimated_vsync_jitter = -1,
         .stats = stats_ctx_create(vo, global, "vo"),
     };
+    vo->in->stat_draw = stats_get_entry(vo->in->stats, "video-draw");
+    vo->in->stat_flip = stats_get_entry(vo->in->stats, "video-flip");
+    vo->in->stat_iterations = stats_get_entry(vo->in->stats, "iterations");
     mp_dispatch_set_wakeup_fn(vo->in->dispatch, dispatch_wakeup_cb, vo);
     mp_mutex_init(&vo->in->lock);
     mp_cond_init(&vo->in->wakeup);
@@ -968,15 +972,15 @@ static bool render_frame(struct vo *vo)
         if (can_queue)
             wakeup_core(vo);
 
-        stats_time_start(in->stats, "video-draw");
+        stats_entry_time_start(in->stat_draw);
 
         vo->driver->draw_frame(vo, frame);
 
-        stats_time_end(in->stats, "video-draw");
+        stats_entry_time_end(in->stat_draw);
 
         wait_until(vo, target);
 
-        stats_time_start(in->stats, "video-flip");
+        stats_entry_time_start(in->stat_flip);
 
         vo->driver->flip_page(vo);
 
@@ -991,7 +995,7 @@ static bool render_frame(struct vo *vo)
         if (vsync.last_queue_display_time <= 0)
             vsync.last_queue_display_time = mp_time_ns();
 
-        stats_time_end(in->stats, "video-flip");
+        stats_entry_time_end(in->stat_flip);
 
         mp_mutex_lock(&in->lock);
         in->dropped_frame = prev_drop_count < vo->in->drop_count;
@@ -1081,6 +1085,7 @@ static MP_THREAD_VOID vo_thread(void *ptr)
     bool vo_paused = false;
 
     mp_thread_set_name("vo");
+    stats_register_thread_cputime(in->stats, "thread");
 
     if (vo->driver->get_image) {
         in->dr_helper = dr_helper_create(in->dispatch, get_image_vo, vo);
@@ -1100,7 +1105,7 @@ static MP_THREAD_VOID vo_thread(void *ptr)
         mp_dispatch_queue_process(vo->in->dispatch, 0);
         if (in->terminate)
             break;
-        stats_event(in->stats, "iterations");
+        stats_entry_event(in->stat_iterations);
         vo->driver->control(vo, VOCTRL_CHECK_EVENTS, NULL);
         bool working = render_frame(vo);
         int64_t now = mp_time_ns();
@@ -1170,6 +1175,7 @@ static MP_THREAD_VOID vo_thread(void *ptr)
     vo->driver->uninit(vo);
 done:
     TA_FREEP(&in->dr_helper);
+    stats_unregister_thread(in->stats, "thread");
     MP_THREAD_RETURN();
 }
 